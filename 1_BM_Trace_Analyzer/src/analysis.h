@@ -0,0 +1,742 @@
+// analysis.h
+// Declares the analysis passes run over each trace record, and the engine
+// that fuses a set of passes into a single loop over the trace.
+//
+// Each pass is a policy class with these members:
+//
+//     enum { NEEDS_PC = 0 or 1 };           // whether add() looks at the PC
+//     explicit Pass(AnalysisStats *stats);  // set up; keep stats for later
+//     inline void add(uint64_t pc, uint8_t optype);  // account for one record
+//     void add_opmix(const uint64_t *hist);  // see below
+//     void publish();                       // write running totals into stats
+//     void finish();                        // write results into stats
+//
+// AnalysisEngine<PassA, PassB, ...> inherits from every pass and calls each
+// pass's add() in turn inside one loop over a batch of records. The passes
+// are known at compile time, so the calls are inlined into the loop: adding
+// a metric adds work to the same scan instead of another pass over the trace,
+// and there is no virtual call per record. The only virtual calls are the
+// ones through the type-erased Analyzer interface, once per batch.
+//
+// Passes that do not need the PC (NEEDS_PC == 0) instead see the whole batch
+// at once, as the number of records of each op type passed to add_opmix().
+// The engine counts that histogram once per batch with the SIMD kernels in
+// opmix.h, from the records or from the dense op-type column of a columnar
+// trace (see coltrace.h), and every such pass shares it. Only the passes that
+// need the PC share the fused loop, and they never have add_opmix() called,
+// so theirs can be empty.
+//
+// publish() writes the running totals behind the four required Lab 1
+// statistics into stats, so they can be read before the trace ends; passes
+// that do not feed those statistics leave it empty.
+
+#ifndef _ANALYSIS_H_
+#define _ANALYSIS_H_
+
+#include "trace.h"
+#include "cfg.h"
+#include "config.h"
+#include "hll.h"
+#include "icache.h"
+#include "opmix.h"
+#include "pcset.h"
+#include "reuse.h"
+#include "simpoint.h"
+#include "topk.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** The results of analyzing one trace. */
+typedef struct AnalysisStatsStruct
+{
+    /** Number of instructions executed by op type. */
+    uint64_t optype_dyn[NUM_OP_TYPES];
+    /** Total number of CPU cycles under the simple CPI model. */
+    uint64_t num_cycle;
+    /** Exact number of unique PCs. Only valid when UNIQUE_PC_EXACT is set. */
+    uint64_t unique_pc;
+    /** HyperLogLog estimate of the number of unique PCs. */
+    uint64_t unique_pc_approx;
+    /** Relative standard error of unique_pc_approx. */
+    double unique_pc_std_error;
+    /** Heavy-hitter sketch of the hottest PCs. */
+    SpaceSaving top_pc;
+    /** Basic-block vector profile and simulation points. */
+    SimPointProfiler simpoint;
+    /** Reuse distances and working set of instruction cache lines. */
+    ReuseProfiler line_reuse;
+    /** Reuse distances and working set of instruction pages. */
+    ReuseProfiler page_reuse;
+    /** Misses of every simulated instruction cache. */
+    ICacheProfiler icache;
+    /** Control-flow graph, branch outcomes, and loops. */
+    CfgProfiler cfg;
+
+    AnalysisStatsStruct()
+        : num_cycle(0), unique_pc(0), unique_pc_approx(0),
+          unique_pc_std_error(0.0), top_pc(1)
+    {
+        memset(optype_dyn, 0, sizeof(optype_dyn));
+    }
+} AnalysisStats;
+
+/**
+ * Cycles per instruction of each op type in the simple CPI model:
+ * ALU 1, LD 2, ST 2, CBR 3, OTHER 1.
+ */
+extern const uint64_t CPI_MODEL[NUM_OP_TYPES];
+
+/** Counts instructions by op type. */
+class OpMixPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 0
+    };
+
+    explicit OpMixPass(AnalysisStats *stats) : stats(stats)
+    {
+        memset(optype_dyn, 0, sizeof(optype_dyn));
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        optype_dyn[optype]++;
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+        for (int i = 0; i < NUM_OP_TYPES; i++)
+        {
+            optype_dyn[i] += hist[i];
+        }
+    }
+
+    void publish()
+    {
+        memcpy(stats->optype_dyn, optype_dyn, sizeof(optype_dyn));
+    }
+
+    void finish()
+    {
+        publish();
+    }
+
+private:
+    AnalysisStats *stats;
+    uint64_t optype_dyn[NUM_OP_TYPES];
+};
+
+/** Accumulates cycles under the simple CPI model. */
+class CpiModelPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 0
+    };
+
+    explicit CpiModelPass(AnalysisStats *stats) : stats(stats), num_cycle(0)
+    {
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        num_cycle += CPI_MODEL[optype];
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+        num_cycle += opmix_cycles(hist, CPI_MODEL);
+    }
+
+    void publish()
+    {
+        stats->num_cycle = num_cycle;
+    }
+
+    void finish()
+    {
+        publish();
+    }
+
+private:
+    AnalysisStats *stats;
+    uint64_t num_cycle;
+};
+
+/** Counts unique PCs exactly with a PcSet. */
+class UniquePcPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit UniquePcPass(AnalysisStats *stats) : stats(stats)
+    {
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        pcs.insert(pc);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+        stats->unique_pc = pcs.size();
+    }
+
+    void finish()
+    {
+        publish();
+    }
+
+private:
+    AnalysisStats *stats;
+    PcSet pcs;
+};
+
+/** Estimates unique PCs with a HyperLogLog sketch of HLL_PRECISION. */
+class ApproxUniquePcPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit ApproxUniquePcPass(AnalysisStats *stats)
+        : stats(stats), hll(HLL_PRECISION)
+    {
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        hll.add(pc);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+        stats->unique_pc_approx = (uint64_t)(hll.estimate() + 0.5);
+        stats->unique_pc_std_error = hll.std_error();
+    }
+
+    void finish()
+    {
+        publish();
+    }
+
+private:
+    AnalysisStats *stats;
+    HyperLogLog hll;
+};
+
+/** Finds the hottest PCs with a Space-Saving sketch of TOPPC_COUNTERS. */
+class TopPcPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit TopPcPass(AnalysisStats *stats) : sketch(&stats->top_pc)
+    {
+        *sketch = SpaceSaving(TOPPC_COUNTERS);
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        sketch->add(pc, optype);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+    }
+
+private:
+    /** The sketch is the result, so it is updated in place in the stats. */
+    SpaceSaving *sketch;
+};
+
+/** Profiles basic-block vectors over SIMPOINT_INTERVAL-sized intervals. */
+class SimPointPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit SimPointPass(AnalysisStats *stats) : profiler(&stats->simpoint)
+    {
+        *profiler = SimPointProfiler(SIMPOINT_INTERVAL);
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        profiler->add(pc, optype);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+        profiler->finish(SIMPOINT_MAX_K);
+    }
+
+private:
+    /** The profile is the result, so it is updated in place in the stats. */
+    SimPointProfiler *profiler;
+};
+
+/**
+ * Measures reuse distances and the working set per REUSE_INTERVAL
+ * instructions, at both cache-line and page granularity.
+ */
+class ReusePass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit ReusePass(AnalysisStats *stats)
+        : lines(&stats->line_reuse), pages(&stats->page_reuse)
+    {
+        *lines = ReuseProfiler(REUSE_LINE_BITS, REUSE_INTERVAL);
+        *pages = ReuseProfiler(REUSE_PAGE_BITS, REUSE_INTERVAL);
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        lines->add(pc);
+        pages->add(pc);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+        lines->finish();
+        pages->finish();
+    }
+
+private:
+    /** The profiles are the results, so they are updated in place in the stats. */
+    ReuseProfiler *lines;
+    ReuseProfiler *pages;
+};
+
+/** Simulates every power-of-two LRU instruction cache at once. */
+class ICachePass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit ICachePass(AnalysisStats *stats) : profiler(&stats->icache)
+    {
+        // Only traces run with this pass pay for the simulator's stacks.
+        profiler->allocate();
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        profiler->add(pc);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+    }
+
+private:
+    /** The simulator is the result, so it is updated in place in the stats. */
+    ICacheProfiler *profiler;
+};
+
+/** Rebuilds the control-flow graph and finds loops. */
+class CfgPass
+{
+public:
+    enum
+    {
+        NEEDS_PC = 1
+    };
+
+    explicit CfgPass(AnalysisStats *stats) : profiler(&stats->cfg)
+    {
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        profiler->add(pc, optype);
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+        profiler->finish();
+    }
+
+private:
+    /** The profile is the result, so it is updated in place in the stats. */
+    CfgProfiler *profiler;
+};
+
+/**
+ * Wraps a pass that is only compiled into the engine when Enabled is true.
+ * The disabled form is empty, so its add() vanishes from the fused loop.
+ */
+template <typename Pass, bool Enabled>
+class OptionalPass : public Pass
+{
+public:
+    explicit OptionalPass(AnalysisStats *stats) : Pass(stats)
+    {
+    }
+};
+
+template <typename Pass>
+class OptionalPass<Pass, false>
+{
+public:
+    enum
+    {
+        NEEDS_PC = 0
+    };
+
+    explicit OptionalPass(AnalysisStats *stats)
+    {
+    }
+
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+    }
+
+    void add_opmix(const uint64_t *hist)
+    {
+    }
+
+    void publish()
+    {
+    }
+
+    void finish()
+    {
+    }
+};
+
+/** A type-erased analysis engine, so callers need not know its passes. */
+class Analyzer
+{
+public:
+    virtual ~Analyzer()
+    {
+    }
+
+    /**
+     * Run every pass over a batch of records.
+     *
+     * @param recs the records, all with valid op types
+     * @param num_recs the number of records in recs
+     */
+    virtual void analyze_batch(const TraceRec *recs, size_t num_recs) = 0;
+
+    /**
+     * Run every pass over a batch of records split into columns.
+     *
+     * @param pcs the PC of each record
+     * @param optypes the op type of each record, all valid
+     * @param num_recs the number of records
+     */
+    virtual void analyze_columns(const uint64_t *pcs, const uint8_t *optypes,
+                                 size_t num_recs) = 0;
+
+    /**
+     * Let every pass write its running totals into the stats, without
+     * ending the trace.
+     */
+    virtual void publish() = 0;
+
+    /** Let every pass write its results into the stats. */
+    virtual void finish() = 0;
+};
+
+/**
+ * Calls a pass's add() from the fused loop if the pass needs the PC, and
+ * otherwise its add_opmix() with the op-type histogram of the whole batch.
+ */
+template <typename Pass, bool NeedsPc = Pass::NEEDS_PC>
+struct BatchDispatch
+{
+    static inline void add(Pass *pass, uint64_t pc, uint8_t optype)
+    {
+        pass->add(pc, optype);
+    }
+
+    static inline void add_opmix(Pass *pass, const uint64_t *hist)
+    {
+    }
+};
+
+template <typename Pass>
+struct BatchDispatch<Pass, false>
+{
+    static inline void add(Pass *pass, uint64_t pc, uint8_t optype)
+    {
+    }
+
+    static inline void add_opmix(Pass *pass, const uint64_t *hist)
+    {
+        pass->add_opmix(hist);
+    }
+};
+
+/** Runs the passes Passes over each record in one fused loop. */
+template <typename... Passes>
+class AnalysisEngine : public Analyzer, private Passes...
+{
+public:
+    explicit AnalysisEngine(AnalysisStats *stats) : Passes(stats)...
+    {
+    }
+
+    void analyze_batch(const TraceRec *recs, size_t num_recs)
+    {
+        if (any_needs_opmix())
+        {
+            uint64_t hist[NUM_OP_TYPES] = {0};
+            opmix_count_records(recs, num_recs, hist);
+            dispatch_opmix(hist);
+        }
+
+        // Skip the fused loop entirely when only op types are analyzed.
+        if (!any_needs_pc())
+        {
+            return;
+        }
+        for (size_t i = 0; i < num_recs; i++)
+        {
+            int expand[] = {
+                0, (BatchDispatch<Passes>::add(this, recs[i].inst_addr, recs[i].optype), 0)...};
+            (void)expand;
+        }
+    }
+
+    void analyze_columns(const uint64_t *pcs, const uint8_t *optypes, size_t num_recs)
+    {
+        if (any_needs_opmix())
+        {
+            uint64_t hist[NUM_OP_TYPES] = {0};
+            opmix_count_optypes(optypes, num_recs, hist);
+            dispatch_opmix(hist);
+        }
+
+        if (!any_needs_pc())
+        {
+            return;
+        }
+        for (size_t i = 0; i < num_recs; i++)
+        {
+            int expand[] = {0, (BatchDispatch<Passes>::add(this, pcs[i], optypes[i]), 0)...};
+            (void)expand;
+        }
+    }
+
+    void publish()
+    {
+        int expand[] = {0, (Passes::publish(), 0)...};
+        (void)expand;
+    }
+
+    void finish()
+    {
+        int expand[] = {0, (Passes::finish(), 0)...};
+        (void)expand;
+    }
+
+private:
+    /** Hand one batch's op-type histogram to every pass that takes it. */
+    void dispatch_opmix(const uint64_t *hist)
+    {
+        // Call every pass in order. The array only exists to expand the
+        // parameter pack; the compiler discards it.
+        int expand[] = {0, (BatchDispatch<Passes>::add_opmix(this, hist), 0)...};
+        (void)expand;
+    }
+
+    /** @return true if any pass takes the op-type histogram */
+    static bool any_needs_opmix()
+    {
+        bool needs[] = {false, !Passes::NEEDS_PC...};
+        for (size_t i = 0; i < sizeof(needs); i++)
+        {
+            if (needs[i])
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** @return true if any pass needs the PC column */
+    static bool any_needs_pc()
+    {
+        bool needs[] = {false, (bool)Passes::NEEDS_PC...};
+        for (size_t i = 0; i < sizeof(needs); i++)
+        {
+            if (needs[i])
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * Everything measured about one trace. Each trace analyzed has its own, so
+ * several traces can be analyzed at once on different threads.
+ */
+typedef struct TraceStatsStruct
+{
+    /** Total number of instructions executed. Updated by sim.cpp. */
+    uint64_t num_inst;
+    /** Number of instructions executed by op type. */
+    uint64_t optype_dyn[NUM_OP_TYPES];
+    /** Total number of CPU cycles, including instruction cache stalls. */
+    uint64_t num_cycle;
+    /** Number of unique PCs, counted exactly or estimated. */
+    uint64_t unique_pc;
+    /** Results of the analysis passes. */
+    AnalysisStats analysis;
+    /** The engine analyzing the trace, until analyze_trace_finish(). */
+    Analyzer *analyzer;
+
+    TraceStatsStruct() : num_inst(0), num_cycle(0), unique_pc(0), analyzer(NULL)
+    {
+        memset(optype_dyn, 0, sizeof(optype_dyn));
+    }
+} TraceStats;
+
+/**
+ * Create an engine with the passes selected by the command-line arguments.
+ *
+ * Every combination of optional passes is instantiated at compile time, and
+ * the matching one is picked at run time.
+ *
+ * @param stats where the engine should write its results
+ * @return the new engine
+ */
+Analyzer *analyzer_new(AnalysisStats *stats);
+
+// The functions below that take a TraceStats analyze one trace into it, so
+// several traces can be analyzed at once, one per thread. The ones that do
+// not analyze a single trace into the global stat_* variables, like
+// analyze_trace_record() in trace.h.
+
+/**
+ * Prepares the analysis state once the command-line arguments are known.
+ * Must be called before the first record of a TraceStats is analyzed; the
+ * functions without one call it on first use if it has not been called.
+ *
+ * Implemented in studentwork.cpp.
+ */
+void analyze_trace_init();
+void analyze_trace_init(TraceStats *ts);
+
+/**
+ * Finalizes statistics that are only known once the whole trace has been
+ * analyzed, such as estimates from sketches.
+ *
+ * Implemented in studentwork.cpp.
+ */
+void analyze_trace_finish();
+void analyze_trace_finish(TraceStats *ts);
+
+/**
+ * Updates the global variables stat_num_cycle, stat_optype_dyn, and
+ * stat_unique_pc according to a contiguous array of trace records.
+ *
+ * This is equivalent to calling analyze_trace_record() on each record in
+ * order, but lets the analysis loop run without a call per record. sim.cpp
+ * validates the op type of every record before passing them in.
+ *
+ * Implemented in studentwork.cpp.
+ *
+ * @param recs the trace records to process
+ * @param num_recs the number of records in recs
+ */
+void analyze_trace_batch(const TraceRec *recs, size_t num_recs);
+void analyze_trace_batch(TraceStats *ts, const TraceRec *recs, size_t num_recs);
+
+/**
+ * Updates the global variables stat_num_cycle, stat_optype_dyn, and
+ * stat_unique_pc according to a block of records from a columnar trace,
+ * given as one array of PCs and one array of op types.
+ *
+ * This is equivalent to calling analyze_trace_record() on each record in
+ * order. sim.cpp validates every op type before passing them in.
+ *
+ * Implemented in studentwork.cpp.
+ *
+ * @param pcs the PC of each record
+ * @param optypes the op type of each record
+ * @param num_recs the number of records
+ */
+void analyze_trace_columns(const uint64_t *pcs, const uint8_t *optypes, size_t num_recs);
+void analyze_trace_columns(TraceStats *ts, const uint64_t *pcs, const uint8_t *optypes,
+                           size_t num_recs);
+
+#endif
@@ -0,0 +1,461 @@
+// blocktrace.cpp
+// Implements the seekable block-compressed trace container.
+
+#include "blocktrace.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+/** Number of decompressed blocks buffered ahead of the reader per thread. */
+#define BLOCKTRACE_SLOTS_PER_THREAD 2
+
+/** One buffer in the ring of decompressed blocks. */
+typedef struct BlockTraceSlotStruct
+{
+    /** The decompressed data. */
+    std::vector<uint8_t> data;
+    /** The block currently held in this slot. */
+    uint64_t block;
+    /** Whether data holds the decompressed contents of block. */
+    bool ready;
+} BlockTraceSlot;
+
+struct BlockTraceReaderStruct
+{
+    /** The memory-mapped file. */
+    const uint8_t *map;
+    /** The size of map in bytes. */
+    size_t map_size;
+
+    /** The block index, read from the end of the file. */
+    const BlockTraceIndexEntry *index;
+    /** The number of blocks in the file. */
+    uint64_t num_blocks;
+    /** Uncompressed size of every block except possibly the last. */
+    uint32_t block_size;
+    /** Uncompressed size of the whole trace. */
+    uint64_t raw_size;
+
+    /** Ring of decompressed blocks; block b is decompressed into slot b % n. */
+    std::vector<BlockTraceSlot> slots;
+    /** The worker threads. */
+    std::vector<std::thread> workers;
+
+    /** Protects every field below. */
+    std::mutex lock;
+    /** Signalled when a slot becomes ready. */
+    std::condition_variable slot_ready;
+    /** Signalled when the reader releases a slot. */
+    std::condition_variable slot_free;
+    /** The next block a worker should decompress. */
+    uint64_t next_decode;
+    /** The block the reader is currently consuming. */
+    uint64_t next_read;
+    /** Set when the reader is closed, to stop the workers. */
+    bool stop;
+    /** Set when a worker fails to decompress a block. */
+    bool error;
+
+    /** The read position within the current block. Only used by the reader. */
+    size_t read_pos;
+    /** Where in the first block read to start. Only used by the reader. */
+    size_t start_pos;
+};
+
+struct BlockTraceWriterStruct
+{
+    /** The output file. */
+    FILE *file;
+    /** Uncompressed size of every block except possibly the last. */
+    uint32_t block_size;
+    /** The block being filled. */
+    std::vector<uint8_t> block;
+    /** Scratch buffer for the compressed block. */
+    std::vector<uint8_t> comp;
+    /** Index entries for the blocks written so far. */
+    std::vector<BlockTraceIndexEntry> index;
+    /** The file offset of the next block. */
+    uint64_t offset;
+    /** Total uncompressed bytes written so far. */
+    uint64_t raw_size;
+};
+
+bool blocktrace_check_magic(const void *buf, size_t size)
+{
+    return size >= BLOCKTRACE_MAGIC_LEN &&
+           memcmp(buf, BLOCKTRACE_MAGIC, BLOCKTRACE_MAGIC_LEN) == 0;
+}
+
+/**
+ * Check that every block but the last holds exactly block_size bytes, that
+ * the last holds at most that, and that they add up to the trace size. The
+ * reader locates blocks by dividing offsets by block_size and inflates each
+ * into a buffer of that size, so it relies on all of these.
+ *
+ * @param index the index entries
+ * @param num_blocks the number of entries
+ * @param block_size the block size from the header
+ * @param raw_size the trace size from the footer
+ * @return true if the index is consistent
+ */
+static bool blocktrace_check_index(const BlockTraceIndexEntry *index, uint64_t num_blocks,
+                                   uint32_t block_size, uint64_t raw_size)
+{
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < num_blocks; i++)
+    {
+        if (i + 1 < num_blocks ? index[i].raw_size != block_size
+                               : index[i].raw_size > block_size)
+        {
+            return false;
+        }
+        total += index[i].raw_size;
+    }
+    return total == raw_size;
+}
+
+/**
+ * Worker thread: claim blocks in file order and inflate each into its slot
+ * once the reader has released the block that previously occupied it.
+ */
+static void blocktrace_worker(BlockTraceReader *r)
+{
+    std::unique_lock<std::mutex> guard(r->lock);
+    while (true)
+    {
+        r->slot_free.wait(guard, [r] {
+            return r->stop || r->next_decode >= r->num_blocks ||
+                   r->next_decode < r->next_read + r->slots.size();
+        });
+        if (r->stop || r->next_decode >= r->num_blocks)
+        {
+            return;
+        }
+
+        uint64_t block = r->next_decode++;
+        BlockTraceSlot *slot = &r->slots[block % r->slots.size()];
+        const BlockTraceIndexEntry *entry = &r->index[block];
+        guard.unlock();
+
+        uLongf raw_size = entry->raw_size;
+        int status = Z_DATA_ERROR;
+        if (entry->raw_size <= r->block_size &&
+            entry->offset <= r->map_size &&
+            entry->comp_size <= r->map_size - entry->offset)
+        {
+            status = uncompress(slot->data.data(), &raw_size,
+                                r->map + entry->offset, entry->comp_size);
+        }
+
+        guard.lock();
+        if (status != Z_OK || raw_size != entry->raw_size)
+        {
+            r->error = true;
+        }
+        slot->block = block;
+        slot->ready = true;
+        r->slot_ready.notify_all();
+    }
+}
+
+BlockTraceReader *blocktrace_open(int fd, unsigned int num_threads, uint64_t start)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Couldn't stat block trace");
+        return NULL;
+    }
+
+    size_t map_size = st.st_size;
+    if (map_size < sizeof(BlockTraceHeader) + sizeof(BlockTraceFooter))
+    {
+        fprintf(stderr, "Error: Block trace file is too short\n");
+        return NULL;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Couldn't map block trace");
+        return NULL;
+    }
+
+    // Validate the header, footer, and index before starting any threads.
+    const uint8_t *bytes = (const uint8_t *)map;
+    BlockTraceHeader header;
+    BlockTraceFooter footer;
+    memcpy(&header, bytes, sizeof(header));
+    memcpy(&footer, bytes + map_size - sizeof(footer), sizeof(footer));
+    if (!blocktrace_check_magic(footer.magic, sizeof(footer.magic)) ||
+        header.version != BLOCKTRACE_VERSION ||
+        header.block_size < BLOCKTRACE_MIN_BLOCK_SIZE ||
+        header.block_size > BLOCKTRACE_MAX_BLOCK_SIZE ||
+        footer.index_offset > map_size - sizeof(footer) ||
+        footer.num_blocks > (map_size - sizeof(footer) - footer.index_offset) /
+                                sizeof(BlockTraceIndexEntry) ||
+        footer.index_offset % alignof(BlockTraceIndexEntry) != 0 ||
+        !blocktrace_check_index((const BlockTraceIndexEntry *)(bytes + footer.index_offset),
+                                footer.num_blocks, header.block_size, footer.raw_size))
+    {
+        fprintf(stderr, "Error: Invalid block trace file\n");
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    BlockTraceReader *r = new BlockTraceReader();
+    r->map = bytes;
+    r->map_size = map_size;
+    r->index = (const BlockTraceIndexEntry *)(bytes + footer.index_offset);
+    r->num_blocks = footer.num_blocks;
+    r->block_size = header.block_size;
+    r->raw_size = footer.raw_size;
+    r->stop = false;
+    r->error = false;
+    r->read_pos = 0;
+
+    // Every block but the last holds block_size bytes, so the block to start
+    // in follows from the offset alone.
+    uint64_t start_block = start / r->block_size;
+    r->start_pos = start % r->block_size;
+    if (start_block >= r->num_blocks ||
+        r->start_pos >= r->index[start_block].raw_size)
+    {
+        start_block = r->num_blocks;
+        r->start_pos = 0;
+    }
+    r->next_decode = start_block;
+    r->next_read = start_block;
+
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    if (num_threads == 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+    if (num_threads > r->num_blocks - start_block)
+    {
+        num_threads = r->num_blocks > start_block ? r->num_blocks - start_block : 1;
+    }
+
+    r->slots.resize(num_threads * BLOCKTRACE_SLOTS_PER_THREAD);
+    for (size_t i = 0; i < r->slots.size(); i++)
+    {
+        r->slots[i].data.resize(r->block_size);
+        r->slots[i].block = 0;
+        r->slots[i].ready = false;
+    }
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        r->workers.push_back(std::thread(blocktrace_worker, r));
+    }
+
+    return r;
+}
+
+ssize_t blocktrace_read(BlockTraceReader *r, void *buf, size_t size)
+{
+    uint8_t *out = (uint8_t *)buf;
+    size_t bytes_read = 0;
+
+    while (bytes_read < size && r->next_read < r->num_blocks)
+    {
+        BlockTraceSlot *slot = &r->slots[r->next_read % r->slots.size()];
+        if (r->read_pos == 0)
+        {
+            // Wait for the workers to finish this block.
+            std::unique_lock<std::mutex> guard(r->lock);
+            r->slot_ready.wait(guard, [r, slot] {
+                return r->error || (slot->ready && slot->block == r->next_read);
+            });
+            if (r->error)
+            {
+                fprintf(stderr, "Error: Corrupt block in block trace file\n");
+                return -1;
+            }
+
+            // Skip to the start offset in the first block read.
+            r->read_pos = r->start_pos;
+            r->start_pos = 0;
+        }
+
+        // The slot belongs to the reader until it is released below, so it can
+        // be copied without holding the lock.
+        size_t block_left = r->index[r->next_read].raw_size - r->read_pos;
+        size_t chunk = size - bytes_read < block_left ? size - bytes_read : block_left;
+        memcpy(out + bytes_read, slot->data.data() + r->read_pos, chunk);
+        bytes_read += chunk;
+        r->read_pos += chunk;
+
+        if (r->read_pos == r->index[r->next_read].raw_size)
+        {
+            // Hand the slot back to the workers.
+            std::lock_guard<std::mutex> guard(r->lock);
+            slot->ready = false;
+            r->next_read++;
+            r->read_pos = 0;
+            r->slot_free.notify_all();
+        }
+    }
+
+    return bytes_read;
+}
+
+uint64_t blocktrace_size(const BlockTraceReader *r)
+{
+    return r->raw_size;
+}
+
+void blocktrace_close(BlockTraceReader *r)
+{
+    if (r == NULL)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        r->stop = true;
+        r->slot_free.notify_all();
+    }
+    for (size_t i = 0; i < r->workers.size(); i++)
+    {
+        r->workers[i].join();
+    }
+
+    munmap((void *)r->map, r->map_size);
+    delete r;
+}
+
+/**
+ * Compress the block being filled and append it to the file.
+ *
+ * @return 0 on success, or -1 on error
+ */
+static int blocktrace_flush_block(BlockTraceWriter *w)
+{
+    if (w->block.empty())
+    {
+        return 0;
+    }
+
+    uLongf comp_size = w->comp.size();
+    if (compress2(w->comp.data(), &comp_size, w->block.data(), w->block.size(),
+                  Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        fprintf(stderr, "Error: Couldn't compress block\n");
+        return -1;
+    }
+    if (fwrite(w->comp.data(), 1, comp_size, w->file) != comp_size)
+    {
+        perror("Couldn't write block trace");
+        return -1;
+    }
+
+    BlockTraceIndexEntry entry;
+    entry.offset = w->offset;
+    entry.comp_size = comp_size;
+    entry.raw_size = w->block.size();
+    w->index.push_back(entry);
+
+    w->offset += comp_size;
+    w->raw_size += w->block.size();
+    w->block.clear();
+    return 0;
+}
+
+BlockTraceWriter *blocktrace_create(const char *filename, uint32_t block_size)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        perror("Couldn't create block trace");
+        return NULL;
+    }
+
+    BlockTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BLOCKTRACE_MAGIC, BLOCKTRACE_MAGIC_LEN);
+    header.version = BLOCKTRACE_VERSION;
+    header.block_size = block_size;
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        perror("Couldn't write block trace");
+        fclose(file);
+        return NULL;
+    }
+
+    BlockTraceWriter *w = new BlockTraceWriter();
+    w->file = file;
+    w->block_size = block_size;
+    w->block.reserve(block_size);
+    w->comp.resize(compressBound(block_size));
+    w->offset = sizeof(header);
+    w->raw_size = 0;
+    return w;
+}
+
+int blocktrace_write(BlockTraceWriter *w, const void *buf, size_t size)
+{
+    const uint8_t *in = (const uint8_t *)buf;
+    while (size > 0)
+    {
+        size_t room = w->block_size - w->block.size();
+        size_t chunk = size < room ? size : room;
+        w->block.insert(w->block.end(), in, in + chunk);
+        in += chunk;
+        size -= chunk;
+
+        if (w->block.size() == w->block_size && blocktrace_flush_block(w) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int blocktrace_finish(BlockTraceWriter *w)
+{
+    int status = blocktrace_flush_block(w);
+
+    if (status == 0)
+    {
+        // Keep the index 8-byte aligned so the reader can use it in place.
+        static const uint8_t padding[8] = {0};
+        size_t pad = (8 - w->offset % 8) % 8;
+        BlockTraceFooter footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.index_offset = w->offset + pad;
+        footer.num_blocks = w->index.size();
+        footer.raw_size = w->raw_size;
+        memcpy(footer.magic, BLOCKTRACE_MAGIC, BLOCKTRACE_MAGIC_LEN);
+
+        if (fwrite(padding, 1, pad, w->file) != pad ||
+            fwrite(w->index.data(), sizeof(BlockTraceIndexEntry),
+                   w->index.size(), w->file) != w->index.size() ||
+            fwrite(&footer, sizeof(footer), 1, w->file) != 1)
+        {
+            perror("Couldn't write block trace");
+            status = -1;
+        }
+    }
+
+    if (fclose(w->file) != 0 && status == 0)
+    {
+        perror("Couldn't write block trace");
+        status = -1;
+    }
+    delete w;
+    return status;
+}
@@ -0,0 +1,164 @@
+// blocktrace.h
+// Declares the seekable block-compressed trace container, along with a
+// multi-threaded reader and a writer for it.
+//
+// File layout:
+//
+//     BlockTraceHeader
+//     block 0 (zlib stream)
+//     block 1 (zlib stream)
+//     ...
+//     BlockTraceIndexEntry[num_blocks]
+//     BlockTraceFooter
+//
+// Every block holds block_size bytes of the uncompressed trace (the last one
+// may be shorter) and is compressed independently, so blocks can be inflated
+// in parallel and any block can be located through the index without reading
+// the ones before it.
+
+#ifndef _BLOCKTRACE_H_
+#define _BLOCKTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Magic bytes at the start and at the very end of a block trace file. */
+#define BLOCKTRACE_MAGIC "TRBLK\0\0\0"
+/** Length of BLOCKTRACE_MAGIC. */
+#define BLOCKTRACE_MAGIC_LEN 8
+/** The current version of the file layout. */
+#define BLOCKTRACE_VERSION 1
+
+/**
+ * Default number of uncompressed bytes per block: 64K Lab 1 records, which is
+ * also a whole number of Lab 2/3 records.
+ */
+#define BLOCKTRACE_DEFAULT_BLOCK_SIZE (1024 * 1024)
+/** Smallest block size a block trace may use. */
+#define BLOCKTRACE_MIN_BLOCK_SIZE 1024
+/** Largest block size a block trace may use. */
+#define BLOCKTRACE_MAX_BLOCK_SIZE (1 << 30)
+
+/** The header at the start of a block trace file. */
+typedef struct BlockTraceHeaderStruct
+{
+    char magic[BLOCKTRACE_MAGIC_LEN];
+    uint32_t version;
+    /** Uncompressed size of every block except possibly the last. */
+    uint32_t block_size;
+} BlockTraceHeader;
+
+/** One entry of the block index. */
+typedef struct BlockTraceIndexEntryStruct
+{
+    /** File offset of the compressed block. */
+    uint64_t offset;
+    /** Compressed size of the block in bytes. */
+    uint32_t comp_size;
+    /** Uncompressed size of the block in bytes. */
+    uint32_t raw_size;
+} BlockTraceIndexEntry;
+
+/** The footer at the end of a block trace file. */
+typedef struct BlockTraceFooterStruct
+{
+    /** File offset of the first index entry. */
+    uint64_t index_offset;
+    /** Number of blocks, and thus of index entries. */
+    uint64_t num_blocks;
+    /** Total uncompressed size of the trace in bytes. */
+    uint64_t raw_size;
+    char magic[BLOCKTRACE_MAGIC_LEN];
+} BlockTraceFooter;
+
+/** A block trace opened for reading. Private to blocktrace.cpp. */
+typedef struct BlockTraceReaderStruct BlockTraceReader;
+
+/** A block trace opened for writing. Private to blocktrace.cpp. */
+typedef struct BlockTraceWriterStruct BlockTraceWriter;
+
+/**
+ * Check whether the first bytes of a file mark it as a block trace.
+ *
+ * @param buf the first bytes of the file
+ * @param size the number of bytes in buf
+ * @return true if the file is a block trace
+ */
+bool blocktrace_check_magic(const void *buf, size_t size);
+
+/**
+ * Open a block trace for reading and start decompressing it on a pool of
+ * worker threads.
+ *
+ * Blocks are inflated ahead of the reader into a ring of buffers and handed
+ * out in file order, so the reader sees the same byte stream as a gzip trace.
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * Reading starts at offset start of the uncompressed trace. The index locates
+ * the block holding it, so the blocks before it are never inflated.
+ *
+ * @param fd an open file descriptor for the block trace; the reader does not
+ * take ownership of it
+ * @param num_threads the number of worker threads, or 0 for one per CPU
+ * @param start the uncompressed offset to start reading at
+ * @return the reader, or NULL on failure
+ */
+BlockTraceReader *blocktrace_open(int fd, unsigned int num_threads, uint64_t start);
+
+/**
+ * @param r the reader
+ * @return the uncompressed size of the whole trace
+ */
+uint64_t blocktrace_size(const BlockTraceReader *r);
+
+/**
+ * Copy up to size bytes of the uncompressed trace into buf.
+ *
+ * Only returns fewer than size bytes at the end of the trace.
+ *
+ * @param r the reader
+ * @param buf the buffer to copy into
+ * @param size the number of bytes to read
+ * @return the number of bytes read, 0 at the end of the trace, or -1 on error
+ */
+ssize_t blocktrace_read(BlockTraceReader *r, void *buf, size_t size);
+
+/**
+ * Stop the worker threads and release the reader.
+ *
+ * @param r the reader to close
+ */
+void blocktrace_close(BlockTraceReader *r);
+
+/**
+ * Create a block trace file for writing.
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * @param filename the path of the file to create
+ * @param block_size the uncompressed size of each block
+ * @return the writer, or NULL on failure
+ */
+BlockTraceWriter *blocktrace_create(const char *filename, uint32_t block_size);
+
+/**
+ * Append uncompressed trace data, compressing each block as it fills up.
+ *
+ * @param w the writer
+ * @param buf the data to append
+ * @param size the number of bytes in buf
+ * @return 0 on success, or -1 on error
+ */
+int blocktrace_write(BlockTraceWriter *w, const void *buf, size_t size);
+
+/**
+ * Flush the last block, write the index and footer, and close the file.
+ *
+ * @param w the writer
+ * @return 0 on success, or -1 on error
+ */
+int blocktrace_finish(BlockTraceWriter *w);
+
+#endif
@@ -0,0 +1,236 @@
+// cfg.cpp
+// Implements the control-flow graph profiler.
+
+#include "cfg.h"
+#include <algorithm>
+#include <string.h>
+
+CfgProfiler::CfgProfiler()
+    : last_pc(CFG_NONE), last_optype(OP_OTHER), num_transfers(0), branch_execs(0),
+      branch_taken(0)
+{
+}
+
+void CfgProfiler::transfer(uint64_t pc, bool sequential)
+{
+    if (last_pc == CFG_NONE)
+    {
+        // The first instruction of the trace.
+        return;
+    }
+
+    edges.find_or_insert(CfgEdgeKey(last_pc, pc))->count++;
+    follow_visits(pc);
+    if (!sequential)
+    {
+        num_transfers++;
+    }
+    if (last_optype != OP_CBR)
+    {
+        return;
+    }
+
+    CfgBranch *branch = branches.find_or_insert(CfgBranchKey(last_pc));
+    branch->execs++;
+    branch_execs++;
+
+    if (sequential)
+    {
+        // Not taken: a loop closed by this branch is left.
+        if (branch->loop != CFG_NONE)
+        {
+            end_visit(&loops[branch->loop]);
+        }
+        return;
+    }
+
+    branch->taken++;
+    branch_taken++;
+    if (pc <= last_pc)
+    {
+        // Taken backward: one more iteration of the loop it closes.
+        if (branch->loop == CFG_NONE)
+        {
+            CfgLoop loop;
+            memset(&loop, 0, sizeof(loop));
+            loop.head = pc;
+            loop.tail = last_pc;
+            loop.exit_pc = CFG_NONE;
+            branch->loop = loops.size();
+            loops.push_back(loop);
+        }
+        CfgLoop *loop = &loops[branch->loop];
+        loop->current_trip++;
+        if (!loop->tracked)
+        {
+            loop->tracked = true;
+            active_loops.push_back(branch->loop);
+        }
+    }
+}
+
+void CfgProfiler::follow_visits(uint64_t pc)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < active_loops.size(); i++)
+    {
+        CfgLoop *loop = &loops[active_loops[i]];
+        if (loop->current_trip > 0)
+        {
+            bool src_inside = last_pc >= loop->head && last_pc <= loop->tail;
+            bool dst_inside = pc >= loop->head && pc <= loop->tail;
+            if (loop->exit_pc == CFG_NONE)
+            {
+                if (!dst_inside)
+                {
+                    loop->exit_pc = last_pc;
+                }
+            }
+            else if (dst_inside && pc > loop->exit_pc &&
+                     pc - loop->exit_pc <= CFG_MAX_FALLTHROUGH)
+            {
+                // Back from a call.
+                loop->exit_pc = CFG_NONE;
+            }
+            else if (src_inside || dst_inside)
+            {
+                // Control came back by falling into the head, the only way
+                // in without a transfer, or by jumping in: a new visit.
+                end_visit(loop);
+            }
+        }
+        if (loop->current_trip > 0)
+        {
+            active_loops[kept++] = active_loops[i];
+        }
+        else
+        {
+            loop->tracked = false;
+        }
+    }
+    active_loops.resize(kept);
+}
+
+void CfgProfiler::end_visit(CfgLoop *loop)
+{
+    // The body runs once more than the back edge is taken.
+    uint64_t trip = loop->current_trip + 1;
+    int bucket = std::min(63 - __builtin_clzll(trip), CFG_TRIP_BUCKETS - 1);
+    loop->trips[bucket]++;
+    loop->visits++;
+    loop->iterations += trip;
+    loop->current_trip = 0;
+    loop->exit_pc = CFG_NONE;
+}
+
+void CfgProfiler::finish()
+{
+    for (size_t i = 0; i < loops.size(); i++)
+    {
+        if (loops[i].current_trip > 0)
+        {
+            end_visit(&loops[i]);
+        }
+    }
+}
+
+size_t CfgProfiler::num_blocks() const
+{
+    std::vector<uint64_t> targets;
+    const std::vector<CfgEdge> &slots = edges.get_slots();
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].src != CFG_NONE)
+        {
+            targets.push_back(slots[i].dst);
+        }
+    }
+    std::sort(targets.begin(), targets.end());
+    return std::unique(targets.begin(), targets.end()) - targets.begin();
+}
+
+size_t CfgProfiler::num_biased_branches(uint64_t *biased_execs) const
+{
+    size_t count = 0;
+    *biased_execs = 0;
+    const std::vector<CfgBranch> &slots = branches.get_slots();
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].pc == CFG_NONE)
+        {
+            continue;
+        }
+        double rate = (double)slots[i].taken / (double)slots[i].execs;
+        if (rate >= CFG_BIAS_THRESHOLD || rate <= 1.0 - CFG_BIAS_THRESHOLD)
+        {
+            count++;
+            *biased_execs += slots[i].execs;
+        }
+    }
+    return count;
+}
+
+/** Orders edges by count, most frequent first, then by address. */
+static bool edge_hotter(const CfgEdge &a, const CfgEdge &b)
+{
+    if (a.count != b.count)
+    {
+        return a.count > b.count;
+    }
+    return a.src != b.src ? a.src < b.src : a.dst < b.dst;
+}
+
+/** Orders branches by executions, most frequent first, then by address. */
+static bool branch_hotter(const CfgBranch &a, const CfgBranch &b)
+{
+    return a.execs != b.execs ? a.execs > b.execs : a.pc < b.pc;
+}
+
+/** Orders loops by iterations, most first, then by address. */
+static bool loop_hotter(const CfgLoop &a, const CfgLoop &b)
+{
+    return a.iterations != b.iterations ? a.iterations > b.iterations : a.tail < b.tail;
+}
+
+std::vector<CfgEdge> CfgProfiler::top_edges(size_t k) const
+{
+    std::vector<CfgEdge> top;
+    const std::vector<CfgEdge> &slots = edges.get_slots();
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].src != CFG_NONE)
+        {
+            top.push_back(slots[i]);
+        }
+    }
+    k = std::min(k, top.size());
+    std::partial_sort(top.begin(), top.begin() + k, top.end(), edge_hotter);
+    top.resize(k);
+    return top;
+}
+
+std::vector<CfgBranch> CfgProfiler::top_branches(size_t k) const
+{
+    std::vector<CfgBranch> top;
+    const std::vector<CfgBranch> &slots = branches.get_slots();
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].pc != CFG_NONE)
+        {
+            top.push_back(slots[i]);
+        }
+    }
+    k = std::min(k, top.size());
+    std::partial_sort(top.begin(), top.begin() + k, top.end(), branch_hotter);
+    top.resize(k);
+    return top;
+}
+
+std::vector<CfgLoop> CfgProfiler::top_loops(size_t k) const
+{
+    std::vector<CfgLoop> top(loops);
+    k = std::min(k, top.size());
+    std::partial_sort(top.begin(), top.begin() + k, top.end(), loop_hotter);
+    top.resize(k);
+    return top;
+}
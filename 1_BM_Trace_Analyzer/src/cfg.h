@@ -0,0 +1,382 @@
+// cfg.h
+// Declares a profiler that rebuilds the dynamic control-flow graph from the
+// PC stream, with the taken rate of every conditional branch and the trip
+// counts of the loops they close.
+
+#ifndef _CFG_H_
+#define _CFG_H_
+
+#include "hash.h"
+#include "trace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Default number of hottest edges, branches, and loops reported by -cfg. */
+#define CFG_DEFAULT_K 16
+/** Largest PC step that still counts as falling through to the next insn. */
+#define CFG_MAX_FALLTHROUGH 16
+/** Initial number of slots in the edge and branch tables. */
+#define CFG_INITIAL_SLOTS 1024
+/**
+ * Number of trip-count buckets: bucket b holds trip counts in [2^b, 2^(b+1)),
+ * and the last bucket everything larger.
+ */
+#define CFG_TRIP_BUCKETS 20
+/** A branch taken or not taken at least this often is reported as biased. */
+#define CFG_BIAS_THRESHOLD 0.95
+/** Marks an empty slot in a table, and a branch that closes no loop. */
+#define CFG_NONE ((uint64_t)-1)
+
+/** A control transfer seen in the trace: any non-sequential PC step. */
+typedef struct CfgEdgeStruct
+{
+    /** The last instruction before the transfer, CFG_NONE in an empty slot. */
+    uint64_t src;
+    /** The first instruction after the transfer. */
+    uint64_t dst;
+    /** Number of times the transfer was made. */
+    uint64_t count;
+
+    CfgEdgeStruct() : src(CFG_NONE), dst(0), count(0)
+    {
+    }
+} CfgEdge;
+
+/** A conditional branch and its outcomes. */
+typedef struct CfgBranchStruct
+{
+    /** The address of the branch, CFG_NONE in an empty slot. */
+    uint64_t pc;
+    /** Number of times the branch was executed. */
+    uint64_t execs;
+    /** Number of times the branch was taken. */
+    uint64_t taken;
+    /** The index of the loop the branch closes, or CFG_NONE. */
+    uint64_t loop;
+
+    CfgBranchStruct() : pc(CFG_NONE), execs(0), taken(0), loop(CFG_NONE)
+    {
+    }
+} CfgBranch;
+
+/** A loop closed by a conditional branch that jumps backward. */
+typedef struct CfgLoopStruct
+{
+    /** The first instruction of the loop, the target of the back edge. */
+    uint64_t head;
+    /** The branch that closes the loop. */
+    uint64_t tail;
+    /** Number of times the loop was entered and left. */
+    uint64_t visits;
+    /** Number of iterations over all visits. */
+    uint64_t iterations;
+    /** Iterations of the current visit so far. */
+    uint64_t current_trip;
+    /**
+     * The instruction that took control out of [head, tail] during the
+     * current visit, or CFG_NONE while control is inside.
+     */
+    uint64_t exit_pc;
+    /** Whether the loop is in the profiler's list of visits in progress. */
+    bool tracked;
+    /** Number of visits in each trip-count bucket; see CFG_TRIP_BUCKETS. */
+    uint64_t trips[CFG_TRIP_BUCKETS];
+} CfgLoop;
+
+/**
+ * A growable open-addressing table of Entry, with linear probing.
+ *
+ * Key is the type that finds an entry in a table: it hashes a key, tells
+ * whether an entry holds a key, and fills in an empty entry with a key.
+ */
+template <typename Entry, typename Key>
+class CfgTable
+{
+public:
+    CfgTable() : slots(CFG_INITIAL_SLOTS), slot_mask(CFG_INITIAL_SLOTS - 1), count(0)
+    {
+    }
+
+    /** @return the entry with the given key, inserting it if it is new */
+    Entry *find_or_insert(const Key &key)
+    {
+        size_t slot = key.hash() & slot_mask;
+        while (!key.is_empty(slots[slot]))
+        {
+            if (key.matches(slots[slot]))
+            {
+                return &slots[slot];
+            }
+            slot = (slot + 1) & slot_mask;
+        }
+
+        // Keep the table at most half full.
+        if (2 * (count + 1) > slots.size())
+        {
+            grow();
+            return find_or_insert(key);
+        }
+
+        key.fill(&slots[slot]);
+        count++;
+        return &slots[slot];
+    }
+
+    /** @return every slot, empty or not */
+    const std::vector<Entry> &get_slots() const
+    {
+        return slots;
+    }
+
+    /** @return the number of entries */
+    size_t size() const
+    {
+        return count;
+    }
+
+private:
+    std::vector<Entry> slots;
+    size_t slot_mask;
+    size_t count;
+
+    /** Double the table. */
+    void grow()
+    {
+        std::vector<Entry> old_slots(slots.size() * 2);
+        old_slots.swap(slots);
+        slot_mask = slots.size() - 1;
+
+        for (size_t i = 0; i < old_slots.size(); i++)
+        {
+            Key key(old_slots[i]);
+            if (key.is_empty(old_slots[i]))
+            {
+                continue;
+            }
+            size_t slot = key.hash() & slot_mask;
+            while (!key.is_empty(slots[slot]))
+            {
+                slot = (slot + 1) & slot_mask;
+            }
+            slots[slot] = old_slots[i];
+        }
+    }
+};
+
+/** Finds an edge by its source and destination. */
+struct CfgEdgeKey
+{
+    uint64_t src;
+    uint64_t dst;
+
+    CfgEdgeKey(uint64_t src, uint64_t dst) : src(src), dst(dst)
+    {
+    }
+
+    explicit CfgEdgeKey(const CfgEdge &edge) : src(edge.src), dst(edge.dst)
+    {
+    }
+
+    uint64_t hash() const
+    {
+        return hash_u64(src ^ hash_u64(dst));
+    }
+
+    bool is_empty(const CfgEdge &edge) const
+    {
+        return edge.src == CFG_NONE;
+    }
+
+    bool matches(const CfgEdge &edge) const
+    {
+        return edge.src == src && edge.dst == dst;
+    }
+
+    void fill(CfgEdge *edge) const
+    {
+        edge->src = src;
+        edge->dst = dst;
+    }
+};
+
+/** Finds a branch by its address. */
+struct CfgBranchKey
+{
+    uint64_t pc;
+
+    explicit CfgBranchKey(uint64_t pc) : pc(pc)
+    {
+    }
+
+    explicit CfgBranchKey(const CfgBranch &branch) : pc(branch.pc)
+    {
+    }
+
+    uint64_t hash() const
+    {
+        return hash_u64(pc);
+    }
+
+    bool is_empty(const CfgBranch &branch) const
+    {
+        return branch.pc == CFG_NONE;
+    }
+
+    bool matches(const CfgBranch &branch) const
+    {
+        return branch.pc == pc;
+    }
+
+    void fill(CfgBranch *branch) const
+    {
+        branch->pc = pc;
+    }
+};
+
+/**
+ * Rebuilds the dynamic control-flow graph of a trace.
+ *
+ * The trace has no branch targets or outcomes, only PCs, so control transfers
+ * are inferred from them: the step from one PC to the next is a transfer
+ * unless it is a short step forward (at most CFG_MAX_FALLTHROUGH bytes, the
+ * longest instruction) or stays on the same PC, as the records of a repeated
+ * string instruction do. After a conditional branch, a transfer means the
+ * branch was taken. A taken branch to a target this close ahead looks like a
+ * fall-through and is counted as not taken.
+ *
+ * Every transfer, and every not-taken conditional branch, is an edge of the
+ * graph, counted in a flat hash table keyed by its two PCs. Straight-line
+ * code adds no edges, so the table only grows with the number of distinct
+ * transfers, and an instruction that is not a transfer costs one compare.
+ *
+ * A conditional branch taken to a target at or before itself closes a loop
+ * starting at that target. Each time it is taken the loop iterates again, and
+ * the first time it is not taken the loop is left, which ends a visit. A loop
+ * can also be left through another exit, such as a break or a return, so
+ * every transfer is also checked against the loops with a visit in progress.
+ * Control that leaves [head, tail] may only be making a call, so the visit
+ * goes on if control comes back to the instruction after the one that left.
+ * Coming back anywhere else, by a jump or by falling into the head, enters
+ * the loop anew and ends the visit.
+ */
+class CfgProfiler
+{
+public:
+    CfgProfiler();
+
+    /**
+     * Account for one instruction.
+     *
+     * @param pc the address of the instruction
+     * @param optype the op type of the instruction
+     */
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        bool sequential = pc >= last_pc && pc - last_pc <= CFG_MAX_FALLTHROUGH;
+        if (last_optype == OP_CBR || !sequential)
+        {
+            transfer(pc, sequential);
+        }
+        last_pc = pc;
+        last_optype = optype;
+    }
+
+    /** End the visit of every loop still running at the end of the trace. */
+    void finish();
+
+    /** @return the number of distinct edges */
+    size_t num_edges() const
+    {
+        return edges.size();
+    }
+
+    /** @return the number of distinct edge targets, i.e. basic blocks entered */
+    size_t num_blocks() const;
+
+    /** @return the number of non-sequential steps in the PC stream */
+    uint64_t get_num_transfers() const
+    {
+        return num_transfers;
+    }
+
+    /** @return the number of distinct conditional branches */
+    size_t num_branches() const
+    {
+        return branches.size();
+    }
+
+    /** @return the number of conditional branches executed */
+    uint64_t get_branch_execs() const
+    {
+        return branch_execs;
+    }
+
+    /** @return the number of conditional branches taken */
+    uint64_t get_branch_taken() const
+    {
+        return branch_taken;
+    }
+
+    /**
+     * @return the number of distinct branches taken or not taken at least
+     * CFG_BIAS_THRESHOLD of the time, and through biased_execs, how many
+     * times they were executed
+     */
+    size_t num_biased_branches(uint64_t *biased_execs) const;
+
+    /** @return the k edges made most often, most frequent first */
+    std::vector<CfgEdge> top_edges(size_t k) const;
+
+    /** @return the k branches executed most often, most frequent first */
+    std::vector<CfgBranch> top_branches(size_t k) const;
+
+    /** @return the k loops with the most iterations, most first */
+    std::vector<CfgLoop> top_loops(size_t k) const;
+
+    /** @return the number of loops found */
+    size_t num_loops() const
+    {
+        return loops.size();
+    }
+
+private:
+    CfgTable<CfgEdge, CfgEdgeKey> edges;
+    CfgTable<CfgBranch, CfgBranchKey> branches;
+    std::vector<CfgLoop> loops;
+
+    /**
+     * The loops with a visit in progress, by index. A loop whose visit ended
+     * stays until the next transfer removes it.
+     */
+    std::vector<uint64_t> active_loops;
+
+    /** The previous instruction. */
+    uint64_t last_pc;
+    uint8_t last_optype;
+
+    uint64_t num_transfers;
+    uint64_t branch_execs;
+    uint64_t branch_taken;
+
+    /**
+     * Account for the step from last_pc to pc, which ends a basic block.
+     *
+     * @param pc the address of the next instruction
+     * @param sequential true if pc falls through from last_pc
+     */
+    void transfer(uint64_t pc, bool sequential);
+
+    /**
+     * Follow the loops with a visit in progress through the step from
+     * last_pc to pc, ending the visits it starts anew.
+     *
+     * @param pc the address of the next instruction
+     */
+    void follow_visits(uint64_t pc);
+
+    /** Record the end of a visit of a loop. */
+    void end_visit(CfgLoop *loop);
+};
+
+#endif
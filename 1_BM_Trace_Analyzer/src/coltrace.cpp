@@ -0,0 +1,435 @@
+// coltrace.cpp
+// Implements the columnar trace format.
+
+#include "coltrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+/** Longest LEB128 encoding of a 64-bit value. */
+#define COLTRACE_MAX_VARINT_LEN 10
+
+struct ColTraceReaderStruct
+{
+    /** The memory-mapped file. */
+    const uint8_t *map;
+    /** The size of map in bytes. */
+    size_t map_size;
+    /** Largest number of records in a chunk. */
+    uint32_t chunk_recs;
+
+    /** The file offset of the next chunk header. */
+    size_t next_chunk;
+    /** Set once the end marker has been read. */
+    bool done;
+
+    /** The current chunk, decoded. */
+    std::vector<uint64_t> pcs;
+    std::vector<uint8_t> optypes;
+    /** The number of records in the current chunk. */
+    size_t num_recs;
+    /** The read position within the current chunk. */
+    size_t read_pos;
+
+    /** Scratch buffers for the inflated columns. */
+    std::vector<uint8_t> pc_column;
+    std::vector<uint8_t> op_column;
+};
+
+struct ColTraceWriterStruct
+{
+    /** The output file. */
+    FILE *file;
+    /** Number of records per chunk. */
+    uint32_t chunk_recs;
+    /** The chunk being filled. */
+    std::vector<TraceRec> chunk;
+    /** Scratch buffers for the encoded and compressed columns. */
+    std::vector<uint8_t> pc_column;
+    std::vector<uint8_t> op_column;
+    std::vector<uint8_t> pc_comp;
+    std::vector<uint8_t> op_comp;
+};
+
+bool coltrace_check_magic(const void *buf, size_t size)
+{
+    return size >= COLTRACE_MAGIC_LEN &&
+           memcmp(buf, COLTRACE_MAGIC, COLTRACE_MAGIC_LEN) == 0;
+}
+
+ColTraceReader *coltrace_open(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Couldn't stat columnar trace");
+        return NULL;
+    }
+
+    size_t map_size = st.st_size;
+    if (map_size < sizeof(ColTraceHeader) + sizeof(ColTraceChunkHeader))
+    {
+        fprintf(stderr, "Error: Columnar trace file is too short\n");
+        return NULL;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Couldn't map columnar trace");
+        return NULL;
+    }
+
+    ColTraceHeader header;
+    memcpy(&header, map, sizeof(header));
+    if (!coltrace_check_magic(header.magic, sizeof(header.magic)) ||
+        header.version != COLTRACE_VERSION || header.chunk_recs == 0 ||
+        header.chunk_recs > COLTRACE_MAX_CHUNK_RECS)
+    {
+        fprintf(stderr, "Error: Invalid columnar trace file\n");
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    ColTraceReader *r = new ColTraceReader();
+    r->map = (const uint8_t *)map;
+    r->map_size = map_size;
+    r->chunk_recs = header.chunk_recs;
+    r->next_chunk = sizeof(header);
+    r->done = false;
+    r->pcs.resize(header.chunk_recs);
+    r->optypes.resize(header.chunk_recs);
+    r->num_recs = 0;
+    r->read_pos = 0;
+    r->pc_column.resize((size_t)header.chunk_recs * COLTRACE_MAX_VARINT_LEN);
+    r->op_column.resize((header.chunk_recs + 1) / 2);
+    return r;
+}
+
+/**
+ * Inflate and decode the next chunk into r->pcs and r->optypes.
+ *
+ * @return 0 on success, or -1 on error
+ */
+static int coltrace_decode_chunk(ColTraceReader *r)
+{
+    ColTraceChunkHeader chunk;
+    if (r->map_size - r->next_chunk < sizeof(chunk))
+    {
+        fprintf(stderr, "Error: Unexpected end of trace file\n");
+        return -1;
+    }
+    memcpy(&chunk, r->map + r->next_chunk, sizeof(chunk));
+    r->next_chunk += sizeof(chunk);
+
+    r->num_recs = chunk.num_recs;
+    r->read_pos = 0;
+    if (chunk.num_recs == 0)
+    {
+        r->done = true;
+        return 0;
+    }
+
+    size_t op_raw_size = (chunk.num_recs + 1) / 2;
+    if (chunk.num_recs > r->chunk_recs || chunk.pc_raw_size > r->pc_column.size() ||
+        (uint64_t)chunk.pc_comp_size + chunk.op_comp_size > r->map_size - r->next_chunk)
+    {
+        fprintf(stderr, "Error: Invalid columnar trace file\n");
+        return -1;
+    }
+
+    uLongf pc_size = chunk.pc_raw_size;
+    uLongf op_size = op_raw_size;
+    const uint8_t *pc_comp = r->map + r->next_chunk;
+    const uint8_t *op_comp = pc_comp + chunk.pc_comp_size;
+    r->next_chunk += (size_t)chunk.pc_comp_size + chunk.op_comp_size;
+    if (uncompress(r->pc_column.data(), &pc_size, pc_comp, chunk.pc_comp_size) != Z_OK ||
+        uncompress(r->op_column.data(), &op_size, op_comp, chunk.op_comp_size) != Z_OK ||
+        pc_size != chunk.pc_raw_size || op_size != op_raw_size)
+    {
+        fprintf(stderr, "Error: Corrupt chunk in columnar trace file\n");
+        return -1;
+    }
+
+    // Decode the zigzag varint deltas into absolute PCs.
+    const uint8_t *in = r->pc_column.data();
+    const uint8_t *in_end = in + pc_size;
+    uint64_t pc = 0;
+    for (size_t i = 0; i < chunk.num_recs; i++)
+    {
+        uint64_t zigzag = 0;
+        int shift = 0;
+        uint8_t byte;
+        do
+        {
+            if (in == in_end || shift >= 64)
+            {
+                fprintf(stderr, "Error: Corrupt chunk in columnar trace file\n");
+                return -1;
+            }
+            byte = *in++;
+            zigzag |= (uint64_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        pc += (zigzag >> 1) ^ -(zigzag & 1);
+        r->pcs[i] = pc;
+    }
+
+    // Unpack the op types, two per byte.
+    const uint8_t *ops = r->op_column.data();
+    for (size_t i = 0; i < chunk.num_recs; i++)
+    {
+        r->optypes[i] = (ops[i / 2] >> (4 * (i % 2))) & 0xf;
+    }
+
+    return 0;
+}
+
+ssize_t coltrace_read(ColTraceReader *r, uint64_t *pcs, uint8_t *optypes,
+                      size_t max_recs)
+{
+    size_t recs_read = 0;
+    while (recs_read < max_recs)
+    {
+        if (r->read_pos == r->num_recs)
+        {
+            if (r->done || coltrace_decode_chunk(r) != 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        size_t left = r->num_recs - r->read_pos;
+        size_t count = max_recs - recs_read < left ? max_recs - recs_read : left;
+        memcpy(pcs + recs_read, r->pcs.data() + r->read_pos, count * sizeof(uint64_t));
+        memcpy(optypes + recs_read, r->optypes.data() + r->read_pos, count);
+        recs_read += count;
+        r->read_pos += count;
+    }
+
+    if (recs_read < max_recs && !r->done)
+    {
+        return -1;
+    }
+    return recs_read;
+}
+
+int64_t coltrace_skip(ColTraceReader *r, uint64_t num_recs)
+{
+    uint64_t skipped = 0;
+    while (skipped < num_recs)
+    {
+        if (r->read_pos < r->num_recs)
+        {
+            // Skip within the current chunk.
+            uint64_t left = r->num_recs - r->read_pos;
+            uint64_t count = num_recs - skipped < left ? num_recs - skipped : left;
+            r->read_pos += count;
+            skipped += count;
+            continue;
+        }
+        if (r->done)
+        {
+            break;
+        }
+
+        // Step over the next chunk from its header alone if all of it is to be
+        // skipped. Otherwise decode it and skip within it.
+        ColTraceChunkHeader chunk;
+        memset(&chunk, 0, sizeof(chunk));
+        if (r->map_size - r->next_chunk >= sizeof(chunk))
+        {
+            memcpy(&chunk, r->map + r->next_chunk, sizeof(chunk));
+        }
+        if (chunk.num_recs > 0 && chunk.num_recs <= num_recs - skipped)
+        {
+            uint64_t chunk_size = sizeof(chunk) + (uint64_t)chunk.pc_comp_size + chunk.op_comp_size;
+            if (chunk_size > r->map_size - r->next_chunk)
+            {
+                fprintf(stderr, "Error: Corrupt chunk in columnar trace file\n");
+                return -1;
+            }
+            r->next_chunk += chunk_size;
+            skipped += chunk.num_recs;
+            continue;
+        }
+        if (coltrace_decode_chunk(r) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return skipped;
+}
+
+void coltrace_close(ColTraceReader *r)
+{
+    if (r == NULL)
+    {
+        return;
+    }
+
+    munmap((void *)r->map, r->map_size);
+    delete r;
+}
+
+/**
+ * Write a chunk header followed by the two compressed columns. A chunk with
+ * no records is the end marker.
+ *
+ * @return 0 on success, or -1 on error
+ */
+static int coltrace_flush_chunk(ColTraceWriter *w)
+{
+    size_t n = w->chunk.size();
+    ColTraceChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.num_recs = n;
+
+    if (n > 0)
+    {
+        // Encode the PC deltas as zigzag varints.
+        uint8_t *out = w->pc_column.data();
+        uint64_t prev = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            int64_t delta = (int64_t)(w->chunk[i].inst_addr - prev);
+            uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+            prev = w->chunk[i].inst_addr;
+            while (zigzag >= 0x80)
+            {
+                *out++ = (uint8_t)(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *out++ = (uint8_t)zigzag;
+        }
+        chunk.pc_raw_size = out - w->pc_column.data();
+
+        // Pack the op types, two per byte.
+        size_t op_raw_size = (n + 1) / 2;
+        memset(w->op_column.data(), 0, op_raw_size);
+        for (size_t i = 0; i < n; i++)
+        {
+            w->op_column[i / 2] |= (w->chunk[i].optype & 0xf) << (4 * (i % 2));
+        }
+
+        uLongf pc_comp_size = w->pc_comp.size();
+        uLongf op_comp_size = w->op_comp.size();
+        if (compress2(w->pc_comp.data(), &pc_comp_size, w->pc_column.data(),
+                      chunk.pc_raw_size, Z_BEST_COMPRESSION) != Z_OK ||
+            compress2(w->op_comp.data(), &op_comp_size, w->op_column.data(),
+                      op_raw_size, Z_BEST_COMPRESSION) != Z_OK)
+        {
+            fprintf(stderr, "Error: Couldn't compress chunk\n");
+            return -1;
+        }
+        chunk.pc_comp_size = pc_comp_size;
+        chunk.op_comp_size = op_comp_size;
+    }
+
+    if (fwrite(&chunk, sizeof(chunk), 1, w->file) != 1 ||
+        fwrite(w->pc_comp.data(), 1, chunk.pc_comp_size, w->file) != chunk.pc_comp_size ||
+        fwrite(w->op_comp.data(), 1, chunk.op_comp_size, w->file) != chunk.op_comp_size)
+    {
+        perror("Couldn't write columnar trace");
+        return -1;
+    }
+
+    w->chunk.clear();
+    return 0;
+}
+
+ColTraceWriter *coltrace_create(const char *filename, uint32_t chunk_recs)
+{
+    if (chunk_recs == 0 || chunk_recs > COLTRACE_MAX_CHUNK_RECS)
+    {
+        fprintf(stderr, "Error: columnar chunks must hold 1 to %d records\n",
+                COLTRACE_MAX_CHUNK_RECS);
+        return NULL;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        perror("Couldn't create columnar trace");
+        return NULL;
+    }
+
+    ColTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLTRACE_MAGIC, COLTRACE_MAGIC_LEN);
+    header.version = COLTRACE_VERSION;
+    header.chunk_recs = chunk_recs;
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        perror("Couldn't write columnar trace");
+        fclose(file);
+        return NULL;
+    }
+
+    ColTraceWriter *w = new ColTraceWriter();
+    w->file = file;
+    w->chunk_recs = chunk_recs;
+    w->chunk.reserve(chunk_recs);
+    w->pc_column.resize((size_t)chunk_recs * COLTRACE_MAX_VARINT_LEN);
+    w->op_column.resize((chunk_recs + 1) / 2);
+    w->pc_comp.resize(compressBound(w->pc_column.size()));
+    w->op_comp.resize(compressBound(w->op_column.size()));
+    return w;
+}
+
+int coltrace_write(ColTraceWriter *w, const TraceRec *recs, size_t num_recs)
+{
+    while (num_recs > 0)
+    {
+        size_t room = w->chunk_recs - w->chunk.size();
+        size_t count = num_recs < room ? num_recs : room;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (recs[i].optype >= NUM_OP_TYPES)
+            {
+                fprintf(stderr, "Error: Invalid op type %u in trace\n", recs[i].optype);
+                return -1;
+            }
+        }
+        w->chunk.insert(w->chunk.end(), recs, recs + count);
+        recs += count;
+        num_recs -= count;
+
+        if (w->chunk.size() == w->chunk_recs && coltrace_flush_chunk(w) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int coltrace_finish(ColTraceWriter *w)
+{
+    // Flush the last partial chunk, then write the empty end marker.
+    int status = 0;
+    if (!w->chunk.empty())
+    {
+        status = coltrace_flush_chunk(w);
+    }
+    if (status == 0)
+    {
+        status = coltrace_flush_chunk(w);
+    }
+
+    if (fclose(w->file) != 0 && status == 0)
+    {
+        perror("Couldn't write columnar trace");
+        status = -1;
+    }
+    delete w;
+    return status;
+}
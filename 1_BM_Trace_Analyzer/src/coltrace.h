@@ -0,0 +1,165 @@
+// coltrace.h
+// Declares the columnar (structure-of-arrays) trace format, along with a
+// reader and a writer for it.
+//
+// File layout:
+//
+//     ColTraceHeader
+//     ColTraceChunkHeader, PC column, op-type column   (chunk 0)
+//     ColTraceChunkHeader, PC column, op-type column   (chunk 1)
+//     ...
+//     ColTraceChunkHeader with num_recs == 0            (end marker)
+//
+// Each chunk holds up to chunk_recs records split into two columns, each
+// compressed on its own with zlib:
+//
+//  - The PC column holds the difference between each PC and the one before
+//    it, zigzag-encoded and written as a LEB128 varint. The first PC of a chunk
+//    is relative to 0, so every chunk can be decoded on its own. Sequential
+//    code becomes a run of small, identical bytes, which zlib compresses far
+//    better than the 16-byte records of a gzip trace.
+//  - The op-type column packs two op types per byte, low nibble first.
+//
+// The reader hands the records back as a dense array of PCs and a dense array
+// of one-byte op types, which analyses can scan without touching the PCs.
+
+#ifndef _COLTRACE_H_
+#define _COLTRACE_H_
+
+#include "trace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Magic bytes at the start of a columnar trace file. */
+#define COLTRACE_MAGIC "TRCOL\0\0\0"
+/** Length of COLTRACE_MAGIC. */
+#define COLTRACE_MAGIC_LEN 8
+/** The current version of the file layout. */
+#define COLTRACE_VERSION 1
+
+/** Default number of records per chunk. */
+#define COLTRACE_DEFAULT_CHUNK_RECS (64 * 1024)
+/**
+ * Largest number of records per chunk: 1 GB of Lab 1 records, what tracepack
+ * writes at its largest block size.
+ */
+#define COLTRACE_MAX_CHUNK_RECS (1 << 26)
+
+/** The header at the start of a columnar trace file. */
+typedef struct ColTraceHeaderStruct
+{
+    char magic[COLTRACE_MAGIC_LEN];
+    uint32_t version;
+    /** Largest number of records in a chunk. */
+    uint32_t chunk_recs;
+} ColTraceHeader;
+
+/** The header in front of each chunk. */
+typedef struct ColTraceChunkHeaderStruct
+{
+    /** Number of records in the chunk, or 0 for the end marker. */
+    uint32_t num_recs;
+    /** Uncompressed size of the varint PC column in bytes. */
+    uint32_t pc_raw_size;
+    /** Compressed size of the PC column in bytes. */
+    uint32_t pc_comp_size;
+    /** Compressed size of the op-type column in bytes. */
+    uint32_t op_comp_size;
+} ColTraceChunkHeader;
+
+/** A columnar trace opened for reading. Private to coltrace.cpp. */
+typedef struct ColTraceReaderStruct ColTraceReader;
+
+/** A columnar trace opened for writing. Private to coltrace.cpp. */
+typedef struct ColTraceWriterStruct ColTraceWriter;
+
+/**
+ * Check whether the first bytes of a file mark it as a columnar trace.
+ *
+ * @param buf the first bytes of the file
+ * @param size the number of bytes in buf
+ * @return true if the file is a columnar trace
+ */
+bool coltrace_check_magic(const void *buf, size_t size);
+
+/**
+ * Open a columnar trace for reading.
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * @param fd an open file descriptor for the columnar trace; the reader does
+ * not take ownership of it
+ * @return the reader, or NULL on failure
+ */
+ColTraceReader *coltrace_open(int fd);
+
+/**
+ * Decode up to max_recs records into a column of PCs and a column of op
+ * types.
+ *
+ * Only returns fewer than max_recs records at the end of the trace. The op
+ * types are not validated.
+ *
+ * @param r the reader
+ * @param pcs receives the PC of each record
+ * @param optypes receives the op type of each record
+ * @param max_recs the number of records pcs and optypes can hold
+ * @return the number of records read, 0 at the end of the trace, or -1 on
+ * error
+ */
+ssize_t coltrace_read(ColTraceReader *r, uint64_t *pcs, uint8_t *optypes,
+                      size_t max_recs);
+
+/**
+ * Skip up to num_recs records. Whole chunks are skipped without being
+ * inflated.
+ *
+ * @param r the reader
+ * @param num_recs the number of records to skip
+ * @return the number of records skipped, fewer than num_recs only at the end
+ * of the trace, or -1 on error
+ */
+int64_t coltrace_skip(ColTraceReader *r, uint64_t num_recs);
+
+/**
+ * Release the reader.
+ *
+ * @param r the reader to close
+ */
+void coltrace_close(ColTraceReader *r);
+
+/**
+ * Create a columnar trace file for writing.
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * @param filename the path of the file to create
+ * @param chunk_recs the number of records per chunk, from 1 to
+ * COLTRACE_MAX_CHUNK_RECS
+ * @return the writer, or NULL on failure
+ */
+ColTraceWriter *coltrace_create(const char *filename, uint32_t chunk_recs);
+
+/**
+ * Append records, compressing each chunk as it fills up.
+ *
+ * Op types are packed into four bits, so a record with an op type of
+ * NUM_OP_TYPES or more is refused rather than written as another op type.
+ *
+ * @param w the writer
+ * @param recs the records to append
+ * @param num_recs the number of records in recs
+ * @return 0 on success, or -1 on error
+ */
+int coltrace_write(ColTraceWriter *w, const TraceRec *recs, size_t num_recs);
+
+/**
+ * Flush the last chunk, write the end marker, and close the file.
+ *
+ * @param w the writer
+ * @return 0 on success, or -1 on error
+ */
+int coltrace_finish(ColTraceWriter *w);
+
+#endif
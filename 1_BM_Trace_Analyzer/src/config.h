@@ -0,0 +1,108 @@
+// config.h
+// Declares the command-line configuration of the analysis passes, which
+// sim.cpp defines and parses.
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdint.h>
+
+/**
+ * A Boolean indicating whether unique PCs should be counted exactly with a
+ * hash set.
+ *
+ * This is on by default. It is turned off by the command-line argument
+ * -approx-unique and turned back on by -validate-unique.
+ */
+extern bool UNIQUE_PC_EXACT;
+
+/**
+ * A Boolean indicating whether unique PCs should be estimated with a
+ * HyperLogLog sketch, which uses a few KB of memory regardless of the length
+ * of the trace.
+ *
+ * Set by the command-line arguments -approx-unique and -validate-unique.
+ */
+extern bool UNIQUE_PC_APPROX;
+
+/**
+ * The precision of the HyperLogLog sketch: the sketch has 2^HLL_PRECISION
+ * one-byte registers.
+ *
+ * Set by the command-line argument -hllprecision.
+ */
+extern unsigned int HLL_PRECISION;
+
+/**
+ * The number of hottest instruction addresses to report, or 0 to disable the
+ * heavy-hitter profile.
+ *
+ * Set by the command-line argument -toppc.
+ */
+extern unsigned int TOPPC_K;
+
+/**
+ * The number of counters in the heavy-hitter sketch. Counts are overestimated
+ * by at most (number of instructions) / TOPPC_COUNTERS.
+ *
+ * Set by the command-line argument -toppccounters.
+ */
+extern unsigned int TOPPC_COUNTERS;
+
+/**
+ * The number of instructions per SimPoint interval, or 0 to disable SimPoint
+ * profiling.
+ *
+ * Set by the command-line argument -simpoint.
+ */
+extern uint64_t SIMPOINT_INTERVAL;
+
+/**
+ * The largest number of clusters SimPoint profiling tries.
+ *
+ * Set by the command-line argument -simpointmaxk.
+ */
+extern unsigned int SIMPOINT_MAX_K;
+
+/**
+ * The number of instructions per working-set interval, or 0 to disable the
+ * reuse-distance and working-set analysis.
+ *
+ * Set by the command-line argument -reuse.
+ */
+extern uint64_t REUSE_INTERVAL;
+
+/**
+ * The number of hottest control-flow edges, conditional branches, and loops
+ * to report, or 0 to disable the control-flow analysis.
+ *
+ * Set by the command-line argument -cfg.
+ */
+extern unsigned int CFG_K;
+
+/**
+ * A Boolean indicating whether to report the instruction cache miss ratio of
+ * every power-of-two size and associativity.
+ *
+ * Set by the command-line argument -icachemrc.
+ */
+extern bool ICACHE_MRC;
+
+/**
+ * The size in bytes and associativity of the instruction cache charged by
+ * IMISS_PENALTY.
+ *
+ * Set by the command-line arguments -icachesize and -icacheassoc.
+ */
+extern uint64_t ICACHE_SIZE;
+extern unsigned int ICACHE_ASSOC;
+
+/**
+ * The number of cycles added to stat_num_cycle for every instruction cache
+ * miss, or 0 to leave instruction fetch out of the CPI model.
+ *
+ * Set by the command-line argument -imisspenalty.
+ */
+extern unsigned int IMISS_PENALTY;
+
+#endif
@@ -0,0 +1,328 @@
+// gzindex.cpp
+// Implements the random-access index of gzip traces.
+
+#include "gzindex.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/** Largest amount of input handed to inflate at once; avail_in is 32 bits. */
+#define GZINDEX_MAX_INPUT (1U << 30)
+
+struct GzIndexStruct
+{
+    GzIndexHeader header;
+    /** The access points, in order of offset. */
+    std::vector<GzIndexPoint> points;
+    /** The compressed window of each access point. */
+    std::vector<std::vector<uint8_t> > windows;
+};
+
+/**
+ * Append an access point.
+ *
+ * @param window the circular buffer of the last GZINDEX_WINDOW_SIZE bytes
+ * inflated, whose oldest byte is at window + GZINDEX_WINDOW_SIZE - left
+ * @param left the number of bytes of the buffer not yet overwritten this lap
+ * @return 0 on success, or -1 on error
+ */
+static int gzindex_add_point(GzIndex *idx, uint64_t out, uint64_t in, int bits,
+                             const uint8_t *window, unsigned int left)
+{
+    // Unroll the circular buffer, oldest byte first.
+    std::vector<uint8_t> flat(GZINDEX_WINDOW_SIZE);
+    memcpy(flat.data(), window + GZINDEX_WINDOW_SIZE - left, left);
+    memcpy(flat.data() + left, window, GZINDEX_WINDOW_SIZE - left);
+
+    uLongf comp_size = compressBound(GZINDEX_WINDOW_SIZE);
+    std::vector<uint8_t> comp(comp_size);
+    if (compress2(comp.data(), &comp_size, flat.data(), flat.size(), Z_BEST_COMPRESSION) != Z_OK)
+    {
+        fprintf(stderr, "Error: Couldn't compress index window\n");
+        return -1;
+    }
+    comp.resize(comp_size);
+
+    GzIndexPoint point;
+    point.out = out;
+    point.in = in;
+    point.bits = bits;
+    point.window_comp_size = comp_size;
+    idx->points.push_back(point);
+    idx->windows.push_back(comp);
+    return 0;
+}
+
+GzIndex *gzindex_build(int fd, uint64_t span)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        fprintf(stderr, "Error: Couldn't read trace file\n");
+        return NULL;
+    }
+    size_t map_size = st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("Couldn't map trace file");
+        return NULL;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    const uint8_t *bytes = (const uint8_t *)map;
+
+    GzIndex *idx = new GzIndex();
+    memset(&idx->header, 0, sizeof(idx->header));
+    memcpy(idx->header.magic, GZINDEX_MAGIC, GZINDEX_MAGIC_LEN);
+    idx->header.version = GZINDEX_VERSION;
+    idx->header.trailer_size = (map_size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) ? 8 : 4;
+    idx->header.comp_size = map_size;
+
+    // A window of 15 + 32 accepts both gzip and zlib headers.
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 15 + 32) != Z_OK)
+    {
+        fprintf(stderr, "Error: Couldn't initialize zlib\n");
+        munmap(map, map_size);
+        delete idx;
+        return NULL;
+    }
+
+    // Inflate into a circular buffer one window long, one deflate block at a
+    // time, so the last 32 KB are at hand at every block boundary.
+    std::vector<uint8_t> window(GZINDEX_WINDOW_SIZE);
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    uint64_t last = 0;
+    int status = Z_OK;
+    strm.avail_out = 0;
+    while (true)
+    {
+        if (strm.avail_in == 0)
+        {
+            if (total_in == map_size)
+            {
+                // gunzip treats a file that ends mid-stream as an error.
+                fprintf(stderr, "Error: Unexpected end of trace file\n");
+                status = Z_DATA_ERROR;
+                break;
+            }
+            strm.next_in = (Bytef *)(bytes + total_in);
+            strm.avail_in = map_size - total_in < GZINDEX_MAX_INPUT ? map_size - total_in
+                                                                    : GZINDEX_MAX_INPUT;
+        }
+        if (strm.avail_out == 0)
+        {
+            strm.next_out = window.data();
+            strm.avail_out = GZINDEX_WINDOW_SIZE;
+        }
+
+        unsigned int avail_in = strm.avail_in;
+        unsigned int avail_out = strm.avail_out;
+        status = inflate(&strm, Z_BLOCK);
+        total_in += avail_in - strm.avail_in;
+        total_out += avail_out - strm.avail_out;
+
+        if (status == Z_STREAM_END)
+        {
+            // A gzip file may hold several concatenated members.
+            if (total_in == map_size)
+            {
+                status = Z_OK;
+                break;
+            }
+            inflateReset(&strm);
+            continue;
+        }
+        if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            fprintf(stderr, "Error: Corrupt trace file: %s\n",
+                    strm.msg != NULL ? strm.msg : zError(status));
+            break;
+        }
+
+        // Bit 7 of data_type marks the end of a block, and bit 6 the end of
+        // the last one, after which there is nothing to resume.
+        bool at_boundary = (strm.data_type & 128) && !(strm.data_type & 64);
+        if (at_boundary && (total_out == 0 || total_out - last > span))
+        {
+            if (gzindex_add_point(idx, total_out, total_in, strm.data_type & 7, window.data(),
+                                  strm.avail_out) != 0)
+            {
+                status = Z_MEM_ERROR;
+                break;
+            }
+            last = total_out;
+        }
+    }
+
+    inflateEnd(&strm);
+    munmap(map, map_size);
+    if (status != Z_OK)
+    {
+        delete idx;
+        return NULL;
+    }
+
+    idx->header.raw_size = total_out;
+    idx->header.num_points = idx->points.size();
+    return idx;
+}
+
+int gzindex_write(const GzIndex *idx, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        perror("Couldn't create index file");
+        return -1;
+    }
+
+    bool ok = fwrite(&idx->header, sizeof(idx->header), 1, file) == 1;
+    for (size_t i = 0; ok && i < idx->points.size(); i++)
+    {
+        ok = fwrite(&idx->points[i], sizeof(GzIndexPoint), 1, file) == 1 &&
+             fwrite(idx->windows[i].data(), 1, idx->windows[i].size(), file) ==
+                 idx->windows[i].size();
+    }
+
+    if (fclose(file) != 0 || !ok)
+    {
+        perror("Couldn't write index file");
+        return -1;
+    }
+    return 0;
+}
+
+GzIndex *gzindex_load(const char *filename, uint64_t comp_size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        if (errno != ENOENT)
+        {
+            perror("Couldn't open index file");
+        }
+        return NULL;
+    }
+
+    GzIndex *idx = new GzIndex();
+    bool ok = fread(&idx->header, sizeof(idx->header), 1, file) == 1 &&
+              memcmp(idx->header.magic, GZINDEX_MAGIC, GZINDEX_MAGIC_LEN) == 0 &&
+              idx->header.version == GZINDEX_VERSION;
+    if (ok && idx->header.comp_size != comp_size)
+    {
+        fprintf(stderr, "Warning: %s is the index of another trace; ignoring it\n", filename);
+        fclose(file);
+        delete idx;
+        return NULL;
+    }
+
+    for (uint64_t i = 0; ok && i < idx->header.num_points; i++)
+    {
+        GzIndexPoint point;
+        ok = fread(&point, sizeof(point), 1, file) == 1 && point.bits < 8 &&
+             point.window_comp_size <= compressBound(GZINDEX_WINDOW_SIZE) &&
+             point.in <= comp_size;
+        if (!ok)
+        {
+            break;
+        }
+        std::vector<uint8_t> window(point.window_comp_size);
+        ok = fread(window.data(), 1, window.size(), file) == window.size();
+        idx->points.push_back(point);
+        idx->windows.push_back(window);
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Invalid index file %s\n", filename);
+        delete idx;
+        return NULL;
+    }
+    return idx;
+}
+
+uint64_t gzindex_num_points(const GzIndex *idx)
+{
+    return idx->points.size();
+}
+
+uint64_t gzindex_raw_size(const GzIndex *idx)
+{
+    return idx->header.raw_size;
+}
+
+unsigned int gzindex_trailer_size(const GzIndex *idx)
+{
+    return idx->header.trailer_size;
+}
+
+int gzindex_seek(const GzIndex *idx, int fd, uint64_t offset, z_stream *strm,
+                 uint64_t *out, uint64_t *in)
+{
+    // Binary search for the last point at or before offset.
+    size_t lo = 0;
+    size_t hi = idx->points.size();
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->points[mid].out <= offset)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo == 0)
+    {
+        return 1;
+    }
+    const GzIndexPoint *point = &idx->points[lo - 1];
+
+    std::vector<uint8_t> window(GZINDEX_WINDOW_SIZE);
+    uLongf window_size = window.size();
+    if (uncompress(window.data(), &window_size, idx->windows[lo - 1].data(),
+                   point->window_comp_size) != Z_OK ||
+        window_size != GZINDEX_WINDOW_SIZE)
+    {
+        fprintf(stderr, "Error: Corrupt window in index file\n");
+        return -1;
+    }
+
+    if (inflateReset2(strm, -15) != Z_OK)
+    {
+        fprintf(stderr, "Error: Couldn't reset zlib\n");
+        return -1;
+    }
+    if (point->bits > 0)
+    {
+        // The block starts partway through the byte before the point.
+        uint8_t byte;
+        if (pread(fd, &byte, 1, point->in - 1) != 1)
+        {
+            perror("Couldn't read trace file");
+            return -1;
+        }
+        inflatePrime(strm, point->bits, byte >> (8 - point->bits));
+    }
+    inflateSetDictionary(strm, window.data(), GZINDEX_WINDOW_SIZE);
+
+    *out = point->out;
+    *in = point->in;
+    return 0;
+}
+
+void gzindex_free(GzIndex *idx)
+{
+    delete idx;
+}
@@ -0,0 +1,139 @@
+// gzindex.h
+// Declares a random-access index of a gzip trace: a sidecar file of inflate
+// access points from which decompression can resume mid-stream, in the style
+// of zlib's zran.c example.
+//
+// File layout of <trace>.gzi:
+//
+//     GzIndexHeader
+//     GzIndexPoint 0, then its compressed window
+//     GzIndexPoint 1, then its compressed window
+//     ...
+//
+// An access point is a deflate block boundary. Inflate can resume there from
+// the bit position within the compressed byte and the 32 KB of uncompressed
+// data before it, which back-references in the following blocks may copy
+// from. Each window is stored zlib-compressed, which makes it tiny for traces.
+
+#ifndef _GZINDEX_H_
+#define _GZINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+/** Magic bytes at the start of an index file. */
+#define GZINDEX_MAGIC "TRGZI\0\0\0"
+/** Length of GZINDEX_MAGIC. */
+#define GZINDEX_MAGIC_LEN 8
+/** The current version of the file layout. */
+#define GZINDEX_VERSION 1
+/** Suffix appended to the trace file name to name its index. */
+#define GZINDEX_SUFFIX ".gzi"
+/** Default number of uncompressed bytes between access points. */
+#define GZINDEX_DEFAULT_SPAN (1024 * 1024)
+/** Size of the deflate window saved at each access point. */
+#define GZINDEX_WINDOW_SIZE 32768
+
+/** The header at the start of an index file. */
+typedef struct GzIndexHeaderStruct
+{
+    char magic[GZINDEX_MAGIC_LEN];
+    uint32_t version;
+    /** Size of the trailer after each compressed stream: 8 (gzip) or 4 (zlib). */
+    uint32_t trailer_size;
+    /** Size of the compressed trace, to detect an index of another file. */
+    uint64_t comp_size;
+    /** Uncompressed size of the trace. */
+    uint64_t raw_size;
+    /** Number of access points. */
+    uint64_t num_points;
+} GzIndexHeader;
+
+/** One access point. */
+typedef struct GzIndexPointStruct
+{
+    /** Offset in the uncompressed trace. */
+    uint64_t out;
+    /** Offset of the first whole compressed byte after the block boundary. */
+    uint64_t in;
+    /** Number of bits of the byte before in that belong to the next block. */
+    uint32_t bits;
+    /** Size of the compressed window that follows. */
+    uint32_t window_comp_size;
+} GzIndexPoint;
+
+/** An index loaded into memory. Private to gzindex.cpp. */
+typedef struct GzIndexStruct GzIndex;
+
+/**
+ * Inflate a gzip or zlib trace once and record an access point at the first
+ * block boundary after every span uncompressed bytes.
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * @param fd an open file descriptor for the trace; not closed
+ * @param span the least number of uncompressed bytes between access points
+ * @return the index, or NULL on failure
+ */
+GzIndex *gzindex_build(int fd, uint64_t span);
+
+/**
+ * Write an index to a file.
+ *
+ * @param idx the index
+ * @param filename the path of the file to create
+ * @return 0 on success, or -1 on error
+ */
+int gzindex_write(const GzIndex *idx, const char *filename);
+
+/**
+ * Load an index from a file.
+ *
+ * Returns NULL without a message if the file does not exist. Prints an error
+ * message and returns NULL if it is invalid, or if it does not match a
+ * compressed trace of comp_size bytes.
+ *
+ * @param filename the path of the index file
+ * @param comp_size the size of the compressed trace the index is for
+ * @return the index, or NULL
+ */
+GzIndex *gzindex_load(const char *filename, uint64_t comp_size);
+
+/** @return the number of access points in the index */
+uint64_t gzindex_num_points(const GzIndex *idx);
+
+/** @return the uncompressed size of the indexed trace */
+uint64_t gzindex_raw_size(const GzIndex *idx);
+
+/** @return the size of the trailer after each compressed stream */
+unsigned int gzindex_trailer_size(const GzIndex *idx);
+
+/**
+ * Prepare an inflate stream to resume at the last access point at or before
+ * an uncompressed offset.
+ *
+ * The stream is reset to raw deflate, primed with the bits of the block that
+ * start in the byte before the point, and given the point's window. The
+ * caller must then feed it input from the returned compressed offset on.
+ *
+ * @param idx the index
+ * @param fd the compressed trace, to read the partial byte from
+ * @param offset the uncompressed offset to resume at or before
+ * @param strm an initialized inflate stream
+ * @param out receives the uncompressed offset of the access point
+ * @param in receives the compressed offset to continue reading from
+ * @return 0 on success, 1 if there is no access point at or before offset,
+ * or -1 on error
+ */
+int gzindex_seek(const GzIndex *idx, int fd, uint64_t offset, z_stream *strm,
+                 uint64_t *out, uint64_t *in);
+
+/**
+ * Release an index.
+ *
+ * @param idx the index, or NULL
+ */
+void gzindex_free(GzIndex *idx);
+
+#endif
@@ -0,0 +1,30 @@
+// hash.h
+// Declares the hash function shared by the analyzer's hash tables and
+// sketches.
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+
+/**
+ * Hash a 64-bit value with the MurmurHash3 finalizer.
+ *
+ * It is cheap and every input bit affects every output bit, so both the low
+ * bits (table indices) and the high bits (fingerprints, HyperLogLog ranks)
+ * of the result are well mixed even for sequential PCs.
+ *
+ * @param x the value to hash
+ * @return the hash of x
+ */
+static inline uint64_t hash_u64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+#endif
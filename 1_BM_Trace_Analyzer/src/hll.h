@@ -0,0 +1,125 @@
+// hll.h
+// Declares a HyperLogLog sketch for estimating the number of unique PCs in
+// bounded memory.
+
+#ifndef _HLL_H_
+#define _HLL_H_
+
+#include "hash.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Smallest supported HyperLogLog precision (16 registers). */
+#define HLL_MIN_PRECISION 4
+/** Largest supported HyperLogLog precision (256K registers). */
+#define HLL_MAX_PRECISION 18
+/** Default HyperLogLog precision: 4K registers, about 1.6% standard error. */
+#define HLL_DEFAULT_PRECISION 12
+
+/**
+ * A HyperLogLog distinct-count sketch (Flajolet et al., 2007).
+ *
+ * The top `precision` bits of each hashed PC select one of 2^precision
+ * one-byte registers, and the register keeps the largest number of leading
+ * zeros plus one seen in the remaining hash bits. Memory use is 2^precision
+ * bytes no matter how many PCs are added.
+ */
+class HyperLogLog
+{
+public:
+    /**
+     * Construct an empty sketch.
+     *
+     * @param precision the number of index bits, between HLL_MIN_PRECISION
+     * and HLL_MAX_PRECISION
+     */
+    explicit HyperLogLog(unsigned int precision = HLL_DEFAULT_PRECISION)
+        : precision(precision), registers((size_t)1 << precision, 0)
+    {
+    }
+
+    /**
+     * Add a PC to the sketch.
+     *
+     * @param pc the address to add
+     */
+    inline void add(uint64_t pc)
+    {
+        uint64_t h = hash_u64(pc);
+        size_t index = h >> (64 - precision);
+        // Set a sentinel bit so the rank is capped at 64 - precision + 1.
+        uint64_t rest = (h << precision) | ((uint64_t)1 << (precision - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (rank > registers[index])
+        {
+            registers[index] = rank;
+        }
+    }
+
+    /**
+     * Estimate the number of distinct PCs added so far.
+     *
+     * Uses the raw HyperLogLog estimate, with linear counting for small
+     * cardinalities. No large-range correction is needed with 64-bit hashes.
+     *
+     * @return the estimated number of distinct PCs
+     */
+    double estimate() const
+    {
+        double m = (double)registers.size();
+        double sum = 0.0;
+        size_t zeros = 0;
+        for (size_t i = 0; i < registers.size(); i++)
+        {
+            sum += ldexp(1.0, -registers[i]);
+            zeros += (registers[i] == 0);
+        }
+
+        double e = alpha() * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0)
+        {
+            e = m * log(m / (double)zeros);
+        }
+        return e;
+    }
+
+    /**
+     * @return the relative standard error of estimate(), 1.04 / sqrt(m)
+     */
+    double std_error() const
+    {
+        return 1.04 / sqrt((double)registers.size());
+    }
+
+    /** @return the number of index bits */
+    unsigned int get_precision() const
+    {
+        return precision;
+    }
+
+private:
+    /** The number of index bits. */
+    unsigned int precision;
+    /** One register per index. */
+    std::vector<uint8_t> registers;
+
+    /** The bias correction constant alpha_m. */
+    double alpha() const
+    {
+        switch (registers.size())
+        {
+        case 16:
+            return 0.673;
+        case 32:
+            return 0.697;
+        case 64:
+            return 0.709;
+        default:
+            return 0.7213 / (1.0 + 1.079 / (double)registers.size());
+        }
+    }
+};
+
+#endif
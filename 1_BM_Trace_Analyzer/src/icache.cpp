@@ -0,0 +1,75 @@
+// icache.cpp
+// Implements the all-geometries instruction cache simulator.
+
+#include "icache.h"
+#include <string.h>
+
+ICacheProfiler::ICacheProfiler()
+    : repeat_hits(0), num_accesses(0), last_line(ICACHE_EMPTY)
+{
+    memset(depth_hits, 0, sizeof(depth_hits));
+}
+
+void ICacheProfiler::allocate()
+{
+    for (int k = 0; k <= ICACHE_MAX_SET_BITS; k++)
+    {
+        stacks[k].assign(((size_t)1 << k) * ICACHE_MAX_WAYS, ICACHE_EMPTY);
+    }
+}
+
+void ICacheProfiler::access(uint64_t line)
+{
+    for (int k = 0; k <= ICACHE_MAX_SET_BITS; k++)
+    {
+        uint64_t set = line & (((uint64_t)1 << k) - 1);
+        uint64_t *stack = &stacks[k][set * ICACHE_MAX_WAYS];
+
+        // Find the line, or fall off the bottom of the stack on a miss.
+        int depth = 0;
+        while (depth < ICACHE_MAX_WAYS && stack[depth] != line)
+        {
+            depth++;
+        }
+        if (depth < ICACHE_MAX_WAYS)
+        {
+            depth_hits[k][depth]++;
+        }
+        else
+        {
+            depth = ICACHE_MAX_WAYS - 1;
+        }
+
+        // Move it to the top.
+        memmove(stack + 1, stack, depth * sizeof(uint64_t));
+        stack[0] = line;
+    }
+}
+
+uint64_t ICacheProfiler::misses(unsigned int set_bits, unsigned int ways) const
+{
+    uint64_t hits = repeat_hits;
+    for (unsigned int d = 0; d < ways; d++)
+    {
+        hits += depth_hits[set_bits][d];
+    }
+    return num_accesses - hits;
+}
+
+bool ICacheProfiler::supported(uint64_t size, unsigned int ways)
+{
+    uint64_t way_size = (uint64_t)ways << ICACHE_LINE_BITS;
+    if (ways == 0 || ways > ICACHE_MAX_WAYS || (ways & (ways - 1)) != 0 ||
+        size < way_size || size % way_size != 0)
+    {
+        return false;
+    }
+    uint64_t sets = size / way_size;
+    return (sets & (sets - 1)) == 0 && sets <= ((uint64_t)1 << ICACHE_MAX_SET_BITS);
+}
+
+uint64_t ICacheProfiler::misses_for_size(uint64_t size, unsigned int ways) const
+{
+    uint64_t sets = size / ((uint64_t)ways << ICACHE_LINE_BITS);
+    return misses(63 - __builtin_clzll(sets), ways);
+}
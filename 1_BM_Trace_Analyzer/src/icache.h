@@ -0,0 +1,118 @@
+// icache.h
+// Declares a single-pass simulator of every power-of-two set-associative LRU
+// instruction cache.
+
+#ifndef _ICACHE_H_
+#define _ICACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** log2 of the instruction cache line size. */
+#define ICACHE_LINE_BITS 6
+/** log2 of the largest number of sets simulated. */
+#define ICACHE_MAX_SET_BITS 14
+/** Largest associativity simulated. Must be a power of two. */
+#define ICACHE_MAX_WAYS 16
+/** Smallest and largest cache sizes reported by -icachemrc, in bytes. */
+#define ICACHE_MIN_REPORT_SIZE 1024
+#define ICACHE_MAX_REPORT_SIZE (1024 * 1024)
+/** Default cache used by -imisspenalty. */
+#define ICACHE_DEFAULT_SIZE (32 * 1024)
+#define ICACHE_DEFAULT_ASSOC 8
+/** Marks an empty way. */
+#define ICACHE_EMPTY ((uint64_t)-1)
+
+/**
+ * Simulates every LRU instruction cache with 2^0 .. 2^ICACHE_MAX_SET_BITS sets
+ * and 1 .. ICACHE_MAX_WAYS ways at once.
+ *
+ * LRU caches with the same number of sets have the inclusion property: each
+ * set of an A-way cache holds the A most recently used lines that map to it.
+ * So for each number of sets, one LRU stack per set, ICACHE_MAX_WAYS deep, is
+ * enough. An access found at depth d of its set's stack hits in every cache
+ * with that many sets and more than d ways, and misses in the rest (Mattson
+ * et al., 1970). One histogram of depths per set count then gives the misses
+ * of every capacity and associativity.
+ *
+ * Every access costs one bounded stack search per set count. Repeated
+ * accesses to the previous line hit at depth 0 everywhere and skip the search.
+ */
+class ICacheProfiler
+{
+public:
+    /** Set up an empty profile. The stacks are not allocated until allocate(). */
+    ICacheProfiler();
+
+    /**
+     * Allocate the LRU stacks, about 4 MB. Must be called before the first
+     * add(); profiles that are never added to need not call it.
+     */
+    void allocate();
+
+    /**
+     * Account for one instruction fetch.
+     *
+     * @param pc the address of the instruction
+     */
+    inline void add(uint64_t pc)
+    {
+        uint64_t line = pc >> ICACHE_LINE_BITS;
+        num_accesses++;
+        if (line == last_line)
+        {
+            repeat_hits++;
+        }
+        else
+        {
+            access(line);
+            last_line = line;
+        }
+    }
+
+    /**
+     * @param set_bits log2 of the number of sets, at most ICACHE_MAX_SET_BITS
+     * @param ways the associativity, at most ICACHE_MAX_WAYS
+     * @return the number of misses in that cache, including cold misses
+     */
+    uint64_t misses(unsigned int set_bits, unsigned int ways) const;
+
+    /**
+     * @param size the cache size in bytes
+     * @param ways the associativity
+     * @return true if a cache of that geometry is simulated
+     */
+    static bool supported(uint64_t size, unsigned int ways);
+
+    /**
+     * @param size the cache size in bytes, which must be supported()
+     * @param ways the associativity
+     * @return the number of misses in that cache
+     */
+    uint64_t misses_for_size(uint64_t size, unsigned int ways) const;
+
+    /** @return the number of instruction fetches */
+    uint64_t get_num_accesses() const
+    {
+        return num_accesses;
+    }
+
+private:
+    /**
+     * LRU stacks, indexed by set bits: ICACHE_MAX_WAYS lines per set, most
+     * recent first.
+     */
+    std::vector<uint64_t> stacks[ICACHE_MAX_SET_BITS + 1];
+    /** Number of hits at each stack depth, indexed by set bits. */
+    uint64_t depth_hits[ICACHE_MAX_SET_BITS + 1][ICACHE_MAX_WAYS];
+    /** Hits on the previous line, which are at depth 0 for every set count. */
+    uint64_t repeat_hits;
+    uint64_t num_accesses;
+    uint64_t last_line;
+
+    /** Look up a line other than the previous one in every stack. */
+    void access(uint64_t line);
+};
+
+#endif
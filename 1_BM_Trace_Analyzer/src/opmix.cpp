@@ -0,0 +1,248 @@
+// opmix.cpp
+// Implements the op-type histogram kernels.
+//
+// The SIMD kernels are compiled with per-function target attributes, so the
+// rest of the analyzer needs no special compiler flags and still runs on CPUs
+// without AVX2. The kernel is picked once, on first use, from what the CPU
+// supports.
+
+#include "opmix.h"
+#include <immintrin.h>
+#include <stddef.h>
+#include <string.h>
+
+// The record kernels read the op type straight out of 16-byte records.
+static_assert(sizeof(TraceRec) == 16 && offsetof(TraceRec, optype) == 8,
+              "the record kernels assume 16-byte records with the op type at byte 8");
+
+/** Largest number of vectors added into 8-bit lane counters before folding. */
+#define OPMIX_MAX_LANE_COUNT 255
+
+/** Names of the kernels, indexed by OpMixKernel. */
+static const char *opmix_kernel_names[NUM_OPMIX_KERNELS] = {"scalar", "avx2", "avx512"};
+
+/** The kernel selected by opmix_set_kernel(), or NUM_OPMIX_KERNELS if none. */
+static OpMixKernel opmix_kernel = NUM_OPMIX_KERNELS;
+
+/** @return true if the CPU can run the given kernel */
+static bool opmix_supported(OpMixKernel kernel)
+{
+    __builtin_cpu_init();
+    switch (kernel)
+    {
+    case OPMIX_SCALAR:
+        return true;
+    case OPMIX_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case OPMIX_AVX512:
+        return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt");
+    default:
+        return false;
+    }
+}
+
+/** @return the fastest kernel the CPU supports */
+static OpMixKernel opmix_fastest_kernel()
+{
+    // A function-local static is initialized exactly once even when threads
+    // analyzing different traces get here at the same time.
+    static const OpMixKernel fastest = opmix_supported(OPMIX_AVX512) ? OPMIX_AVX512
+                                       : opmix_supported(OPMIX_AVX2) ? OPMIX_AVX2
+                                                                     : OPMIX_SCALAR;
+    return fastest;
+}
+
+/** @return the selected kernel, or the fastest supported one if unset */
+static OpMixKernel opmix_get_kernel()
+{
+    return opmix_kernel != NUM_OPMIX_KERNELS ? opmix_kernel : opmix_fastest_kernel();
+}
+
+bool opmix_set_kernel(OpMixKernel kernel)
+{
+    if (!opmix_supported(kernel))
+    {
+        return false;
+    }
+    opmix_kernel = kernel;
+    return true;
+}
+
+bool opmix_parse_kernel(const char *name, OpMixKernel *kernel)
+{
+    for (int k = 0; k < NUM_OPMIX_KERNELS; k++)
+    {
+        if (strcmp(name, opmix_kernel_names[k]) == 0)
+        {
+            *kernel = (OpMixKernel)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *opmix_kernel_name()
+{
+    return opmix_kernel_names[opmix_get_kernel()];
+}
+
+/**
+ * Count op types one byte at a time, stride bytes apart.
+ *
+ * Four sub-histograms are updated in turn so that runs of the same op type do
+ * not make every increment wait for the previous one to the same counter.
+ */
+static void opmix_count_scalar(const uint8_t *bytes, size_t n, size_t stride,
+                               uint64_t hist[NUM_OP_TYPES])
+{
+    uint64_t sub[4][NUM_OP_TYPES];
+    memset(sub, 0, sizeof(sub));
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sub[0][bytes[(i + 0) * stride]]++;
+        sub[1][bytes[(i + 1) * stride]]++;
+        sub[2][bytes[(i + 2) * stride]]++;
+        sub[3][bytes[(i + 3) * stride]]++;
+    }
+    for (; i < n; i++)
+    {
+        sub[0][bytes[i * stride]]++;
+    }
+
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        hist[op] += sub[0][op] + sub[1][op] + sub[2][op] + sub[3][op];
+    }
+}
+
+/**
+ * Count op types in num_vectors 32-byte vectors with AVX2.
+ *
+ * Every byte lane keeps its own 8-bit count for each op type, so lanes never
+ * conflict. The counts are folded into hist with a sum of absolute
+ * differences before any of them can overflow.
+ *
+ * @param records true if bytes holds 16-byte records, in which case only the
+ * op type byte of each record is counted; false for a dense array of op types
+ */
+__attribute__((target("avx2"))) static void
+opmix_count_avx2(const uint8_t *bytes, size_t num_vectors, bool records,
+                 uint64_t hist[NUM_OP_TYPES])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lanes = records ? _mm256_set_epi64x(0xff, 0, 0xff, 0) : _mm256_set1_epi8(-1);
+    __m256i optype[NUM_OP_TYPES];
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        optype[op] = _mm256_set1_epi8(op);
+    }
+
+    while (num_vectors > 0)
+    {
+        size_t count = num_vectors < OPMIX_MAX_LANE_COUNT ? num_vectors : OPMIX_MAX_LANE_COUNT;
+        num_vectors -= count;
+
+        __m256i acc[NUM_OP_TYPES];
+        for (int op = 0; op < NUM_OP_TYPES; op++)
+        {
+            acc[op] = zero;
+        }
+        for (size_t v = 0; v < count; v++, bytes += 32)
+        {
+            __m256i data = _mm256_loadu_si256((const __m256i *)bytes);
+            for (int op = 0; op < NUM_OP_TYPES; op++)
+            {
+                // A match is -1 in its lane; subtracting it adds one.
+                __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(data, optype[op]), lanes);
+                acc[op] = _mm256_sub_epi8(acc[op], match);
+            }
+        }
+
+        for (int op = 0; op < NUM_OP_TYPES; op++)
+        {
+            __m256i sums = _mm256_sad_epu8(acc[op], zero);
+            hist[op] += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                        _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        }
+    }
+}
+
+/**
+ * Count op types in num_vectors 64-byte vectors with AVX-512BW.
+ *
+ * One compare per op type yields a 64-bit mask with a bit per matching byte,
+ * which is popcounted straight into the histogram.
+ *
+ * @param records true if bytes holds 16-byte records, in which case only the
+ * op type byte of each record is counted; false for a dense array of op types
+ */
+__attribute__((target("avx512bw,popcnt"))) static void
+opmix_count_avx512(const uint8_t *bytes, size_t num_vectors, bool records,
+                   uint64_t hist[NUM_OP_TYPES])
+{
+    const __mmask64 lanes = records ? 0x0100010001000100ULL : ~0ULL;
+    __m512i optype[NUM_OP_TYPES];
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        optype[op] = _mm512_set1_epi8(op);
+    }
+
+    uint64_t counts[NUM_OP_TYPES] = {0};
+    for (size_t v = 0; v < num_vectors; v++, bytes += 64)
+    {
+        __m512i data = _mm512_loadu_si512((const void *)bytes);
+        for (int op = 0; op < NUM_OP_TYPES; op++)
+        {
+            counts[op] += _mm_popcnt_u64(_mm512_mask_cmpeq_epi8_mask(lanes, data, optype[op]));
+        }
+    }
+
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        hist[op] += counts[op];
+    }
+}
+
+void opmix_count_optypes(const uint8_t *optypes, size_t n, uint64_t hist[NUM_OP_TYPES])
+{
+    size_t done = 0;
+    switch (opmix_get_kernel())
+    {
+    case OPMIX_AVX2:
+        opmix_count_avx2(optypes, n / 32, false, hist);
+        done = n / 32 * 32;
+        break;
+    case OPMIX_AVX512:
+        opmix_count_avx512(optypes, n / 64, false, hist);
+        done = n / 64 * 64;
+        break;
+    default:
+        break;
+    }
+
+    // The scalar kernel also handles whatever is left over.
+    opmix_count_scalar(optypes + done, n - done, 1, hist);
+}
+
+void opmix_count_records(const TraceRec *recs, size_t n, uint64_t hist[NUM_OP_TYPES])
+{
+    size_t done = 0;
+    switch (opmix_get_kernel())
+    {
+    case OPMIX_AVX2:
+        opmix_count_avx2((const uint8_t *)recs, n / 2, true, hist);
+        done = n / 2 * 2;
+        break;
+    case OPMIX_AVX512:
+        opmix_count_avx512((const uint8_t *)recs, n / 4, true, hist);
+        done = n / 4 * 4;
+        break;
+    default:
+        break;
+    }
+
+    opmix_count_scalar((const uint8_t *)(recs + done) + offsetof(TraceRec, optype), n - done,
+                       sizeof(TraceRec), hist);
+}
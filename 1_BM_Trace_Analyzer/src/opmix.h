@@ -0,0 +1,85 @@
+// opmix.h
+// Declares the op-type histogram kernels, with scalar, AVX2, and AVX-512
+// versions picked at run time.
+
+#ifndef _OPMIX_H_
+#define _OPMIX_H_
+
+#include "trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** The implementations of the op-type histogram kernels. */
+typedef enum OpMixKernelEnum
+{
+    OPMIX_SCALAR, // Portable C++
+    OPMIX_AVX2,   // 32 bytes at a time, per-lane byte counters
+    OPMIX_AVX512, // 64 bytes at a time, compare masks and popcount (AVX-512BW)
+    NUM_OPMIX_KERNELS
+} OpMixKernel;
+
+/**
+ * Select the kernel used by opmix_count_optypes() and opmix_count_records().
+ *
+ * By default the fastest kernel the CPU supports is used. Every kernel gives
+ * exactly the same counts.
+ *
+ * @param kernel the kernel to use
+ * @return true on success, or false if the CPU does not support the kernel
+ */
+bool opmix_set_kernel(OpMixKernel kernel);
+
+/**
+ * Look up a kernel by its name: "scalar", "avx2", or "avx512".
+ *
+ * @param name the name of the kernel
+ * @param kernel receives the kernel
+ * @return true on success, or false if there is no kernel with that name
+ */
+bool opmix_parse_kernel(const char *name, OpMixKernel *kernel);
+
+/** @return the name of the selected kernel */
+const char *opmix_kernel_name();
+
+/**
+ * Add the number of occurrences of each op type in a dense array of op types
+ * to hist.
+ *
+ * @param optypes the op types, all less than NUM_OP_TYPES
+ * @param n the number of op types
+ * @param hist the histogram to add to
+ */
+void opmix_count_optypes(const uint8_t *optypes, size_t n, uint64_t hist[NUM_OP_TYPES]);
+
+/**
+ * Add the number of occurrences of each op type in an array of trace records
+ * to hist.
+ *
+ * @param recs the records, all with op types less than NUM_OP_TYPES
+ * @param n the number of records
+ * @param hist the histogram to add to
+ */
+void opmix_count_records(const TraceRec *recs, size_t n, uint64_t hist[NUM_OP_TYPES]);
+
+/**
+ * Weight a histogram of op types by the cycles each op type takes.
+ *
+ * Replaces a table lookup per record with NUM_OP_TYPES multiplies per batch,
+ * with exactly the same integer result.
+ *
+ * @param hist the number of records of each op type
+ * @param cpi the cycles taken by each op type
+ * @return the total number of cycles
+ */
+static inline uint64_t opmix_cycles(const uint64_t hist[NUM_OP_TYPES],
+                                    const uint64_t cpi[NUM_OP_TYPES])
+{
+    uint64_t cycles = 0;
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        cycles += hist[op] * cpi[op];
+    }
+    return cycles;
+}
+
+#endif
@@ -0,0 +1,173 @@
+// pcset.h
+// Declares a flat open-addressing hash set of instruction addresses, used to
+// count unique PCs.
+
+#ifndef _PCSET_H_
+#define _PCSET_H_
+
+#include "hash.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Initial number of slots in a PcSet.
+ *
+ * Large enough that the instruction footprint of the lab traces fits without
+ * ever growing the table, while the whole table (9 bytes per slot) still fits
+ * in L2.
+ */
+#define PCSET_INITIAL_CAPACITY (16 * 1024)
+
+/** Number of slots compared at once. */
+#define PCSET_GROUP_SIZE 16
+
+/** Control byte of an empty slot. Fingerprints are 0-127. */
+#define PCSET_EMPTY ((int8_t)-128)
+
+/**
+ * A set of 64-bit instruction addresses.
+ *
+ * Slots are stored in two flat, power-of-two sized arrays: one control byte
+ * per slot and one key per slot. A control byte is either PCSET_EMPTY or the
+ * top 7 bits of the key's hash. Slots are probed in groups of 16, in the
+ * style of Swiss tables: one SSE2 compare finds every slot in a group whose
+ * control byte matches, and only those keys are compared. Groups are probed
+ * linearly.
+ *
+ * Keys are never removed, so the first group with an empty slot ends a probe.
+ */
+class PcSet
+{
+public:
+    /**
+     * Construct an empty set.
+     *
+     * @param initial_capacity the initial number of slots, rounded up to a
+     * power of two of at least one group
+     */
+    explicit PcSet(size_t initial_capacity = PCSET_INITIAL_CAPACITY)
+    {
+        size_t capacity = PCSET_GROUP_SIZE;
+        while (capacity < initial_capacity)
+        {
+            capacity *= 2;
+        }
+        reset(capacity);
+    }
+
+    /**
+     * Insert pc if it is not already in the set, with a single probe.
+     *
+     * @param pc the address to insert
+     * @return true if pc was inserted, false if it was already present
+     */
+    inline bool insert(uint64_t pc)
+    {
+        uint64_t h = hash_u64(pc);
+        int8_t fingerprint = (int8_t)(h >> 57);
+        size_t group = (size_t)h & group_mask;
+
+        while (true)
+        {
+            size_t base = group * PCSET_GROUP_SIZE;
+            uint32_t match, empty;
+            group_masks(base, fingerprint, &match, &empty);
+
+            for (; match != 0; match &= match - 1)
+            {
+                if (keys[base + __builtin_ctz(match)] == pc)
+                {
+                    return false;
+                }
+            }
+
+            if (empty != 0)
+            {
+                size_t slot = base + __builtin_ctz(empty);
+                ctrl[slot] = fingerprint;
+                keys[slot] = pc;
+                if (++count > max_count)
+                {
+                    grow();
+                }
+                return true;
+            }
+
+            group = (group + 1) & group_mask;
+        }
+    }
+
+    /** @return the number of addresses in the set */
+    size_t size() const
+    {
+        return count;
+    }
+
+private:
+    /** One control byte per slot. */
+    std::vector<int8_t> ctrl;
+    /** One key per slot. */
+    std::vector<uint64_t> keys;
+    /** Number of groups minus one. */
+    size_t group_mask;
+    /** Number of keys in the set. */
+    size_t count;
+    /** Grow when count exceeds this (7/8 load factor). */
+    size_t max_count;
+
+    /**
+     * Find the slots of a group whose control byte equals fingerprint, and
+     * the empty slots of the group, as bit masks.
+     */
+    inline void group_masks(size_t base, int8_t fingerprint, uint32_t *match,
+                            uint32_t *empty) const
+    {
+#ifdef __SSE2__
+        __m128i g = _mm_loadu_si128((const __m128i *)&ctrl[base]);
+        *match = _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(fingerprint)));
+        *empty = _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(PCSET_EMPTY)));
+#else
+        *match = 0;
+        *empty = 0;
+        for (size_t i = 0; i < PCSET_GROUP_SIZE; i++)
+        {
+            *match |= (uint32_t)(ctrl[base + i] == fingerprint) << i;
+            *empty |= (uint32_t)(ctrl[base + i] == PCSET_EMPTY) << i;
+        }
+#endif
+    }
+
+    /** Empty the set and resize it to capacity slots. */
+    void reset(size_t capacity)
+    {
+        ctrl.assign(capacity, PCSET_EMPTY);
+        keys.assign(capacity, 0);
+        group_mask = capacity / PCSET_GROUP_SIZE - 1;
+        count = 0;
+        max_count = capacity - capacity / 8;
+    }
+
+    /** Double the number of slots and reinsert every key. */
+    void grow()
+    {
+        std::vector<int8_t> old_ctrl;
+        std::vector<uint64_t> old_keys;
+        old_ctrl.swap(ctrl);
+        old_keys.swap(keys);
+
+        reset(old_ctrl.size() * 2);
+        for (size_t i = 0; i < old_ctrl.size(); i++)
+        {
+            if (old_ctrl[i] != PCSET_EMPTY)
+            {
+                insert(old_keys[i]);
+            }
+        }
+    }
+};
+
+#endif
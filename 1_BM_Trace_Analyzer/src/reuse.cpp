@@ -0,0 +1,177 @@
+// reuse.cpp
+// Implements the reuse-distance and working-set profiler.
+
+#include "reuse.h"
+#include <algorithm>
+#include <string.h>
+#include <utility>
+
+/** Initial number of slots in the block table. */
+#define REUSE_INITIAL_SLOTS 1024
+
+ReuseProfiler::ReuseProfiler(unsigned int block_bits, uint64_t interval_size)
+    : block_bits(block_bits), interval_size(interval_size),
+      keys(REUSE_INITIAL_SLOTS, REUSE_EMPTY), last_time(REUSE_INITIAL_SLOTS),
+      last_interval(REUSE_INITIAL_SLOTS), slot_mask(REUSE_INITIAL_SLOTS - 1),
+      num_blocks(0), tree(REUSE_MIN_TIMES + 1, 0), next_time(1),
+      last_block(REUSE_EMPTY), last_slot(0), num_accesses(0), interval(0),
+      interval_accesses(0), interval_blocks(0)
+{
+    memset(histogram, 0, sizeof(histogram));
+}
+
+void ReuseProfiler::access(uint64_t block)
+{
+    if (next_time == tree.size())
+    {
+        compact_times();
+    }
+
+    bool inserted;
+    size_t slot = find_or_insert(block, &inserted);
+    uint32_t now = next_time++;
+
+    if (inserted)
+    {
+        // A cold miss: every cache misses, whatever its size.
+        last_interval[slot] = interval;
+        interval_blocks++;
+    }
+    else
+    {
+        // The stack distance is the number of blocks whose last access came
+        // after this block's last access.
+        uint32_t then = last_time[slot];
+        uint64_t distance = num_blocks - prefix(then);
+        histogram[distance == 0 ? 0 : 64 - __builtin_clzll(distance)]++;
+        update(then, -1);
+        touch_interval(slot);
+    }
+
+    update(now, 1);
+    last_time[slot] = now;
+    last_block = block;
+    last_slot = slot;
+}
+
+size_t ReuseProfiler::find_or_insert(uint64_t block, bool *inserted)
+{
+    size_t slot = hash_u64(block) & slot_mask;
+    while (keys[slot] != REUSE_EMPTY)
+    {
+        if (keys[slot] == block)
+        {
+            *inserted = false;
+            return slot;
+        }
+        slot = (slot + 1) & slot_mask;
+    }
+
+    // Keep the table at most half full.
+    if (2 * (num_blocks + 1) > keys.size())
+    {
+        grow_table();
+        return find_or_insert(block, inserted);
+    }
+
+    keys[slot] = block;
+    num_blocks++;
+    *inserted = true;
+    return slot;
+}
+
+void ReuseProfiler::grow_table()
+{
+    std::vector<uint64_t> old_keys(keys.size() * 2, REUSE_EMPTY);
+    std::vector<uint32_t> old_time(keys.size() * 2);
+    std::vector<uint32_t> old_interval(keys.size() * 2);
+    old_keys.swap(keys);
+    old_time.swap(last_time);
+    old_interval.swap(last_interval);
+    slot_mask = keys.size() - 1;
+
+    for (size_t i = 0; i < old_keys.size(); i++)
+    {
+        if (old_keys[i] == REUSE_EMPTY)
+        {
+            continue;
+        }
+        size_t slot = hash_u64(old_keys[i]) & slot_mask;
+        while (keys[slot] != REUSE_EMPTY)
+        {
+            slot = (slot + 1) & slot_mask;
+        }
+        keys[slot] = old_keys[i];
+        last_time[slot] = old_time[i];
+        last_interval[slot] = old_interval[i];
+        if (old_keys[i] == last_block)
+        {
+            last_slot = slot;
+        }
+    }
+}
+
+void ReuseProfiler::compact_times()
+{
+    // Sort the blocks by last access time and hand out times 1 .. blocks in
+    // that order, which keeps every stack distance the same.
+    std::vector<std::pair<uint32_t, size_t> > order;
+    order.reserve(num_blocks);
+    for (size_t slot = 0; slot < keys.size(); slot++)
+    {
+        if (keys[slot] != REUSE_EMPTY)
+        {
+            order.push_back(std::make_pair(last_time[slot], slot));
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    // Leave room for at least as many new accesses as there are blocks.
+    size_t times = std::max((size_t)REUSE_MIN_TIMES, 2 * order.size());
+    tree.assign(times + 1, 0);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        last_time[order[i].second] = i + 1;
+        tree[i + 1] = 1;
+    }
+    next_time = order.size() + 1;
+
+    // Build the Fenwick tree from the 1s in linear time.
+    for (size_t t = 1; t < tree.size(); t++)
+    {
+        size_t parent = t + (t & -t);
+        if (parent < tree.size())
+        {
+            tree[parent] += tree[t];
+        }
+    }
+}
+
+void ReuseProfiler::end_interval()
+{
+    footprints.push_back(interval_blocks);
+    interval++;
+    interval_accesses = 0;
+    interval_blocks = 0;
+}
+
+void ReuseProfiler::finish()
+{
+    if (interval_size > 0 && interval_accesses > 0)
+    {
+        end_interval();
+    }
+}
+
+uint64_t ReuseProfiler::misses(uint64_t capacity) const
+{
+    // Accesses with distance >= capacity miss. With capacity = 2^k those are
+    // exactly the buckets from bucket k + 1 on.
+    uint64_t count = get_cold_misses();
+    int first_miss = 64 - __builtin_clzll(capacity);
+    for (int b = first_miss; b < REUSE_NUM_BUCKETS; b++)
+    {
+        count += histogram[b];
+    }
+    return count;
+}
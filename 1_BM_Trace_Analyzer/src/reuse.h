@@ -0,0 +1,219 @@
+// reuse.h
+// Declares a profiler of exact LRU reuse (stack) distances and of the
+// per-interval working set of instruction addresses.
+
+#ifndef _REUSE_H_
+#define _REUSE_H_
+
+#include "hash.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** log2 of the cache line size used for line-granularity reuse distances. */
+#define REUSE_LINE_BITS 6
+/** log2 of the page size used for page-granularity reuse distances. */
+#define REUSE_PAGE_BITS 12
+/** Default number of instructions per footprint interval. */
+#define REUSE_DEFAULT_INTERVAL 100000
+/**
+ * Number of reuse-distance buckets: bucket 0 holds distance 0, and bucket b
+ * holds distances in [2^(b-1), 2^b).
+ */
+#define REUSE_NUM_BUCKETS 65
+/** Smallest number of access times the Fenwick tree is sized for. */
+#define REUSE_MIN_TIMES (64 * 1024)
+/** Marks an empty slot in the block table. */
+#define REUSE_EMPTY ((uint64_t)-1)
+
+/**
+ * Measures the LRU stack distance of every access to a block of addresses,
+ * that is, the number of distinct other blocks accessed since the previous
+ * access to the same block.
+ *
+ * An access with stack distance d hits in a fully associative LRU cache of C
+ * blocks exactly when d < C, so one histogram of distances gives the miss
+ * ratio of every cache size at once (Mattson et al., 1970).
+ *
+ * Each block remembers the time of its last access, and a Fenwick tree over
+ * time holds a 1 at the last access time of every block. The stack distance
+ * of an access is then the number of 1s after the block's previous access
+ * time, an O(log n) prefix sum, instead of an O(n) walk of an LRU stack. When
+ * the tree runs out of times, the live times are renumbered 1 .. blocks.
+ *
+ * Repeated accesses to the block accessed just before have distance 0 and
+ * leave the tree unchanged, which covers most straight-line code.
+ */
+class ReuseProfiler
+{
+public:
+    /**
+     * Construct a profiler.
+     *
+     * @param block_bits log2 of the block size in bytes
+     * @param interval_size the number of accesses per footprint interval, or 0
+     * to not track the footprint over time
+     */
+    explicit ReuseProfiler(unsigned int block_bits = REUSE_LINE_BITS,
+                           uint64_t interval_size = 0);
+
+    /**
+     * Account for one access.
+     *
+     * @param addr the address accessed
+     */
+    inline void add(uint64_t addr)
+    {
+        uint64_t block = addr >> block_bits;
+        num_accesses++;
+
+        if (block == last_block)
+        {
+            // Distance 0, and the block already holds the latest time.
+            histogram[0]++;
+            touch_interval(last_slot);
+        }
+        else
+        {
+            access(block);
+        }
+
+        if (interval_size > 0 && ++interval_accesses == interval_size)
+        {
+            end_interval();
+        }
+    }
+
+    /** Close the last, possibly partial, footprint interval. */
+    void finish();
+
+    /**
+     * @return the number of accesses in each distance bucket; see
+     * REUSE_NUM_BUCKETS
+     */
+    const uint64_t *get_histogram() const
+    {
+        return histogram;
+    }
+
+    /** @return the number of first accesses to a block (cold misses) */
+    uint64_t get_cold_misses() const
+    {
+        return num_blocks;
+    }
+
+    /** @return the number of accesses */
+    uint64_t get_num_accesses() const
+    {
+        return num_accesses;
+    }
+
+    /** @return the number of distinct blocks accessed */
+    uint64_t get_num_blocks() const
+    {
+        return num_blocks;
+    }
+
+    /** @return log2 of the block size in bytes */
+    unsigned int get_block_bits() const
+    {
+        return block_bits;
+    }
+
+    /**
+     * @param capacity the number of blocks in a fully associative LRU cache,
+     * a power of two
+     * @return the number of misses in that cache, including cold misses
+     */
+    uint64_t misses(uint64_t capacity) const;
+
+    /** @return the number of distinct blocks accessed in each interval */
+    const std::vector<uint64_t> &get_footprints() const
+    {
+        return footprints;
+    }
+
+    /** @return the number of accesses per footprint interval */
+    uint64_t get_interval_size() const
+    {
+        return interval_size;
+    }
+
+private:
+    unsigned int block_bits;
+    uint64_t interval_size;
+
+    /** Block table, open addressing with linear probing. */
+    std::vector<uint64_t> keys;
+    /** Last access time of the block in each slot. */
+    std::vector<uint32_t> last_time;
+    /** Last interval in which the block in each slot was accessed. */
+    std::vector<uint32_t> last_interval;
+    size_t slot_mask;
+    uint64_t num_blocks;
+
+    /** Fenwick tree over access times 1 .. tree.size() - 1. */
+    std::vector<uint32_t> tree;
+    /** The next access time to hand out. */
+    uint32_t next_time;
+
+    /** The previously accessed block and its slot. */
+    uint64_t last_block;
+    size_t last_slot;
+
+    uint64_t histogram[REUSE_NUM_BUCKETS];
+    uint64_t num_accesses;
+
+    /** The current interval, its number of accesses and distinct blocks. */
+    uint32_t interval;
+    uint64_t interval_accesses;
+    uint64_t interval_blocks;
+    std::vector<uint64_t> footprints;
+
+    /** Count the block in slot in the current interval's footprint. */
+    inline void touch_interval(size_t slot)
+    {
+        if (last_interval[slot] != interval)
+        {
+            last_interval[slot] = interval;
+            interval_blocks++;
+        }
+    }
+
+    /** @return the number of 1s at times 1 .. t */
+    inline uint64_t prefix(uint32_t t) const
+    {
+        uint64_t sum = 0;
+        for (; t > 0; t &= t - 1)
+        {
+            sum += tree[t];
+        }
+        return sum;
+    }
+
+    /** Add delta at time t. */
+    inline void update(uint32_t t, int32_t delta)
+    {
+        for (; t < tree.size(); t += t & -t)
+        {
+            tree[t] += delta;
+        }
+    }
+
+    /** Account for an access to a block other than the previous one. */
+    void access(uint64_t block);
+
+    /** @return the slot of block, adding it to the table if it is new */
+    size_t find_or_insert(uint64_t block, bool *inserted);
+
+    /** Double the block table. */
+    void grow_table();
+
+    /** Renumber the live access times 1 .. blocks and resize the tree. */
+    void compact_times();
+
+    /** Record the current interval's footprint and start a new interval. */
+    void end_interval();
+};
+
+#endif
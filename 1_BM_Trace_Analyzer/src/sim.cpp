@@ -7,132 +7,818 @@
 // Author: Rishov Sarkar
 
 #include "trace.h"
+#include "tracefile.h"
+#include "analysis.h"
+#include "opmix.h"
+#include <algorithm>
+#include <atomic>
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
 
-/** Total number of instructions executed. Updated in this file. */
-extern uint64_t stat_num_inst;
+/**
+ * Whether unique PCs should be counted exactly.
+ *
+ * You should not modify this value directly; it is cleared by the
+ * command-line argument -approx-unique and set by -validate-unique.
+ */
+bool UNIQUE_PC_EXACT = true;
+
+/**
+ * Whether unique PCs should be estimated with a HyperLogLog sketch.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * arguments -approx-unique and -validate-unique.
+ */
+bool UNIQUE_PC_APPROX = false;
+
+/**
+ * The precision of the HyperLogLog sketch.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -hllprecision.
+ */
+unsigned int HLL_PRECISION = HLL_DEFAULT_PRECISION;
+
+/**
+ * The number of hottest PCs to report, or 0 to disable the profile.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -toppc.
+ */
+unsigned int TOPPC_K = 0;
+
+/**
+ * The number of counters in the heavy-hitter sketch.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -toppccounters.
+ */
+unsigned int TOPPC_COUNTERS = TOPK_DEFAULT_COUNTERS;
+
+/**
+ * The number of instructions per SimPoint interval, or 0 to disable SimPoint
+ * profiling.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -simpoint.
+ */
+uint64_t SIMPOINT_INTERVAL = 0;
+
+/**
+ * The largest number of clusters SimPoint profiling tries.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -simpointmaxk.
+ */
+unsigned int SIMPOINT_MAX_K = SIMPOINT_DEFAULT_MAX_K;
+
+/**
+ * The number of instructions per working-set interval, or 0 to disable the
+ * reuse-distance analysis.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -reuse.
+ */
+uint64_t REUSE_INTERVAL = 0;
+
+/**
+ * The number of hottest edges, branches, and loops to report, or 0 to
+ * disable the control-flow analysis.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -cfg.
+ */
+unsigned int CFG_K = 0;
+
+/**
+ * Whether to report the miss ratio of every power-of-two instruction cache.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -icachemrc.
+ */
+bool ICACHE_MRC = false;
+
+/**
+ * The instruction cache charged by IMISS_PENALTY.
+ *
+ * You should not modify these values directly; they are set by the
+ * command-line arguments -icachesize and -icacheassoc.
+ */
+uint64_t ICACHE_SIZE = ICACHE_DEFAULT_SIZE;
+unsigned int ICACHE_ASSOC = ICACHE_DEFAULT_ASSOC;
+
+/**
+ * Cycles added per instruction cache miss, or 0 to leave them out of the CPI.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * argument -imisspenalty.
+ */
+unsigned int IMISS_PENALTY = 0;
 
 /**
- * Array of number of instructions executed by op type.
+ * Prefix of the <prefix>.simpoints and <prefix>.weights files to write, or
+ * NULL to only print the simulation points.
  *
- * For instance, stat_optype_dyn[OP_ALU] should be the number of times an ALU
- * instruction was executed in the trace.
+ * Set by the command-line argument -simpointout.
+ */
+const char *SIMPOINT_OUT = NULL;
+
+/**
+ * The number of instructions to skip at the start of each trace.
  *
- * Updated by student code.
+ * Set by the command-line argument -skipinst.
  */
-extern uint64_t stat_optype_dyn[NUM_OP_TYPES];
+uint64_t SKIP_INST = 0;
 
-/** Total number of CPU cycles. Updated by student code. */
-extern uint64_t stat_num_cycle;
+/**
+ * The number of instructions to analyze after SKIP_INST, or 0 for the rest of
+ * the trace.
+ *
+ * Set by the command-line argument -maxinst.
+ */
+uint64_t MAX_INST = 0;
 
 /**
- * Total number of unique instructions executed.
+ * The number of traces to analyze at once, or 0 for one per CPU core.
  *
- * Instructions with the same address should only be counted once.
+ * Set by the command-line argument -threads.
+ */
+unsigned int NUM_THREADS = 0;
+
+/** Short names of the op types, for printing. */
+static const char *optype_names[NUM_OP_TYPES] = {"ALU", "LD", "ST", "CBR", "OTHER"};
+
+/**
+ * Number of trace records read_trace() pulls from the trace file at once.
  *
- * Updated by student code.
+ * 64K records of 16 bytes each make a 1 MB block, which amortizes the
+ * decompression call and the call into the analysis code over many records.
  */
-extern uint64_t stat_unique_pc;
+#define TRACE_BLOCK_RECS (64 * 1024)
+
+/** A trace named on the command line and everything measured about it. */
+typedef struct TraceJobStruct
+{
+    const char *filename;
+    TraceStats stats;
+    /** 0 once the trace has been analyzed, or -1 if it could not be. */
+    int status;
+    /** The number of threads a block trace is inflated on. */
+    unsigned int num_threads;
+} TraceJob;
 
-int read_trace(int fd);
-void print_stats();
+int parse_args(int argc, char *argv[], std::vector<char *> *trace_filenames);
+void analyze_traces(std::vector<TraceJob> &jobs);
+void analyze_trace_file(TraceJob *job);
+int read_trace(TraceFile *tf, TraceStats *ts);
+int read_trace_columns(TraceFile *tf, TraceStats *ts);
+bool validate_trace_block(const TraceRec *recs, size_t num_recs);
+bool validate_optypes(const uint8_t *optypes, size_t num_recs);
+std::string trace_name(const char *filename);
+void print_stats(const TraceStats &ts);
+void print_toppc_stats(const TraceStats &ts);
+void print_simpoint_stats(const TraceStats &ts);
+void print_reuse_stats(const TraceStats &ts);
+void print_icache_stats(const TraceStats &ts);
+void print_cfg_stats(const TraceStats &ts);
+void print_reuse_profile(const char *name, const ReuseProfiler &profile);
+void print_summary(const std::vector<TraceJob> &jobs);
+int write_simpoints(const char *prefix, const TraceStats &ts);
+void print_usage(char *program_name);
 
 int main(int argc, char *argv[])
 {
     int status;
 
-    if (argc != 2)
+    // Parse the command-line arguments.
+    std::vector<char *> trace_filenames;
+    status = parse_args(argc, argv, &trace_filenames);
+    if (status != 0)
     {
-        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
-        return 2;
+        return status;
     }
 
-    // Open the trace file using gunzip.
-    // Uses the traditional pipe/fork/exec method.
-    printf("Opening trace file with gunzip: %s\n", argv[1]);
+    // Analyze every trace. Each is decompressed in-process with zlib.
+    std::vector<TraceJob> jobs(trace_filenames.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        jobs[i].filename = trace_filenames[i];
+        jobs[i].status = -1;
+    }
+    analyze_traces(jobs);
 
-    int pipefd[2];
-    status = pipe(pipefd);
-    if (status != 0)
+    // Report on the traces in the order they were given.
+    status = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
     {
-        perror("Couldn't create pipe");
-        return 1;
+        printf("Opening trace file: %s\n", jobs[i].filename);
+        if (jobs[i].status != 0)
+        {
+            status = 1;
+            continue;
+        }
+
+        // Write the simulation points for the downstream simulators. With
+        // several traces, each gets its own files named after the trace.
+        if (SIMPOINT_INTERVAL > 0 && SIMPOINT_OUT != NULL)
+        {
+            std::string prefix = SIMPOINT_OUT;
+            if (jobs.size() > 1)
+            {
+                prefix += "." + trace_name(jobs[i].filename);
+            }
+            if (write_simpoints(prefix.c_str(), jobs[i].stats) != 0)
+            {
+                status = 1;
+                continue;
+            }
+        }
+
+        // Print statistics.
+        print_stats(jobs[i].stats);
     }
 
-    pid_t pid = fork();
-    if (pid == -1)
+    if (jobs.size() > 1)
     {
-        perror("Couldn't fork");
-        return 1;
+        print_summary(jobs);
     }
+    return status;
+}
 
-    if (pid == 0)
+int parse_args(int argc, char *argv[], std::vector<char *> *trace_filenames)
+{
+    trace_filenames->clear();
+
+    if (argc < 2)
     {
-        // Child process: exec gunzip.
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[0]);
-        close(pipefd[1]);
-        execlp("gunzip", "gunzip", "-c", argv[1], NULL);
-        perror("Couldn't exec gunzip");
-        fprintf(stderr, "Is gunzip installed?\n");
-        return 127;
+        print_usage(argv[0]);
+        return 2;
     }
 
-    // Parent process: read the trace file.
-    int trace_fd = pipefd[0];
-    close(pipefd[1]);
-    status = read_trace(trace_fd);
-    close(trace_fd);
-    if (status != 0)
+    for (int i = 1; i < argc; i++)
     {
-        return 1;
+        if (argv[i][0] == '-')
+        {
+            // Parse options.
+            if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+            {
+                print_usage(argv[0]);
+                return 2;
+            }
+            else if (strcmp(argv[i], "-approx-unique") == 0)
+            {
+                UNIQUE_PC_EXACT = false;
+                UNIQUE_PC_APPROX = true;
+            }
+            else if (strcmp(argv[i], "-validate-unique") == 0)
+            {
+                UNIQUE_PC_EXACT = true;
+                UNIQUE_PC_APPROX = true;
+            }
+            else if (strcmp(argv[i], "-hllprecision") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -hllprecision\n");
+                    return 2;
+                }
+
+                int precision = atoi(argv[i]);
+                if (precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION)
+                {
+                    fprintf(stderr, "Error: HyperLogLog precision must be between %d and %d\n",
+                            HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+                    return 2;
+                }
+
+                HLL_PRECISION = precision;
+            }
+            else if (strcmp(argv[i], "-toppc") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -toppc\n");
+                    return 2;
+                }
+
+                int k = atoi(argv[i]);
+                if (k < 1)
+                {
+                    fprintf(stderr, "Error: -toppc must be at least 1\n");
+                    return 2;
+                }
+
+                TOPPC_K = k;
+            }
+            else if (strcmp(argv[i], "-toppccounters") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -toppccounters\n");
+                    return 2;
+                }
+
+                int counters = atoi(argv[i]);
+                if (counters < 1 || counters > (1 << 24))
+                {
+                    fprintf(stderr, "Error: -toppccounters must be between 1 and %d\n", 1 << 24);
+                    return 2;
+                }
+
+                TOPPC_COUNTERS = counters;
+            }
+            else if (strcmp(argv[i], "-simpoint") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -simpoint\n");
+                    return 2;
+                }
+
+                long long interval = atoll(argv[i]);
+                if (interval < 1)
+                {
+                    fprintf(stderr, "Error: SimPoint interval must be at least 1\n");
+                    return 2;
+                }
+
+                SIMPOINT_INTERVAL = interval;
+            }
+            else if (strcmp(argv[i], "-simpointmaxk") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -simpointmaxk\n");
+                    return 2;
+                }
+
+                int max_k = atoi(argv[i]);
+                if (max_k < 1 || max_k > 100)
+                {
+                    fprintf(stderr, "Error: -simpointmaxk must be between 1 and 100\n");
+                    return 2;
+                }
+
+                SIMPOINT_MAX_K = max_k;
+            }
+            else if (strcmp(argv[i], "-reuse") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -reuse\n");
+                    return 2;
+                }
+
+                long long interval = atoll(argv[i]);
+                if (interval < 1)
+                {
+                    fprintf(stderr, "Error: working-set interval must be at least 1\n");
+                    return 2;
+                }
+
+                REUSE_INTERVAL = interval;
+            }
+            else if (strcmp(argv[i], "-cfg") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -cfg\n");
+                    return 2;
+                }
+
+                int k = atoi(argv[i]);
+                if (k < 1)
+                {
+                    fprintf(stderr, "Error: -cfg must be at least 1\n");
+                    return 2;
+                }
+
+                CFG_K = k;
+            }
+            else if (strcmp(argv[i], "-icachemrc") == 0)
+            {
+                ICACHE_MRC = true;
+            }
+            else if (strcmp(argv[i], "-icachesize") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -icachesize\n");
+                    return 2;
+                }
+
+                long long size = atoll(argv[i]);
+                ICACHE_SIZE = size > 0 ? size : 0;
+            }
+            else if (strcmp(argv[i], "-icacheassoc") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -icacheassoc\n");
+                    return 2;
+                }
+
+                int assoc = atoi(argv[i]);
+                ICACHE_ASSOC = assoc > 0 ? assoc : 0;
+            }
+            else if (strcmp(argv[i], "-imisspenalty") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -imisspenalty\n");
+                    return 2;
+                }
+
+                int penalty = atoi(argv[i]);
+                if (penalty < 0)
+                {
+                    fprintf(stderr, "Error: -imisspenalty must not be negative\n");
+                    return 2;
+                }
+
+                IMISS_PENALTY = penalty;
+            }
+            else if (strcmp(argv[i], "-skipinst") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -skipinst\n");
+                    return 2;
+                }
+
+                long long skip = atoll(argv[i]);
+                if (skip < 0)
+                {
+                    fprintf(stderr, "Error: -skipinst must not be negative\n");
+                    return 2;
+                }
+
+                SKIP_INST = skip;
+            }
+            else if (strcmp(argv[i], "-maxinst") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -maxinst\n");
+                    return 2;
+                }
+
+                long long max = atoll(argv[i]);
+                if (max < 1)
+                {
+                    fprintf(stderr, "Error: -maxinst must be at least 1\n");
+                    return 2;
+                }
+
+                MAX_INST = max;
+            }
+            else if (strcmp(argv[i], "-threads") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -threads\n");
+                    return 2;
+                }
+
+                int threads = atoi(argv[i]);
+                if (threads < 0)
+                {
+                    fprintf(stderr, "Error: -threads must not be negative\n");
+                    return 2;
+                }
+
+                NUM_THREADS = threads;
+            }
+            else if (strcmp(argv[i], "-opmixkernel") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -opmixkernel\n");
+                    return 2;
+                }
+
+                OpMixKernel kernel;
+                if (!opmix_parse_kernel(argv[i], &kernel))
+                {
+                    fprintf(stderr, "Error: unknown op-type kernel: %s\n", argv[i]);
+                    return 2;
+                }
+                if (!opmix_set_kernel(kernel))
+                {
+                    fprintf(stderr, "Error: this CPU does not support the %s kernel\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "-simpointout") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -simpointout\n");
+                    return 2;
+                }
+
+                SIMPOINT_OUT = argv[i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: unrecognized option: %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else
+        {
+            // Parse trace file names.
+            trace_filenames->push_back(argv[i]);
+        }
+    }
+
+    if (trace_filenames->empty())
+    {
+        fprintf(stderr, "Error: no trace file specified\n");
+        return 2;
+    }
+
+    if (TOPPC_COUNTERS < TOPPC_K)
+    {
+        TOPPC_COUNTERS = TOPPC_K;
     }
 
-    // Wait for the child process to finish.
-    waitpid(pid, &status, 0);
-    status = WEXITSTATUS(status);
-    if (status == 127)
+    if (!ICacheProfiler::supported(ICACHE_SIZE, ICACHE_ASSOC))
     {
-        return 1;
+        fprintf(stderr, "Error: the instruction cache must have a power-of-two number of sets, "
+                        "at most %d, and a power-of-two associativity, at most %d\n",
+                1 << ICACHE_MAX_SET_BITS, ICACHE_MAX_WAYS);
+        return 2;
     }
 
-    // Print statistics.
-    print_stats();
     return 0;
 }
 
-int read_trace(int fd)
+/**
+ * Analyzes every trace on a pool of NUM_THREADS threads.
+ *
+ * Each thread takes the next trace not yet taken until none are left. The
+ * largest files are handed out first, so that with fewer threads than traces
+ * the longest trace does not start last and leave the other threads idle.
+ *
+ * @param jobs the traces to analyze; the status and stats of each are set
+ */
+void analyze_traces(std::vector<TraceJob> &jobs)
 {
-    TraceRec trace_record;
-    while (true)
+    // Order the traces by file size, largest first.
+    std::vector<std::pair<off_t, size_t> > order;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        struct stat st;
+        off_t size = stat(jobs[i].filename, &st) == 0 ? st.st_size : 0;
+        order.push_back(std::make_pair(-size, i));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < order.size(); i = next++)
+        {
+            analyze_trace_file(&jobs[order[i].second]);
+        }
+    };
+
+    unsigned int num_threads = NUM_THREADS;
+    if (num_threads == 0)
+    {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Split the threads between the traces, so that block traces analyzed at
+    // once do not each start a decompression worker per core.
+    unsigned int share = std::max<size_t>(1, num_threads / jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        jobs[i].num_threads = share;
+    }
+    num_threads = std::min<size_t>(num_threads, jobs.size());
+
+    // The calling thread is one of the workers.
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < num_threads; t++)
+    {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); t++)
+    {
+        pool[t].join();
+    }
+}
+
+/**
+ * Reads and analyzes one trace file into its own statistics.
+ *
+ * @param job the trace to analyze
+ */
+void analyze_trace_file(TraceJob *job)
+{
+    TraceFile *tf = trace_open(job->filename, job->num_threads);
+    if (tf == NULL)
     {
-        ssize_t bytes_read = read(fd, &trace_record, sizeof(trace_record));
-        if (bytes_read == 0)
+        job->status = -1;
+    }
+    else
+    {
+        analyze_trace_init(&job->stats);
+        job->status = 0;
+        if (SKIP_INST > 0 && trace_skip(tf, SKIP_INST * sizeof(TraceRec)) == -1)
         {
-            return 0;
+            job->status = -1;
         }
-        if (bytes_read == -1)
+        if (job->status == 0)
         {
-            perror("Couldn't read from pipe");
+            job->status = read_trace(tf, &job->stats);
+        }
+        trace_close(tf);
+        analyze_trace_finish(&job->stats);
+    }
+
+    if (job->status != 0)
+    {
+        fprintf(stderr, "Error: couldn't analyze %s\n", job->filename);
+    }
+}
+
+int read_trace(TraceFile *tf, TraceStats *ts)
+{
+    if (trace_is_columnar(tf))
+    {
+        return read_trace_columns(tf, ts);
+    }
+
+    TraceRec *block = (TraceRec *)malloc(TRACE_BLOCK_RECS * sizeof(TraceRec));
+    if (block == NULL)
+    {
+        perror("Couldn't allocate trace buffer");
+        return -1;
+    }
+
+    bool eof = false;
+    while (!eof)
+    {
+        // Stop after MAX_INST records.
+        size_t block_recs = TRACE_BLOCK_RECS;
+        if (MAX_INST > 0 && MAX_INST - ts->num_inst < block_recs)
+        {
+            block_recs = MAX_INST - ts->num_inst;
+        }
+        size_t block_bytes = block_recs * sizeof(TraceRec);
+
+        // Decompress straight into the block. trace_read() only comes up
+        // short at the end of the trace.
+        ssize_t bytes_buffered = trace_read(tf, block, block_bytes);
+        if (bytes_buffered == -1)
+        {
+            free(block);
             return -1;
         }
-        if (bytes_read != sizeof(trace_record) || trace_record.optype >= NUM_OP_TYPES)
+        eof = ((size_t)bytes_buffered < block_bytes ||
+               (MAX_INST > 0 && ts->num_inst + block_recs == MAX_INST));
+
+        // The block is only ever short at the end of the trace, so a partial
+        // record here means the trace file is truncated.
+        size_t num_recs = bytes_buffered / sizeof(TraceRec);
+        if (bytes_buffered % sizeof(TraceRec) != 0 ||
+            !validate_trace_block(block, num_recs))
         {
             fprintf(stderr, "Error: Invalid trace file\n");
+            free(block);
             return -1;
         }
 
         // Update statistics.
-        stat_num_inst++;
-        analyze_trace_record(&trace_record);
+        ts->num_inst += num_recs;
+        analyze_trace_batch(ts, block, num_recs);
     }
+
+    free(block);
+    return 0;
 }
 
-void print_stats()
+/**
+ * Reads a columnar trace one block of records at a time, keeping the PCs and
+ * op types in separate arrays.
+ *
+ * @param tf the columnar trace file
+ * @param ts the statistics to analyze the trace into
+ * @return 0 on success, or -1 on error
+ */
+int read_trace_columns(TraceFile *tf, TraceStats *ts)
 {
+    uint64_t *pcs = (uint64_t *)malloc(TRACE_BLOCK_RECS * sizeof(uint64_t));
+    uint8_t *optypes = (uint8_t *)malloc(TRACE_BLOCK_RECS);
+    if (pcs == NULL || optypes == NULL)
+    {
+        perror("Couldn't allocate trace buffer");
+        free(pcs);
+        free(optypes);
+        return -1;
+    }
+
+    int status = 0;
+    while (true)
+    {
+        size_t block_recs = TRACE_BLOCK_RECS;
+        if (MAX_INST > 0 && MAX_INST - ts->num_inst < block_recs)
+        {
+            block_recs = MAX_INST - ts->num_inst;
+        }
+
+        ssize_t num_recs = trace_read_columns(tf, pcs, optypes, block_recs);
+        if (num_recs == -1)
+        {
+            status = -1;
+            break;
+        }
+        if (!validate_optypes(optypes, num_recs))
+        {
+            fprintf(stderr, "Error: Invalid trace file\n");
+            status = -1;
+            break;
+        }
+
+        // Update statistics.
+        ts->num_inst += num_recs;
+        analyze_trace_columns(ts, pcs, optypes, num_recs);
+
+        if ((size_t)num_recs < block_recs || (MAX_INST > 0 && ts->num_inst == MAX_INST))
+        {
+            break;
+        }
+    }
+
+    free(pcs);
+    free(optypes);
+    return status;
+}
+
+/**
+ * Checks that every record in a block has a valid op type.
+ *
+ * The check is a branch-free reduction over the whole block so that the
+ * compiler can vectorize it, instead of a compare-and-branch per record.
+ *
+ * @param recs the records to check
+ * @param num_recs the number of records in recs
+ * @return true if all records are valid, false otherwise
+ */
+bool validate_trace_block(const TraceRec *recs, size_t num_recs)
+{
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < num_recs; i++)
+    {
+        invalid |= (recs[i].optype >= NUM_OP_TYPES);
+    }
+    return invalid == 0;
+}
+
+/**
+ * Checks that every op type in a column is valid, like validate_trace_block().
+ *
+ * @param optypes the op types to check
+ * @param num_recs the number of op types
+ * @return true if all op types are valid, false otherwise
+ */
+bool validate_optypes(const uint8_t *optypes, size_t num_recs)
+{
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < num_recs; i++)
+    {
+        invalid |= (optypes[i] >= NUM_OP_TYPES);
+    }
+    return invalid == 0;
+}
+
+/**
+ * @param filename the path of a trace file
+ * @return the file name without its directory or extensions, e.g. "gcc" for
+ * "../traces/gcc.otr.gz"
+ */
+std::string trace_name(const char *filename)
+{
+    const char *base = strrchr(filename, '/');
+    base = base != NULL ? base + 1 : filename;
+    return std::string(base, strcspn(base, "."));
+}
+
+void print_stats(const TraceStats &ts)
+{
+    const uint64_t *stat_optype_dyn = ts.optype_dyn;
+    const AnalysisStats &stat_analysis = ts.analysis;
+    uint64_t stat_num_inst = ts.num_inst;
+    uint64_t stat_num_cycle = ts.num_cycle;
+    uint64_t stat_unique_pc = ts.unique_pc;
+
     if (stat_num_inst == 0)
     {
         fprintf(stderr, "Warning: No instructions found in trace file. "
@@ -150,6 +836,19 @@ void print_stats()
     printf("LAB1_CPI                \t : %6.3f\n", cpi);
     printf("LAB1_UNIQUE_PC          \t : %10lu\n", stat_unique_pc);
 
+    if (UNIQUE_PC_APPROX)
+    {
+        printf("LAB1_UNIQUE_PC_APPROX   \t : %10lu\n", stat_analysis.unique_pc_approx);
+        printf("LAB1_HLL_PRECISION      \t : %10u\n", HLL_PRECISION);
+        printf("LAB1_HLL_STD_ERROR      \t : %6.3f\n", 100.0 * stat_analysis.unique_pc_std_error);
+        if (UNIQUE_PC_EXACT && stat_unique_pc > 0)
+        {
+            double actual_error = ((double)stat_analysis.unique_pc_approx - (double)stat_unique_pc) /
+                                  (double)stat_unique_pc;
+            printf("LAB1_HLL_ACTUAL_ERROR   \t : %6.3f\n", 100.0 * actual_error);
+        }
+    }
+
     printf("\n");
 
     printf("LAB1_NUM_ALU_OP         \t : %10lu\n", stat_optype_dyn[OP_ALU]);
@@ -165,4 +864,438 @@ void print_stats()
     printf("LAB1_PERC_ST_OP         \t : %6.3f\n", 100.0 * (double)(stat_optype_dyn[OP_ST]) / (double)(stat_num_inst));
     printf("LAB1_PERC_CBR_OP        \t : %6.3f\n", 100.0 * (double)(stat_optype_dyn[OP_CBR]) / (double)(stat_num_inst));
     printf("LAB1_PERC_OTHER_OP      \t : %6.3f\n\n", 100.0 * (double)(stat_optype_dyn[OP_OTHER]) / (double)(stat_num_inst));
+
+    if (TOPPC_K > 0)
+    {
+        print_toppc_stats(ts);
+    }
+
+    if (SIMPOINT_INTERVAL > 0)
+    {
+        print_simpoint_stats(ts);
+    }
+
+    if (REUSE_INTERVAL > 0)
+    {
+        print_reuse_stats(ts);
+    }
+
+    if (ICACHE_MRC || IMISS_PENALTY > 0)
+    {
+        print_icache_stats(ts);
+    }
+
+    if (CFG_K > 0)
+    {
+        print_cfg_stats(ts);
+    }
+}
+
+void print_toppc_stats(const TraceStats &ts)
+{
+    const SpaceSaving &top_pc = ts.analysis.top_pc;
+    std::vector<TopPc> top = top_pc.top(TOPPC_K);
+    double num_inst = ts.num_inst > 0 ? (double)ts.num_inst : 1.0;
+
+    printf("LAB1_TOPPC_COUNTERS     \t : %10lu\n", (unsigned long)top_pc.num_counters());
+    printf("LAB1_TOPPC_MAX_ERROR    \t : %10lu\n", (unsigned long)top_pc.max_error());
+
+    printf("\n");
+
+    // Each estimate is printed with its error bound: the true count lies in
+    // [count - error, count].
+    uint64_t covered[NUM_OP_TYPES] = {0};
+    uint64_t covered_total = 0;
+    for (size_t i = 0; i < top.size(); i++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "LAB1_TOPPC_%lu", (unsigned long)(i + 1));
+        printf("%-24s\t : %#18lx %-5s %10lu  +0/-%lu  %6.3f\n", label,
+               (unsigned long)top[i].pc, optype_names[top[i].optype],
+               (unsigned long)top[i].count, (unsigned long)top[i].error,
+               100.0 * (double)top[i].count / num_inst);
+
+        // Use the guaranteed lower bounds so the coverage is never overstated.
+        covered[top[i].optype] += top[i].count - top[i].error;
+        covered_total += top[i].count - top[i].error;
+    }
+
+    printf("\n");
+
+    printf("LAB1_TOPPC_PERC_COVERED \t : %6.3f\n", 100.0 * (double)covered_total / num_inst);
+    for (int op = 0; op < NUM_OP_TYPES; op++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "LAB1_TOPPC_PERC_%s_OP", optype_names[op]);
+        printf("%-24s\t : %6.3f\n", label,
+               covered_total > 0 ? 100.0 * (double)covered[op] / (double)covered_total : 0.0);
+    }
+
+    printf("\n");
+}
+
+void print_simpoint_stats(const TraceStats &ts)
+{
+    const SimPointProfiler &simpoint = ts.analysis.simpoint;
+    const std::vector<SimPoint> &simpoints = simpoint.get_simpoints();
+
+    printf("LAB1_SIMPOINT_INTERVAL  \t : %10lu\n", (unsigned long)simpoint.get_interval_size());
+    printf("LAB1_SIMPOINT_INTERVALS \t : %10lu\n", (unsigned long)simpoint.num_intervals());
+    printf("LAB1_SIMPOINT_K         \t : %10u\n", simpoint.num_clusters());
+    printf("LAB1_SIMPOINT_BIC       \t : %10.3f\n", simpoint.get_bic());
+
+    // The fraction of the trace a downstream simulator has to run.
+    double simulated = simpoint.num_intervals() > 0
+                           ? (double)simpoints.size() / (double)simpoint.num_intervals()
+                           : 0.0;
+    printf("LAB1_SIMPOINT_PERC_SIM  \t : %6.3f\n", 100.0 * simulated);
+
+    printf("\n");
+
+    for (size_t i = 0; i < simpoints.size(); i++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "LAB1_SIMPOINT_%u", simpoints[i].cluster);
+        printf("%-24s\t : %10lu  %6.4f\n", label, (unsigned long)simpoints[i].interval,
+               simpoints[i].weight);
+    }
+
+    printf("\n");
+}
+
+void print_reuse_stats(const TraceStats &ts)
+{
+    const ReuseProfiler &lines = ts.analysis.line_reuse;
+    const ReuseProfiler &pages = ts.analysis.page_reuse;
+
+    printf("LAB1_REUSE_LINE_SIZE    \t : %10lu\n", 1UL << lines.get_block_bits());
+    printf("LAB1_REUSE_PAGE_SIZE    \t : %10lu\n", 1UL << pages.get_block_bits());
+    printf("LAB1_REUSE_LINES        \t : %10lu\n", (unsigned long)lines.get_num_blocks());
+    printf("LAB1_REUSE_PAGES        \t : %10lu\n", (unsigned long)pages.get_num_blocks());
+
+    printf("\n");
+
+    print_reuse_profile("LINE", lines);
+    print_reuse_profile("PAGE", pages);
+
+    // The working set of each interval, in lines and pages touched.
+    printf("LAB1_FOOTPRINT_INTERVAL \t : %10lu\n", (unsigned long)REUSE_INTERVAL);
+    const std::vector<uint64_t> &line_fp = lines.get_footprints();
+    const std::vector<uint64_t> &page_fp = pages.get_footprints();
+    for (size_t i = 0; i < line_fp.size(); i++)
+    {
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_FOOTPRINT_%lu", (unsigned long)i);
+        printf("%-24s\t : %10lu %10lu\n", label, (unsigned long)line_fp[i],
+               (unsigned long)page_fp[i]);
+    }
+
+    printf("\n");
+}
+
+void print_icache_stats(const TraceStats &ts)
+{
+    const ICacheProfiler &icache = ts.analysis.icache;
+    double accesses = icache.get_num_accesses() > 0 ? (double)icache.get_num_accesses() : 1.0;
+    uint64_t misses = icache.misses_for_size(ICACHE_SIZE, ICACHE_ASSOC);
+
+    printf("LAB1_ICACHE_SIZE        \t : %10lu\n", (unsigned long)ICACHE_SIZE);
+    printf("LAB1_ICACHE_ASSOC       \t : %10u\n", ICACHE_ASSOC);
+    printf("LAB1_ICACHE_LINE_SIZE   \t : %10d\n", 1 << ICACHE_LINE_BITS);
+    printf("LAB1_ICACHE_MISSES      \t : %10lu\n", (unsigned long)misses);
+    printf("LAB1_ICACHE_MISS_RATE   \t : %6.3f\n", 100.0 * (double)misses / accesses);
+    printf("LAB1_IMISS_PENALTY      \t : %10u\n", IMISS_PENALTY);
+    printf("LAB1_IMISS_CYCLES       \t : %10lu\n", (unsigned long)(IMISS_PENALTY * misses));
+
+    printf("\n");
+
+    if (!ICACHE_MRC)
+    {
+        return;
+    }
+
+    // One line per size and associativity: misses and miss rate.
+    for (unsigned int ways = 1; ways <= ICACHE_MAX_WAYS; ways *= 2)
+    {
+        for (uint64_t size = ICACHE_MIN_REPORT_SIZE; size <= ICACHE_MAX_REPORT_SIZE; size *= 2)
+        {
+            if (!ICacheProfiler::supported(size, ways))
+            {
+                continue;
+            }
+
+            uint64_t size_misses = icache.misses_for_size(size, ways);
+            char label[48];
+            snprintf(label, sizeof(label), "LAB1_ICACHE_%luK_%uWAY", (unsigned long)(size / 1024), ways);
+            printf("%-24s\t : %10lu  %6.3f\n", label, (unsigned long)size_misses,
+                   100.0 * (double)size_misses / accesses);
+        }
+        printf("\n");
+    }
+}
+
+void print_cfg_stats(const TraceStats &ts)
+{
+    const CfgProfiler &cfg = ts.analysis.cfg;
+    uint64_t biased_execs;
+    size_t biased = cfg.num_biased_branches(&biased_execs);
+    double branch_execs = cfg.get_branch_execs() > 0 ? (double)cfg.get_branch_execs() : 1.0;
+
+    printf("LAB1_CFG_BLOCKS         \t : %10lu\n", (unsigned long)cfg.num_blocks());
+    printf("LAB1_CFG_EDGES          \t : %10lu\n", (unsigned long)cfg.num_edges());
+    printf("LAB1_CFG_TRANSFERS      \t : %10lu\n", (unsigned long)cfg.get_num_transfers());
+    printf("LAB1_CFG_BRANCHES       \t : %10lu\n", (unsigned long)cfg.num_branches());
+    printf("LAB1_CFG_PERC_TAKEN     \t : %6.3f\n",
+           100.0 * (double)cfg.get_branch_taken() / branch_execs);
+    printf("LAB1_CFG_BIASED_BRANCHES\t : %10lu\n", (unsigned long)biased);
+    printf("LAB1_CFG_PERC_BIASED    \t : %6.3f\n", 100.0 * (double)biased_execs / branch_execs);
+    printf("LAB1_CFG_LOOPS          \t : %10lu\n", (unsigned long)cfg.num_loops());
+
+    printf("\n");
+
+    // The hottest edges: source, destination, and count.
+    std::vector<CfgEdge> edges = cfg.top_edges(CFG_K);
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_CFG_EDGE_%lu", (unsigned long)(i + 1));
+        printf("%-24s\t : %#18lx -> %#18lx %10lu\n", label, (unsigned long)edges[i].src,
+               (unsigned long)edges[i].dst, (unsigned long)edges[i].count);
+    }
+
+    printf("\n");
+
+    // The hottest conditional branches: address, executions, and taken rate.
+    std::vector<CfgBranch> branches = cfg.top_branches(CFG_K);
+    for (size_t i = 0; i < branches.size(); i++)
+    {
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_BRANCH_%lu", (unsigned long)(i + 1));
+        printf("%-24s\t : %#18lx %10lu  %6.3f\n", label, (unsigned long)branches[i].pc,
+               (unsigned long)branches[i].execs,
+               100.0 * (double)branches[i].taken / (double)branches[i].execs);
+    }
+
+    printf("\n");
+
+    // The loops with the most iterations: head, closing branch, visits,
+    // iterations, and mean trip count, then the trip-count distribution.
+    std::vector<CfgLoop> loops = cfg.top_loops(CFG_K);
+    for (size_t i = 0; i < loops.size(); i++)
+    {
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_LOOP_%lu", (unsigned long)(i + 1));
+        printf("%-24s\t : %#18lx %#18lx %10lu %10lu %10.2f\n", label,
+               (unsigned long)loops[i].head, (unsigned long)loops[i].tail,
+               (unsigned long)loops[i].visits, (unsigned long)loops[i].iterations,
+               loops[i].visits > 0 ? (double)loops[i].iterations / (double)loops[i].visits : 0.0);
+
+        for (int b = 0; b < CFG_TRIP_BUCKETS; b++)
+        {
+            if (loops[i].trips[b] == 0)
+            {
+                continue;
+            }
+            // Bucket b holds the trip counts in [2^b, 2^(b+1)).
+            snprintf(label, sizeof(label), "LAB1_LOOP_%lu_TRIPS_%lu", (unsigned long)(i + 1),
+                     1UL << b);
+            printf("%-24s\t : %10lu  %6.3f\n", label, (unsigned long)loops[i].trips[b],
+                   100.0 * (double)loops[i].trips[b] / (double)loops[i].visits);
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * Print the reuse-distance histogram and the miss-ratio curve of one profile.
+ *
+ * The miss-ratio curve is for fully associative LRU caches of every
+ * power-of-two number of blocks, up to the first size that only takes cold
+ * misses.
+ *
+ * @param name LINE or PAGE
+ * @param profile the profile to print
+ */
+void print_reuse_profile(const char *name, const ReuseProfiler &profile)
+{
+    const uint64_t *histogram = profile.get_histogram();
+    double accesses = profile.get_num_accesses() > 0 ? (double)profile.get_num_accesses() : 1.0;
+
+    // Bucket b holds the distances in [2^(b-1), 2^b); it is labelled with the
+    // smallest of them.
+    int last_bucket = REUSE_NUM_BUCKETS - 1;
+    while (last_bucket > 0 && histogram[last_bucket] == 0)
+    {
+        last_bucket--;
+    }
+    for (int b = 0; b <= last_bucket; b++)
+    {
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_REUSE_%s_DIST_%lu", name,
+                 b == 0 ? 0UL : 1UL << (b - 1));
+        printf("%-24s\t : %10lu  %6.3f\n", label, (unsigned long)histogram[b],
+               100.0 * (double)histogram[b] / accesses);
+    }
+    char cold_label[48];
+    snprintf(cold_label, sizeof(cold_label), "LAB1_REUSE_%s_COLD", name);
+    printf("%-24s\t : %10lu  %6.3f\n", cold_label, (unsigned long)profile.get_cold_misses(),
+           100.0 * (double)profile.get_cold_misses() / accesses);
+
+    printf("\n");
+
+    // Label each cache size with its capacity in bytes.
+    for (uint64_t capacity = 1;; capacity *= 2)
+    {
+        uint64_t misses = profile.misses(capacity);
+        char label[32];
+        snprintf(label, sizeof(label), "LAB1_MRC_%s_%lu", name,
+                 (unsigned long)(capacity << profile.get_block_bits()));
+        printf("%-24s\t : %10lu  %6.3f\n", label, (unsigned long)misses,
+               100.0 * (double)misses / accesses);
+        if (misses == profile.get_cold_misses())
+        {
+            break;
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * Write the simulation points in the SimPoint file format: <prefix>.simpoints
+ * holds "<interval> <cluster>" lines and <prefix>.weights holds
+ * "<weight> <cluster>" lines.
+ *
+ * @param prefix the path prefix of the two files
+ * @param ts the trace whose simulation points to write
+ * @return 0 on success, or -1 on error
+ */
+int write_simpoints(const char *prefix, const TraceStats &ts)
+{
+    const std::vector<SimPoint> &simpoints = ts.analysis.simpoint.get_simpoints();
+    const char *suffixes[2] = {".simpoints", ".weights"};
+
+    for (int f = 0; f < 2; f++)
+    {
+        std::vector<char> filename(strlen(prefix) + strlen(suffixes[f]) + 1);
+        snprintf(filename.data(), filename.size(), "%s%s", prefix, suffixes[f]);
+
+        FILE *file = fopen(filename.data(), "w");
+        if (file == NULL)
+        {
+            perror("Couldn't create SimPoint file");
+            return -1;
+        }
+
+        for (size_t i = 0; i < simpoints.size(); i++)
+        {
+            if (f == 0)
+            {
+                fprintf(file, "%lu %u\n", (unsigned long)simpoints[i].interval, simpoints[i].cluster);
+            }
+            else
+            {
+                fprintf(file, "%.6f %u\n", simpoints[i].weight, simpoints[i].cluster);
+            }
+        }
+
+        if (fclose(file) != 0)
+        {
+            perror("Couldn't write SimPoint file");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Print one line per trace analyzed, then the totals over all of them.
+ *
+ * @param jobs the traces, in the order they were given
+ */
+void print_summary(const std::vector<TraceJob> &jobs)
+{
+    uint64_t total_inst = 0;
+    uint64_t total_cycle = 0;
+    size_t num_analyzed = 0;
+
+    printf("LAB1_NUM_TRACES         \t : %10lu\n", (unsigned long)jobs.size());
+
+    printf("\n");
+
+    // Instructions, CPI, and unique PCs of each trace.
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const TraceStats &ts = jobs[i].stats;
+        if (jobs[i].status != 0)
+        {
+            continue;
+        }
+
+        char label[48];
+        snprintf(label, sizeof(label), "LAB1_TRACE_%s", trace_name(jobs[i].filename).c_str());
+        printf("%-24s\t : %10lu  %6.3f  %10lu\n", label, (unsigned long)ts.num_inst,
+               ts.num_inst > 0 ? (double)ts.num_cycle / (double)ts.num_inst : 0.0,
+               (unsigned long)ts.unique_pc);
+
+        total_inst += ts.num_inst;
+        total_cycle += ts.num_cycle;
+        num_analyzed++;
+    }
+
+    printf("\n");
+
+    printf("LAB1_TRACES_ANALYZED    \t : %10lu\n", (unsigned long)num_analyzed);
+    printf("LAB1_TOTAL_NUM_INST     \t : %10lu\n", (unsigned long)total_inst);
+    printf("LAB1_TOTAL_NUM_CYCLES   \t : %10lu\n", (unsigned long)total_cycle);
+    printf("LAB1_TOTAL_CPI          \t : %6.3f\n",
+           total_inst > 0 ? (double)total_cycle / (double)total_inst : 0.0);
+
+    printf("\n");
+}
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] <trace file> [<trace file> ...]\n\n", program_name);
+    fprintf(stderr, "Trace analyzer\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -threads <n>        Analyze <n> traces at once (Default: one per core)\n");
+    fprintf(stderr, "    -skipinst <n>       Skip the first <n> instructions of each trace, from\n");
+    fprintf(stderr, "                        the nearest access point in <trace>.gzi if there is one\n");
+    fprintf(stderr, "    -maxinst <n>        Analyze at most <n> instructions of each trace\n");
+    fprintf(stderr, "    -approx-unique      Estimate unique PCs with a HyperLogLog sketch instead\n");
+    fprintf(stderr, "                        of counting them exactly\n");
+    fprintf(stderr, "    -validate-unique    Count unique PCs both exactly and with the sketch,\n");
+    fprintf(stderr, "                        and report the sketch's actual error\n");
+    fprintf(stderr, "    -hllprecision <p>   Use 2^<p> sketch registers, between %d and %d\n",
+            HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+    fprintf(stderr, "                        (Default: %d)\n", HLL_DEFAULT_PRECISION);
+    fprintf(stderr, "    -toppc <k>          Report the <k> most executed PCs and their op types\n");
+    fprintf(stderr, "    -toppccounters <n>  Track at most <n> PCs for -toppc; counts are within\n");
+    fprintf(stderr, "                        (instructions / <n>) of the truth (Default: %d)\n",
+            TOPK_DEFAULT_COUNTERS);
+    fprintf(stderr, "    -simpoint <n>       Profile basic-block vectors over intervals of <n>\n");
+    fprintf(stderr, "                        instructions and pick simulation points\n");
+    fprintf(stderr, "    -simpointmaxk <k>   Try at most <k> clusters (Default: %d)\n",
+            SIMPOINT_DEFAULT_MAX_K);
+    fprintf(stderr, "    -simpointout <path> Write <path>.simpoints and <path>.weights, or\n");
+    fprintf(stderr, "                        <path>.<trace>.* for each of several traces\n");
+    fprintf(stderr, "    -reuse <n>          Report reuse distances, miss-ratio curves, and the\n");
+    fprintf(stderr, "                        working set per <n> instructions, by cache line and page\n");
+    fprintf(stderr, "    -cfg <k>            Rebuild the control-flow graph and report the <k>\n");
+    fprintf(stderr, "                        hottest edges, branches with taken rates, and loops\n");
+    fprintf(stderr, "                        with trip counts\n");
+    fprintf(stderr, "    -icachemrc          Report the miss rate of every power-of-two LRU\n");
+    fprintf(stderr, "                        instruction cache from %dKB to %dKB, up to %d ways\n",
+            ICACHE_MIN_REPORT_SIZE / 1024, ICACHE_MAX_REPORT_SIZE / 1024, ICACHE_MAX_WAYS);
+    fprintf(stderr, "    -imisspenalty <c>   Add <c> cycles per instruction cache miss to the\n");
+    fprintf(stderr, "                        CPI model (Default: 0)\n");
+    fprintf(stderr, "    -icachesize <bytes> Size of the cache charged by -imisspenalty (Default: %d)\n",
+            ICACHE_DEFAULT_SIZE);
+    fprintf(stderr, "    -icacheassoc <n>    Associativity of that cache (Default: %d)\n",
+            ICACHE_DEFAULT_ASSOC);
+    fprintf(stderr, "    -opmixkernel <k>    Count op types with the scalar, avx2, or avx512\n");
+    fprintf(stderr, "                        kernel (Default: the fastest the CPU supports)\n");
 }
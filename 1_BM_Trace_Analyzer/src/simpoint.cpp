@@ -0,0 +1,279 @@
+// simpoint.cpp
+// Implements SimPoint-style interval profiling and simulation point
+// selection.
+
+#include "simpoint.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/** Largest number of Lloyd iterations per k-means run. */
+#define SIMPOINT_MAX_ITERATIONS 100
+
+SimPointProfiler::SimPointProfiler(uint64_t interval_size)
+    : interval_size(interval_size), block_start(0), block_len(0), last_pc(0),
+      interval_insts(0), chosen_k(0), chosen_bic(0.0)
+{
+    memset(current, 0, sizeof(current));
+}
+
+void SimPointProfiler::end_interval()
+{
+    if (block_len > 0)
+    {
+        end_block();
+    }
+
+    // Normalize by the interval length so that a short final interval is
+    // comparable to the others.
+    for (int d = 0; d < SIMPOINT_DIMS; d++)
+    {
+        intervals.push_back(current[d] / (double)interval_insts);
+    }
+
+    memset(current, 0, sizeof(current));
+    interval_insts = 0;
+}
+
+/** Squared Euclidean distance between two projected BBVs. */
+static double distance2(const double *a, const double *b)
+{
+    double sum = 0.0;
+    for (int d = 0; d < SIMPOINT_DIMS; d++)
+    {
+        double diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/** A small deterministic PRNG (splitmix64), so runs are reproducible. */
+static uint64_t next_random(uint64_t *state)
+{
+    *state += 0x9e3779b97f4a7c15ULL;
+    return hash_u64(*state);
+}
+
+double SimPointProfiler::kmeans(unsigned int k, uint64_t seed,
+                                std::vector<double> *centroids,
+                                std::vector<unsigned int> *assignment) const
+{
+    size_t n = num_intervals();
+    const double *points = intervals.data();
+    centroids->assign((size_t)k * SIMPOINT_DIMS, 0.0);
+    assignment->assign(n, 0);
+
+    // k-means++ seeding: pick each new centroid with probability proportional
+    // to its squared distance from the nearest centroid chosen so far.
+    uint64_t rng = seed;
+    std::vector<double> nearest(n, DBL_MAX);
+    size_t first = next_random(&rng) % n;
+    memcpy(&(*centroids)[0], points + first * SIMPOINT_DIMS, sizeof(double) * SIMPOINT_DIMS);
+    for (unsigned int c = 1; c < k; c++)
+    {
+        double total = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            double dist = distance2(points + i * SIMPOINT_DIMS, &(*centroids)[(c - 1) * SIMPOINT_DIMS]);
+            if (dist < nearest[i])
+            {
+                nearest[i] = dist;
+            }
+            total += nearest[i];
+        }
+
+        size_t pick = next_random(&rng) % n;
+        if (total > 0.0)
+        {
+            double target = (double)(next_random(&rng) >> 11) / 9007199254740992.0 * total;
+            for (pick = 0; pick + 1 < n && target >= nearest[pick]; pick++)
+            {
+                target -= nearest[pick];
+            }
+        }
+        memcpy(&(*centroids)[c * SIMPOINT_DIMS], points + pick * SIMPOINT_DIMS,
+               sizeof(double) * SIMPOINT_DIMS);
+    }
+
+    // Lloyd iterations.
+    double distortion = 0.0;
+    std::vector<double> sums((size_t)k * SIMPOINT_DIMS);
+    std::vector<size_t> sizes(k);
+    for (int iter = 0; iter < SIMPOINT_MAX_ITERATIONS; iter++)
+    {
+        bool changed = (iter == 0);
+        distortion = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned int best = 0;
+            double best_dist = DBL_MAX;
+            for (unsigned int c = 0; c < k; c++)
+            {
+                double dist = distance2(points + i * SIMPOINT_DIMS, &(*centroids)[c * SIMPOINT_DIMS]);
+                if (dist < best_dist)
+                {
+                    best = c;
+                    best_dist = dist;
+                }
+            }
+            changed |= ((*assignment)[i] != best);
+            (*assignment)[i] = best;
+            distortion += best_dist;
+        }
+        if (!changed)
+        {
+            break;
+        }
+
+        sums.assign(sums.size(), 0.0);
+        sizes.assign(k, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned int c = (*assignment)[i];
+            sizes[c]++;
+            for (int d = 0; d < SIMPOINT_DIMS; d++)
+            {
+                sums[c * SIMPOINT_DIMS + d] += points[i * SIMPOINT_DIMS + d];
+            }
+        }
+        for (unsigned int c = 0; c < k; c++)
+        {
+            // An empty cluster keeps its old centroid.
+            for (int d = 0; sizes[c] > 0 && d < SIMPOINT_DIMS; d++)
+            {
+                (*centroids)[c * SIMPOINT_DIMS + d] = sums[c * SIMPOINT_DIMS + d] / (double)sizes[c];
+            }
+        }
+    }
+
+    return distortion;
+}
+
+double SimPointProfiler::bic(unsigned int k, double distortion,
+                             const std::vector<unsigned int> &assignment) const
+{
+    // The BIC formulation of Pelleg and Moore (X-means), which SimPoint uses:
+    // spherical Gaussians with one pooled variance.
+    double r = (double)num_intervals();
+    double m = (double)SIMPOINT_DIMS;
+    double variance = (r > k) ? distortion / (r - k) : 0.0;
+    if (variance < 1e-12)
+    {
+        variance = 1e-12;
+    }
+
+    std::vector<size_t> sizes(k, 0);
+    for (size_t i = 0; i < assignment.size(); i++)
+    {
+        sizes[assignment[i]]++;
+    }
+
+    double likelihood = 0.0;
+    for (unsigned int c = 0; c < k; c++)
+    {
+        double rn = (double)sizes[c];
+        if (rn == 0.0)
+        {
+            continue;
+        }
+        likelihood += -rn / 2.0 * log(2.0 * M_PI) - rn * m / 2.0 * log(variance) -
+                      (rn - k) / 2.0 + rn * log(rn) - rn * log(r);
+    }
+
+    double params = (k - 1) + m * k + 1;
+    return likelihood - params / 2.0 * log(r);
+}
+
+void SimPointProfiler::finish(unsigned int max_k)
+{
+    if (interval_insts > 0)
+    {
+        end_interval();
+    }
+
+    size_t n = num_intervals();
+    simpoints.clear();
+    if (n == 0)
+    {
+        return;
+    }
+    // At k == n every interval is its own cluster, the pooled variance is 0,
+    // and the BIC is meaningless, so leave at least one cluster with two
+    // intervals when there is more than one.
+    if (max_k > n - 1)
+    {
+        max_k = n > 1 ? n - 1 : 1;
+    }
+
+    // Cluster for every k, keeping the best of several seeds for each.
+    std::vector<std::vector<double> > best_centroids(max_k + 1);
+    std::vector<std::vector<unsigned int> > best_assignment(max_k + 1);
+    std::vector<double> scores(max_k + 1);
+    for (unsigned int k = 1; k <= max_k; k++)
+    {
+        double best_distortion = DBL_MAX;
+        for (uint64_t seed = 0; seed < SIMPOINT_NUM_SEEDS; seed++)
+        {
+            std::vector<double> centroids;
+            std::vector<unsigned int> assignment;
+            double distortion = kmeans(k, seed * 1000003 + k, &centroids, &assignment);
+            if (distortion < best_distortion)
+            {
+                best_distortion = distortion;
+                best_centroids[k].swap(centroids);
+                best_assignment[k].swap(assignment);
+            }
+        }
+        scores[k] = bic(k, best_distortion, best_assignment[k]);
+    }
+
+    // Pick the smallest k that reaches 90% of the range of BIC scores.
+    double min_score = scores[1], max_score = scores[1];
+    for (unsigned int k = 2; k <= max_k; k++)
+    {
+        min_score = scores[k] < min_score ? scores[k] : min_score;
+        max_score = scores[k] > max_score ? scores[k] : max_score;
+    }
+    chosen_k = max_k;
+    for (unsigned int k = 1; k <= max_k; k++)
+    {
+        if (scores[k] >= min_score + 0.9 * (max_score - min_score))
+        {
+            chosen_k = k;
+            break;
+        }
+    }
+    chosen_bic = scores[chosen_k];
+
+    // Represent each non-empty cluster by the interval nearest its centroid.
+    const std::vector<double> &centroids = best_centroids[chosen_k];
+    const std::vector<unsigned int> &assignment = best_assignment[chosen_k];
+    std::vector<size_t> sizes(chosen_k, 0);
+    std::vector<size_t> nearest(chosen_k, 0);
+    std::vector<double> nearest_dist(chosen_k, DBL_MAX);
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned int c = assignment[i];
+        double dist = distance2(&intervals[i * SIMPOINT_DIMS], &centroids[c * SIMPOINT_DIMS]);
+        sizes[c]++;
+        if (dist < nearest_dist[c])
+        {
+            nearest[c] = i;
+            nearest_dist[c] = dist;
+        }
+    }
+
+    // Number the clusters in the order of their representatives.
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned int c = assignment[i];
+        if (sizes[c] > 0 && nearest[c] == i)
+        {
+            SimPoint sp;
+            sp.interval = i;
+            sp.cluster = simpoints.size();
+            sp.weight = (double)sizes[c] / (double)n;
+            simpoints.push_back(sp);
+        }
+    }
+}
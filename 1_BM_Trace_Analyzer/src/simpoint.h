@@ -0,0 +1,186 @@
+// simpoint.h
+// Declares a SimPoint-style profiler that splits the trace into fixed-size
+// intervals, summarizes each one by its basic-block vector, and picks a few
+// representative intervals by clustering those vectors.
+
+#ifndef _SIMPOINT_H_
+#define _SIMPOINT_H_
+
+#include "hash.h"
+#include "trace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Number of dimensions basic-block vectors are randomly projected to. */
+#define SIMPOINT_DIMS 15
+/** Default number of instructions per interval. */
+#define SIMPOINT_DEFAULT_INTERVAL 100000
+/** Default largest number of clusters tried. */
+#define SIMPOINT_DEFAULT_MAX_K 10
+/** Number of random k-means initializations tried for each k. */
+#define SIMPOINT_NUM_SEEDS 5
+/** Largest PC step that still counts as falling through to the next insn. */
+#define SIMPOINT_MAX_FALLTHROUGH 16
+
+/** One representative interval chosen by the profiler. */
+typedef struct SimPointStruct
+{
+    /** Index of the interval, counting from 0. */
+    uint64_t interval;
+    /** The cluster this interval represents. */
+    unsigned int cluster;
+    /** Fraction of all intervals in the cluster. */
+    double weight;
+} SimPoint;
+
+/**
+ * Collects basic-block vectors (BBVs) and selects simulation points.
+ *
+ * Basic blocks are recovered from the PC stream: a block ends at a
+ * conditional branch or wherever the next PC is not a short forward step
+ * from the current one (a taken jump, call, or return). A block is identified
+ * by its first PC.
+ *
+ * Rather than storing the full, sparse BBV of each interval, every block is
+ * mapped to a fixed random vector in SIMPOINT_DIMS dimensions (derived from a
+ * hash of its PC, so no projection matrix is stored), and each interval keeps
+ * only the instruction-weighted sum of those vectors. This is the same random
+ * linear projection SimPoint applies before clustering.
+ */
+class SimPointProfiler
+{
+public:
+    /**
+     * Construct a profiler.
+     *
+     * @param interval_size the number of instructions per interval
+     */
+    explicit SimPointProfiler(uint64_t interval_size = SIMPOINT_DEFAULT_INTERVAL);
+
+    /**
+     * Account for one instruction.
+     *
+     * @param pc the address of the instruction
+     * @param optype the op type of the instruction
+     */
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        if (block_len > 0 && (pc <= last_pc || pc - last_pc > SIMPOINT_MAX_FALLTHROUGH))
+        {
+            end_block();
+        }
+        if (block_len == 0)
+        {
+            block_start = pc;
+        }
+        block_len++;
+        last_pc = pc;
+
+        if (optype == OP_CBR)
+        {
+            end_block();
+        }
+        if (++interval_insts == interval_size)
+        {
+            end_interval();
+        }
+    }
+
+    /**
+     * Close the last interval and pick simulation points.
+     *
+     * Runs k-means for k = 1 .. max_k on the projected BBVs, scores each
+     * clustering with the Bayesian Information Criterion, and picks the
+     * smallest k whose score reaches 90% of the range of scores, as SimPoint
+     * does. Each cluster is represented by the interval closest to its
+     * centroid.
+     *
+     * @param max_k the largest number of clusters to try
+     */
+    void finish(unsigned int max_k);
+
+    /** @return the chosen simulation points, ordered by interval */
+    const std::vector<SimPoint> &get_simpoints() const
+    {
+        return simpoints;
+    }
+
+    /** @return the number of intervals profiled */
+    size_t num_intervals() const
+    {
+        return intervals.size() / SIMPOINT_DIMS;
+    }
+
+    /** @return the number of clusters chosen */
+    unsigned int num_clusters() const
+    {
+        return chosen_k;
+    }
+
+    /** @return the BIC score of the chosen clustering */
+    double get_bic() const
+    {
+        return chosen_bic;
+    }
+
+    /** @return the number of instructions per interval */
+    uint64_t get_interval_size() const
+    {
+        return interval_size;
+    }
+
+private:
+    /** Number of instructions per interval. */
+    uint64_t interval_size;
+
+    /** First PC of the current basic block. */
+    uint64_t block_start;
+    /** Number of instructions in the current basic block so far. */
+    uint64_t block_len;
+    /** The previous PC. */
+    uint64_t last_pc;
+
+    /** Instructions in the current interval so far. */
+    uint64_t interval_insts;
+    /** Projected BBV of the current interval. */
+    double current[SIMPOINT_DIMS];
+    /** Projected, normalized BBVs of finished intervals, SIMPOINT_DIMS each. */
+    std::vector<double> intervals;
+
+    /** Results of finish(). */
+    std::vector<SimPoint> simpoints;
+    unsigned int chosen_k;
+    double chosen_bic;
+
+    /** Add the current basic block to the current interval's BBV. */
+    inline void end_block()
+    {
+        // Derive the block's random vector from its PC: each dimension is a
+        // uniform value in [-1, 1) taken from a different hash.
+        uint64_t seed = hash_u64(block_start);
+        for (int d = 0; d < SIMPOINT_DIMS; d++)
+        {
+            uint64_t h = hash_u64(seed + d);
+            double r = (double)(h >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+            current[d] += r * (double)block_len;
+        }
+        block_len = 0;
+    }
+
+    /** Normalize the current interval's BBV and start a new interval. */
+    void end_interval();
+
+    /**
+     * Run k-means and return the total squared distance of the points to
+     * their centroids.
+     */
+    double kmeans(unsigned int k, uint64_t seed, std::vector<double> *centroids,
+                  std::vector<unsigned int> *assignment) const;
+
+    /** Score a clustering with the Bayesian Information Criterion. */
+    double bic(unsigned int k, double distortion,
+               const std::vector<unsigned int> &assignment) const;
+};
+
+#endif
@@ -8,9 +8,9 @@
 // Author: Byeongyong Go
 
 #include "trace.h"
+#include "analysis.h"
 #include <assert.h>
 #include <stdio.h>
-#include <unordered_set>
 // You may include any other standard C or C++ headers you need here,
 // e.g. #include <vector> or #include <algorithm>.
 // Make sure this compiles on the reference machine!
@@ -55,12 +55,134 @@ uint64_t stat_num_cycle = 0;
  */
 uint64_t stat_unique_pc = 0;
 
+/**
+ * The trace analyzed through the functions that take no TraceStats. The
+ * required statistics above are copied out of it after every call.
+ */
+static TraceStats global_trace;
+
 // ------------------------------------------------------------------------- //
 // You must implement the body of the analyze_trace_record() function below. //
 // Do not modify its return type or argument type.                           //
 // You may add helper functions if you need them.                            //
 // ------------------------------------------------------------------------- //
 
+const uint64_t CPI_MODEL[NUM_OP_TYPES] = {1, 2, 2, 3, 1};
+
+/** Bits of the mask that selects which optional passes are compiled in. */
+#define PASS_UNIQUE_PC 1
+#define PASS_APPROX_UNIQUE_PC 2
+#define PASS_TOP_PC 4
+#define PASS_SIMPOINT 8
+#define PASS_REUSE 16
+#define PASS_ICACHE 32
+#define PASS_CFG 64
+#define PASS_ALL 127
+
+/** The engine with the optional passes in Mask compiled in. */
+template <int Mask>
+struct MaskedEngine
+{
+    typedef AnalysisEngine<OpMixPass, CpiModelPass,
+                           OptionalPass<UniquePcPass, (Mask & PASS_UNIQUE_PC) != 0>,
+                           OptionalPass<ApproxUniquePcPass, (Mask & PASS_APPROX_UNIQUE_PC) != 0>,
+                           OptionalPass<TopPcPass, (Mask & PASS_TOP_PC) != 0>,
+                           OptionalPass<SimPointPass, (Mask & PASS_SIMPOINT) != 0>,
+                           OptionalPass<ReusePass, (Mask & PASS_REUSE) != 0>,
+                           OptionalPass<ICachePass, (Mask & PASS_ICACHE) != 0>,
+                           OptionalPass<CfgPass, (Mask & PASS_CFG) != 0> >
+        type;
+};
+
+/** Instantiate the engine for every mask up to Mask and pick one at run time. */
+template <int Mask>
+static Analyzer *analyzer_new_masked(int mask, AnalysisStats *stats)
+{
+    if (mask == Mask)
+    {
+        return new typename MaskedEngine<Mask>::type(stats);
+    }
+    return analyzer_new_masked<Mask - 1>(mask, stats);
+}
+
+template <>
+Analyzer *analyzer_new_masked<-1>(int mask, AnalysisStats *stats)
+{
+    return NULL;
+}
+
+Analyzer *analyzer_new(AnalysisStats *stats)
+{
+    int mask = (UNIQUE_PC_EXACT ? PASS_UNIQUE_PC : 0) |
+               (UNIQUE_PC_APPROX ? PASS_APPROX_UNIQUE_PC : 0) |
+               (TOPPC_K > 0 ? PASS_TOP_PC : 0) |
+               (SIMPOINT_INTERVAL > 0 ? PASS_SIMPOINT : 0) |
+               (REUSE_INTERVAL > 0 ? PASS_REUSE : 0) |
+               (ICACHE_MRC || IMISS_PENALTY > 0 ? PASS_ICACHE : 0) |
+               (CFG_K > 0 ? PASS_CFG : 0);
+    return analyzer_new_masked<PASS_ALL>(mask, stats);
+}
+
+/**
+ * Builds the analysis engine for the metrics selected on the command line.
+ */
+void analyze_trace_init() {
+    analyze_trace_init(&global_trace);
+}
+
+/**
+ * Builds the analysis engine of one trace.
+ *
+ * @param ts the trace's statistics, which the engine writes its results into
+ */
+void analyze_trace_init(TraceStats *ts) {
+    delete ts->analyzer;
+    ts->analyzer = analyzer_new(&ts->analysis);
+}
+
+/**
+ * Returns the statistics of the trace analyzed through the global functions,
+ * building its engine on first use for callers that never call
+ * analyze_trace_init().
+ */
+static TraceStats *global_trace_stats() {
+    if (global_trace.analyzer == NULL) {
+        analyze_trace_init(&global_trace);
+    }
+    return &global_trace;
+}
+
+/**
+ * Derives the required statistics of one trace from what its passes have
+ * written into its AnalysisStats.
+ *
+ * @param ts the trace's statistics
+ */
+static void derive_required_stats(TraceStats *ts) {
+    const AnalysisStats &analysis = ts->analysis;
+    memcpy(ts->optype_dyn, analysis.optype_dyn, sizeof(ts->optype_dyn));
+    ts->num_cycle = analysis.num_cycle;
+    if (IMISS_PENALTY > 0) {
+        // Charge instruction fetch stalls on top of the per-op-type CPI.
+        ts->num_cycle += IMISS_PENALTY * analysis.icache.misses_for_size(ICACHE_SIZE, ICACHE_ASSOC);
+    }
+    ts->unique_pc = UNIQUE_PC_EXACT ? analysis.unique_pc : analysis.unique_pc_approx;
+}
+
+/**
+ * Brings stat_optype_dyn, stat_num_cycle, and stat_unique_pc up to date with
+ * the records analyzed so far through the functions that take no TraceStats.
+ */
+static void update_global_stats() {
+    if (global_trace.analyzer != NULL) {
+        global_trace.analyzer->publish();
+        derive_required_stats(&global_trace);
+    }
+    memcpy(stat_optype_dyn, global_trace.optype_dyn, sizeof(stat_optype_dyn));
+    stat_num_cycle = global_trace.num_cycle;
+    stat_unique_pc = global_trace.unique_pc;
+}
+
 /**
  * Updates the global variables stat_num_cycle, stat_optype_dyn, and
  * stat_unique_pc according to the given trace record.
@@ -72,27 +194,90 @@ uint64_t stat_unique_pc = 0;
  * @param t the trace record to process. Refer to the trace.h header file for
  * details on the TraceRec type.
  */
-//    uint64_t inst_addr;
-//    uint8_t optype;
-int arr[] = {1, 2, 2, 3, 1};
-std::unordered_set <uint64_t> addr_set({}); 
-
 void analyze_trace_record(TraceRec *t) {
     assert(t);
-    stat_optype_dyn[t->optype] ++;
-    // TODO: Task 1: Quantify the mix of the dynamic instruction stream.
-    // Update stat_optype_dyn according to the trace record t.
-	stat_num_cycle += arr[t->optype];
-    // TODO: Task 2: Estimate the overall CPI using a simple CPI model in which
-    // the CPI for each category of instructions is provided.
-    // Update stat_num_cycle according to the trace record t.
-	if (addr_set.find(t->inst_addr) == addr_set.end()){
-		addr_set.insert(t->inst_addr);
-		stat_unique_pc ++;
-	}	
-    // TODO: Task 3: Estimate the instruction footprint by counting the number
-    // of unique PCs in the benchmark trace.
-    // Update stat_unique_pc according to the trace record t.
-
-    // Make sure you DO NOT update stat_num_inst.
+    global_trace_stats()->analyzer->analyze_batch(t, 1);
+    update_global_stats();
+}
+
+/**
+ * Processes a block of records read by sim.cpp.
+ *
+ * @param recs the trace records to process
+ * @param num_recs the number of records in recs
+ */
+void analyze_trace_batch(const TraceRec *recs, size_t num_recs) {
+    analyze_trace_batch(global_trace_stats(), recs, num_recs);
+    update_global_stats();
+}
+
+/**
+ * Processes a block of records of one trace.
+ *
+ * Every enabled metric is updated in the same loop over the block, so the
+ * trace is decompressed and scanned once however many metrics are enabled.
+ *
+ * @param ts the trace's statistics
+ * @param recs the trace records to process
+ * @param num_recs the number of records in recs
+ */
+void analyze_trace_batch(TraceStats *ts, const TraceRec *recs, size_t num_recs) {
+    assert(recs || num_recs == 0);
+    ts->analyzer->analyze_batch(recs, num_recs);
+}
+
+/**
+ * Processes a block of records from a columnar trace.
+ *
+ * @param pcs the PC of each record
+ * @param optypes the op type of each record
+ * @param num_recs the number of records
+ */
+void analyze_trace_columns(const uint64_t *pcs, const uint8_t *optypes, size_t num_recs) {
+    analyze_trace_columns(global_trace_stats(), pcs, optypes, num_recs);
+    update_global_stats();
+}
+
+/**
+ * Processes a block of records of one columnar trace.
+ *
+ * Passes that only need the op type scan the dense op-type column on its own;
+ * the rest share one loop over both columns.
+ *
+ * @param ts the trace's statistics
+ * @param pcs the PC of each record
+ * @param optypes the op type of each record
+ * @param num_recs the number of records
+ */
+void analyze_trace_columns(TraceStats *ts, const uint64_t *pcs, const uint8_t *optypes,
+                           size_t num_recs) {
+    assert((pcs && optypes) || num_recs == 0);
+    ts->analyzer->analyze_columns(pcs, optypes, num_recs);
+}
+
+/**
+ * Lets every pass publish its results, then copies them into the required
+ * global variables. Calling it again keeps the same results.
+ */
+void analyze_trace_finish() {
+    analyze_trace_finish(&global_trace);
+    update_global_stats();
+}
+
+/**
+ * Lets every pass publish its results, then derives the required statistics
+ * of one trace from them.
+ *
+ * @param ts the trace's statistics
+ */
+void analyze_trace_finish(TraceStats *ts) {
+    if (ts->analyzer == NULL) {
+        // Already finished, or nothing was analyzed.
+        return;
+    }
+    ts->analyzer->finish();
+    delete ts->analyzer;
+    ts->analyzer = NULL;
+
+    derive_required_stats(ts);
 }
@@ -0,0 +1,360 @@
+// topk.h
+// Declares a Space-Saving sketch for finding the most frequently executed
+// instruction addresses in fixed memory.
+
+#ifndef _TOPK_H_
+#define _TOPK_H_
+
+#include "hash.h"
+#include "trace.h"
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Default number of hottest PCs reported by -toppc. */
+#define TOPK_DEFAULT_K 16
+/** Default number of counters in the sketch. */
+#define TOPK_DEFAULT_COUNTERS 1024
+/** Marks the end of a list, or an empty slot in the PC index. */
+#define TOPK_NONE ((uint32_t)-1)
+
+/** An estimate for one monitored PC. */
+typedef struct TopPcStruct
+{
+    /** The instruction address. */
+    uint64_t pc;
+    /** The op type of the instruction. */
+    uint8_t optype;
+    /** Estimated execution count, never less than the true count. */
+    uint64_t count;
+    /** Maximum overestimate in count; the true count is >= count - error. */
+    uint64_t error;
+} TopPc;
+
+/**
+ * The Space-Saving heavy-hitter sketch (Metwally et al., 2005).
+ *
+ * The sketch monitors at most num_counters PCs. A monitored PC has its
+ * counter incremented; an unmonitored PC takes over the counter with the
+ * smallest count c, starting at c + 1 with an error of c. Every PC executed
+ * more than N / num_counters times over N records is guaranteed to be
+ * monitored, and no estimate is more than N / num_counters too high.
+ *
+ * Counters live in the Stream-Summary structure: a list of buckets sorted by
+ * count, each holding the counters with that count. Since counts only ever go
+ * up by one, a counter moves to the next bucket or to a new bucket right
+ * after its own, and the minimum is always the first bucket, so every update
+ * is O(1). A small open-addressing index maps PCs to counters.
+ */
+class SpaceSaving
+{
+public:
+    /**
+     * Construct an empty sketch.
+     *
+     * @param num_counters the number of PCs to monitor
+     */
+    explicit SpaceSaving(uint32_t num_counters = TOPK_DEFAULT_COUNTERS)
+        : counters(num_counters), buckets(num_counters),
+          num_used(0), first_bucket(TOPK_NONE), free_bucket(0), total(0)
+    {
+        size_t index_size = 2;
+        while (index_size < 2 * (size_t)num_counters)
+        {
+            index_size *= 2;
+        }
+        index.assign(index_size, TOPK_NONE);
+        index_mask = index_size - 1;
+
+        // Chain all buckets into the free list.
+        for (uint32_t i = 0; i < num_counters; i++)
+        {
+            buckets[i].next = (i + 1 < num_counters) ? i + 1 : TOPK_NONE;
+        }
+    }
+
+    /**
+     * Count one execution of an instruction.
+     *
+     * @param pc the address of the instruction
+     * @param optype the op type of the instruction
+     */
+    inline void add(uint64_t pc, uint8_t optype)
+    {
+        total++;
+
+        uint32_t c = find(pc);
+        if (c != TOPK_NONE)
+        {
+            increment(c);
+            return;
+        }
+
+        if (num_used < counters.size())
+        {
+            // A free counter is available: start it at zero.
+            c = num_used++;
+            counters[c].count = 0;
+            counters[c].error = 0;
+            attach(c, insert_bucket(TOPK_NONE, 0));
+        }
+        else
+        {
+            // Replace a counter from the minimum bucket.
+            c = buckets[first_bucket].first_counter;
+            erase(counters[c].pc);
+            counters[c].error = counters[c].count;
+        }
+
+        counters[c].pc = pc;
+        counters[c].optype = optype;
+        insert(pc, c);
+        increment(c);
+    }
+
+    /**
+     * Get the k PCs with the highest estimated counts, highest first.
+     *
+     * @param k the number of PCs to return
+     * @return up to k estimates
+     */
+    std::vector<TopPc> top(size_t k) const
+    {
+        std::vector<TopPc> result;
+        for (uint32_t c = 0; c < num_used; c++)
+        {
+            TopPc entry;
+            entry.pc = counters[c].pc;
+            entry.optype = counters[c].optype;
+            entry.count = counters[c].count;
+            entry.error = counters[c].error;
+            result.push_back(entry);
+        }
+
+        k = std::min(k, result.size());
+        std::partial_sort(result.begin(), result.begin() + k, result.end(),
+                          [](const TopPc &a, const TopPc &b) {
+                              return a.count > b.count ||
+                                     (a.count == b.count && a.pc < b.pc);
+                          });
+        result.resize(k);
+        return result;
+    }
+
+    /**
+     * @return the guaranteed bound on the overestimate of any count, which is
+     * the smallest monitored count (0 while there are free counters)
+     */
+    uint64_t max_error() const
+    {
+        if (num_used < counters.size() || first_bucket == TOPK_NONE)
+        {
+            return 0;
+        }
+        return buckets[first_bucket].count;
+    }
+
+    /** @return the number of counters */
+    size_t num_counters() const
+    {
+        return counters.size();
+    }
+
+    /** @return the number of instructions added */
+    uint64_t num_added() const
+    {
+        return total;
+    }
+
+private:
+    typedef struct CounterStruct
+    {
+        uint64_t pc;
+        uint64_t count;
+        uint64_t error;
+        /** The bucket holding this counter. */
+        uint32_t bucket;
+        /** Neighbours in the bucket's list of counters. */
+        uint32_t prev, next;
+        uint8_t optype;
+    } Counter;
+
+    typedef struct BucketStruct
+    {
+        uint64_t count;
+        /** The bucket's list of counters. */
+        uint32_t first_counter;
+        /** Neighbours in the list of buckets, sorted by count. */
+        uint32_t prev, next;
+    } Bucket;
+
+    std::vector<Counter> counters;
+    /** Bucket pool; there are never more buckets than counters. */
+    std::vector<Bucket> buckets;
+    /** PC -> counter index, linear probing. */
+    std::vector<uint32_t> index;
+    size_t index_mask;
+    /** Number of counters in use. */
+    uint32_t num_used;
+    /** The bucket with the smallest count. */
+    uint32_t first_bucket;
+    /** Head of the free-bucket list, linked through next. */
+    uint32_t free_bucket;
+    /** Number of instructions added. */
+    uint64_t total;
+
+    /** Find the counter monitoring pc, or TOPK_NONE. */
+    inline uint32_t find(uint64_t pc) const
+    {
+        for (size_t i = hash_u64(pc) & index_mask;; i = (i + 1) & index_mask)
+        {
+            uint32_t c = index[i];
+            if (c == TOPK_NONE || counters[c].pc == pc)
+            {
+                return c;
+            }
+        }
+    }
+
+    /** Map pc to counter c in the index. */
+    inline void insert(uint64_t pc, uint32_t c)
+    {
+        size_t i = hash_u64(pc) & index_mask;
+        while (index[i] != TOPK_NONE)
+        {
+            i = (i + 1) & index_mask;
+        }
+        index[i] = c;
+    }
+
+    /** Remove pc from the index, shifting later entries back into the gap. */
+    void erase(uint64_t pc)
+    {
+        size_t i = hash_u64(pc) & index_mask;
+        while (counters[index[i]].pc != pc)
+        {
+            i = (i + 1) & index_mask;
+        }
+
+        size_t gap = i;
+        for (size_t j = (i + 1) & index_mask; index[j] != TOPK_NONE;
+             j = (j + 1) & index_mask)
+        {
+            // Move index[j] into the gap unless its home slot lies cyclically
+            // in (gap, j].
+            size_t home = hash_u64(counters[index[j]].pc) & index_mask;
+            if (((j - home) & index_mask) >= ((j - gap) & index_mask))
+            {
+                index[gap] = index[j];
+                gap = j;
+            }
+        }
+        index[gap] = TOPK_NONE;
+    }
+
+    /** Create a bucket with the given count right after bucket prev. */
+    uint32_t insert_bucket(uint32_t prev, uint64_t count)
+    {
+        uint32_t b = free_bucket;
+        free_bucket = buckets[b].next;
+
+        buckets[b].count = count;
+        buckets[b].first_counter = TOPK_NONE;
+        buckets[b].prev = prev;
+        buckets[b].next = (prev == TOPK_NONE) ? first_bucket : buckets[prev].next;
+        if (buckets[b].next != TOPK_NONE)
+        {
+            buckets[buckets[b].next].prev = b;
+        }
+        if (prev == TOPK_NONE)
+        {
+            first_bucket = b;
+        }
+        else
+        {
+            buckets[prev].next = b;
+        }
+        return b;
+    }
+
+    /** Unlink an empty bucket and return it to the free list. */
+    void remove_bucket(uint32_t b)
+    {
+        if (buckets[b].prev == TOPK_NONE)
+        {
+            first_bucket = buckets[b].next;
+        }
+        else
+        {
+            buckets[buckets[b].prev].next = buckets[b].next;
+        }
+        if (buckets[b].next != TOPK_NONE)
+        {
+            buckets[buckets[b].next].prev = buckets[b].prev;
+        }
+        buckets[b].next = free_bucket;
+        free_bucket = b;
+    }
+
+    /** Add counter c to the front of bucket b's list. */
+    inline void attach(uint32_t c, uint32_t b)
+    {
+        counters[c].bucket = b;
+        counters[c].prev = TOPK_NONE;
+        counters[c].next = buckets[b].first_counter;
+        if (buckets[b].first_counter != TOPK_NONE)
+        {
+            counters[buckets[b].first_counter].prev = c;
+        }
+        buckets[b].first_counter = c;
+    }
+
+    /** Remove counter c from its bucket's list. */
+    inline void detach(uint32_t c)
+    {
+        uint32_t b = counters[c].bucket;
+        if (counters[c].prev == TOPK_NONE)
+        {
+            buckets[b].first_counter = counters[c].next;
+        }
+        else
+        {
+            counters[counters[c].prev].next = counters[c].next;
+        }
+        if (counters[c].next != TOPK_NONE)
+        {
+            counters[counters[c].next].prev = counters[c].prev;
+        }
+    }
+
+    /** Increment counter c and move it to the bucket for its new count. */
+    inline void increment(uint32_t c)
+    {
+        uint32_t b = counters[c].bucket;
+        uint64_t count = ++counters[c].count;
+        uint32_t next = buckets[b].next;
+
+        // If c is alone in its bucket and no bucket holds count yet, just
+        // relabel the bucket.
+        if (counters[c].prev == TOPK_NONE && counters[c].next == TOPK_NONE &&
+            (next == TOPK_NONE || buckets[next].count != count))
+        {
+            buckets[b].count = count;
+            return;
+        }
+
+        detach(c);
+        if (next == TOPK_NONE || buckets[next].count != count)
+        {
+            next = insert_bucket(b, count);
+        }
+        attach(c, next);
+        if (buckets[b].first_counter == TOPK_NONE)
+        {
+            remove_bucket(b);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,528 @@
+// tracefile.cpp
+// Implements an in-process reader for gzip, block-compressed, and columnar
+// CPU trace files.
+
+#include "tracefile.h"
+#include "blocktrace.h"
+#include "coltrace.h"
+#include "gzindex.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+/** Size of the compressed input buffer used in streaming mode. */
+#define TRACE_INPUT_BUF_SIZE (1024 * 1024)
+
+/**
+ * Largest amount of the mapped file handed to inflate at once in whole-file
+ * mode; avail_in is 32 bits.
+ */
+#define TRACE_MAX_MAP_INPUT (1U << 30)
+
+/** Records decoded at once when trace_read() rebuilds a columnar trace. */
+#define TRACE_COLUMN_BATCH_RECS 4096
+
+/** Size of the buffer trace_skip() inflates into and drops. */
+#define TRACE_SKIP_BUF_SIZE (64 * 1024)
+
+struct TraceFileStruct
+{
+    /** The path of the trace file, to find its index. */
+    char *filename;
+    /** The file descriptor of the compressed trace file. */
+    int fd;
+    /** The number of uncompressed bytes read or skipped so far. */
+    uint64_t pos;
+
+    /** The reader for a block-compressed trace, or NULL for a gzip trace. */
+    BlockTraceReader *blk;
+    /** The number of threads blk inflates on, or 0 for one per CPU core. */
+    unsigned int blk_threads;
+
+    /** The reader for a columnar trace, or NULL for a gzip trace. */
+    ColTraceReader *col;
+    /** A record of a columnar trace that trace_read() has partly returned. */
+    TraceRec col_rec;
+    /** The number of bytes of col_rec still to be returned. */
+    size_t col_rec_left;
+
+    /** The inflate state. */
+    z_stream strm;
+
+    /** The memory-mapped file in whole-file mode, or NULL in streaming mode. */
+    uint8_t *map;
+    /** The size of map in bytes. */
+    size_t map_size;
+
+    /** The compressed input buffer in streaming mode. */
+    uint8_t *in_buf;
+    /** Whether the end of the compressed file has been reached. */
+    bool in_eof;
+
+    /**
+     * The size of the trailer after the current compressed stream if
+     * inflate was resumed mid-stream from an index, which leaves it in raw
+     * deflate mode; 0 otherwise.
+     */
+    unsigned int raw_trailer_size;
+
+    /** Whether the end of the trace has been reached. */
+    bool done;
+};
+
+/**
+ * Make more compressed input available to inflate: the next part of the
+ * mapping in whole-file mode, or the next chunk of the file in streaming mode.
+ *
+ * @return the number of bytes added, 0 at end of file, or -1 on error
+ */
+static ssize_t trace_fill_input(TraceFile *tf)
+{
+    if (tf->map != NULL)
+    {
+        size_t offset = tf->strm.next_in + tf->strm.avail_in - tf->map;
+        size_t count = tf->map_size - offset;
+        count = count < TRACE_MAX_MAP_INPUT ? count : TRACE_MAX_MAP_INPUT;
+        tf->strm.avail_in += count;
+        return count;
+    }
+    if (tf->in_eof)
+    {
+        return 0;
+    }
+
+    // Keep any input inflate has not consumed yet.
+    if (tf->strm.avail_in > 0 && tf->strm.next_in != tf->in_buf)
+    {
+        memmove(tf->in_buf, tf->strm.next_in, tf->strm.avail_in);
+    }
+    tf->strm.next_in = tf->in_buf;
+
+    while (true)
+    {
+        ssize_t bytes_read = read(tf->fd, tf->in_buf + tf->strm.avail_in,
+                                  TRACE_INPUT_BUF_SIZE - tf->strm.avail_in);
+        if (bytes_read == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_read == -1)
+        {
+            perror("Couldn't read trace file");
+            return -1;
+        }
+        if (bytes_read == 0)
+        {
+            tf->in_eof = true;
+        }
+        tf->strm.avail_in += bytes_read;
+        return bytes_read;
+    }
+}
+
+TraceFile *trace_open(const char *filename, unsigned int num_threads)
+{
+    TraceFile *tf = (TraceFile *)calloc(1, sizeof(TraceFile));
+    if (tf == NULL)
+    {
+        perror("Couldn't allocate trace file");
+        return NULL;
+    }
+
+    tf->fd = open(filename, O_RDONLY);
+    if (tf->fd == -1)
+    {
+        perror("Couldn't open trace file");
+        free(tf);
+        return NULL;
+    }
+    tf->filename = strdup(filename);
+    tf->blk_threads = num_threads;
+
+    // Block-compressed traces are decompressed in parallel by their own
+    // reader.
+    char magic[BLOCKTRACE_MAGIC_LEN];
+    bool have_magic = (pread(tf->fd, magic, sizeof(magic), 0) == sizeof(magic));
+    if (have_magic && blocktrace_check_magic(magic, sizeof(magic)))
+    {
+        tf->blk = blocktrace_open(tf->fd, tf->blk_threads, 0);
+        if (tf->blk == NULL)
+        {
+            trace_close(tf);
+            return NULL;
+        }
+        return tf;
+    }
+
+    // So are columnar traces.
+    if (have_magic && coltrace_check_magic(magic, sizeof(magic)))
+    {
+        tf->col = coltrace_open(tf->fd);
+        if (tf->col == NULL)
+        {
+            trace_close(tf);
+            return NULL;
+        }
+        return tf;
+    }
+
+    // Whole-file mode: map the compressed file and inflate from the mapping.
+    struct stat st;
+    if (fstat(tf->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tf->fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            tf->map = (uint8_t *)map;
+            tf->map_size = st.st_size;
+            tf->strm.next_in = tf->map;
+            tf->strm.avail_in = 0;
+            trace_fill_input(tf);
+        }
+    }
+
+    // Streaming mode: fall back to reading the file in large chunks.
+    if (tf->map == NULL)
+    {
+        tf->in_buf = (uint8_t *)malloc(TRACE_INPUT_BUF_SIZE);
+        if (tf->in_buf == NULL)
+        {
+            perror("Couldn't allocate trace input buffer");
+            trace_close(tf);
+            return NULL;
+        }
+        tf->strm.next_in = tf->in_buf;
+    }
+
+    // A window of 15 + 32 accepts both gzip and zlib headers.
+    if (inflateInit2(&tf->strm, 15 + 32) != Z_OK)
+    {
+        fprintf(stderr, "Error: Couldn't initialize zlib\n");
+        tf->strm.state = NULL;
+        trace_close(tf);
+        return NULL;
+    }
+
+    return tf;
+}
+
+/**
+ * Rebuild up to size bytes of 16-byte records from a columnar trace.
+ *
+ * @return the number of bytes read, 0 at the end of the trace, or -1 on error
+ */
+static ssize_t trace_read_col_records(TraceFile *tf, uint8_t *out, size_t size)
+{
+    uint64_t pcs[TRACE_COLUMN_BATCH_RECS];
+    uint8_t optypes[TRACE_COLUMN_BATCH_RECS];
+    size_t bytes_read = 0;
+
+    while (bytes_read < size)
+    {
+        // Finish a record cut short by the previous call first.
+        if (tf->col_rec_left > 0)
+        {
+            size_t count = size - bytes_read < tf->col_rec_left ? size - bytes_read : tf->col_rec_left;
+            memcpy(out + bytes_read,
+                   (uint8_t *)&tf->col_rec + sizeof(TraceRec) - tf->col_rec_left, count);
+            bytes_read += count;
+            tf->col_rec_left -= count;
+            continue;
+        }
+
+        size_t want = (size - bytes_read) / sizeof(TraceRec);
+        want = want == 0 ? 1 : want;
+        want = want < TRACE_COLUMN_BATCH_RECS ? want : TRACE_COLUMN_BATCH_RECS;
+        ssize_t recs_read = coltrace_read(tf->col, pcs, optypes, want);
+        if (recs_read <= 0)
+        {
+            return recs_read == 0 ? (ssize_t)bytes_read : -1;
+        }
+
+        for (ssize_t i = 0; i < recs_read; i++)
+        {
+            memset(&tf->col_rec, 0, sizeof(TraceRec));
+            tf->col_rec.inst_addr = pcs[i];
+            tf->col_rec.optype = optypes[i];
+            tf->col_rec_left = sizeof(TraceRec);
+            if (size - bytes_read < sizeof(TraceRec))
+            {
+                // Only possible for the last record of the batch.
+                break;
+            }
+            memcpy(out + bytes_read, &tf->col_rec, sizeof(TraceRec));
+            bytes_read += sizeof(TraceRec);
+            tf->col_rec_left = 0;
+        }
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Drop size bytes of compressed input, such as a gzip trailer.
+ *
+ * @return 0 on success, or -1 on error
+ */
+static int trace_drop_input(TraceFile *tf, size_t size)
+{
+    while (size > 0)
+    {
+        if (tf->strm.avail_in == 0 && trace_fill_input(tf) <= 0)
+        {
+            fprintf(stderr, "Error: Unexpected end of trace file\n");
+            return -1;
+        }
+        size_t count = size < tf->strm.avail_in ? size : tf->strm.avail_in;
+        tf->strm.next_in += count;
+        tf->strm.avail_in -= count;
+        size -= count;
+    }
+    return 0;
+}
+
+/**
+ * Inflate up to size bytes of a gzip trace into buf.
+ *
+ * @return the number of bytes read, 0 at the end of the trace, or -1 on error
+ */
+static ssize_t trace_read_gzip(TraceFile *tf, void *buf, size_t size)
+{
+    tf->strm.next_out = (Bytef *)buf;
+    tf->strm.avail_out = size;
+
+    while (tf->strm.avail_out > 0 && !tf->done)
+    {
+        if (tf->strm.avail_in == 0)
+        {
+            ssize_t bytes_added = trace_fill_input(tf);
+            if (bytes_added == -1)
+            {
+                return -1;
+            }
+            if (bytes_added == 0)
+            {
+                // gunzip treats a file that ends mid-stream as an error.
+                fprintf(stderr, "Error: Unexpected end of trace file\n");
+                return -1;
+            }
+        }
+
+        int status = inflate(&tf->strm, Z_NO_FLUSH);
+        if (status == Z_STREAM_END && tf->raw_trailer_size > 0)
+        {
+            // A stream resumed from an index ends in raw mode. Step over its
+            // trailer by hand and parse the headers of any further members.
+            if (trace_drop_input(tf, tf->raw_trailer_size) != 0 ||
+                inflateReset2(&tf->strm, 15 + 32) != Z_OK)
+            {
+                return -1;
+            }
+            tf->raw_trailer_size = 0;
+        }
+        if (status == Z_STREAM_END)
+        {
+            // A gzip file may hold several concatenated members. Keep going
+            // if there is more input after this one.
+            if (tf->strm.avail_in == 0 && trace_fill_input(tf) <= 0)
+            {
+                tf->done = true;
+            }
+            else
+            {
+                inflateReset(&tf->strm);
+            }
+        }
+        else if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            fprintf(stderr, "Error: Corrupt trace file: %s\n",
+                    tf->strm.msg != NULL ? tf->strm.msg : zError(status));
+            return -1;
+        }
+    }
+
+    return size - tf->strm.avail_out;
+}
+
+ssize_t trace_read(TraceFile *tf, void *buf, size_t size)
+{
+    ssize_t bytes_read;
+    if (tf->blk != NULL)
+    {
+        bytes_read = blocktrace_read(tf->blk, buf, size);
+    }
+    else if (tf->col != NULL)
+    {
+        bytes_read = trace_read_col_records(tf, (uint8_t *)buf, size);
+    }
+    else
+    {
+        bytes_read = trace_read_gzip(tf, buf, size);
+    }
+
+    if (bytes_read > 0)
+    {
+        tf->pos += bytes_read;
+    }
+    return bytes_read;
+}
+
+/**
+ * Resume a gzip trace that has not been read yet from the last access point
+ * in its index at or before offset.
+ *
+ * @return 0 on success, including when there is no index or no point to
+ * resume from, or -1 on error
+ */
+static int trace_seek_gzip(TraceFile *tf, uint64_t offset)
+{
+    struct stat st;
+    if (fstat(tf->fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return 0;
+    }
+
+    std::vector<char> index_name(strlen(tf->filename) + strlen(GZINDEX_SUFFIX) + 1);
+    snprintf(index_name.data(), index_name.size(), "%s%s", tf->filename, GZINDEX_SUFFIX);
+    GzIndex *idx = gzindex_load(index_name.data(), st.st_size);
+    if (idx == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t out, in;
+    int status = gzindex_seek(idx, tf->fd, offset, &tf->strm, &out, &in);
+    unsigned int trailer_size = gzindex_trailer_size(idx);
+    gzindex_free(idx);
+    if (status != 0)
+    {
+        return status == 1 ? 0 : -1;
+    }
+
+    // Feed inflate from the access point on.
+    if (tf->map != NULL)
+    {
+        tf->strm.next_in = tf->map + in;
+        tf->strm.avail_in = 0;
+        trace_fill_input(tf);
+    }
+    else
+    {
+        if (lseek(tf->fd, in, SEEK_SET) == -1)
+        {
+            perror("Couldn't seek in trace file");
+            return -1;
+        }
+        tf->strm.next_in = tf->in_buf;
+        tf->strm.avail_in = 0;
+        tf->in_eof = false;
+    }
+    tf->raw_trailer_size = trailer_size;
+    tf->done = false;
+    tf->pos = out;
+    return 0;
+}
+
+int64_t trace_skip(TraceFile *tf, uint64_t size)
+{
+    uint64_t target = tf->pos + size;
+
+    // Jump as close to the target as the format allows.
+    if (tf->blk != NULL && tf->pos == 0)
+    {
+        blocktrace_close(tf->blk);
+        tf->blk = blocktrace_open(tf->fd, tf->blk_threads, target);
+        if (tf->blk == NULL)
+        {
+            return -1;
+        }
+        uint64_t raw_size = blocktrace_size(tf->blk);
+        tf->pos = target < raw_size ? target : raw_size;
+    }
+    else if (tf->col != NULL && tf->col_rec_left == 0 && tf->pos % sizeof(TraceRec) == 0)
+    {
+        int64_t recs = coltrace_skip(tf->col, size / sizeof(TraceRec));
+        if (recs == -1)
+        {
+            return -1;
+        }
+        tf->pos += recs * sizeof(TraceRec);
+    }
+    else if (tf->blk == NULL && tf->col == NULL && tf->pos == 0 && trace_seek_gzip(tf, target) != 0)
+    {
+        return -1;
+    }
+
+    // Inflate the rest of the way and drop it.
+    std::vector<uint8_t> scratch;
+    while (tf->pos < target)
+    {
+        scratch.resize(TRACE_SKIP_BUF_SIZE);
+        uint64_t left = target - tf->pos;
+        ssize_t bytes_read = trace_read(tf, scratch.data(), left < scratch.size() ? left : scratch.size());
+        if (bytes_read == -1)
+        {
+            return -1;
+        }
+        if (bytes_read == 0)
+        {
+            break;
+        }
+    }
+
+    return size - (target - tf->pos);
+}
+
+bool trace_is_columnar(TraceFile *tf)
+{
+    return tf->col != NULL;
+}
+
+ssize_t trace_read_columns(TraceFile *tf, uint64_t *pcs, uint8_t *optypes,
+                           size_t max_recs)
+{
+    if (tf->col == NULL || tf->col_rec_left > 0)
+    {
+        fprintf(stderr, "Error: Trace file is not being read by columns\n");
+        return -1;
+    }
+    ssize_t recs_read = coltrace_read(tf->col, pcs, optypes, max_recs);
+    if (recs_read > 0)
+    {
+        tf->pos += recs_read * sizeof(TraceRec);
+    }
+    return recs_read;
+}
+
+void trace_close(TraceFile *tf)
+{
+    if (tf == NULL)
+    {
+        return;
+    }
+
+    blocktrace_close(tf->blk);
+    coltrace_close(tf->col);
+    if (tf->strm.state != NULL)
+    {
+        inflateEnd(&tf->strm);
+    }
+    if (tf->map != NULL)
+    {
+        munmap(tf->map, tf->map_size);
+    }
+    free(tf->in_buf);
+    free(tf->filename);
+    close(tf->fd);
+    free(tf);
+}
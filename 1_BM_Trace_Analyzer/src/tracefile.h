@@ -0,0 +1,97 @@
+// tracefile.h
+// Declares a reader that decompresses a CPU trace file in-process, without
+// spawning a gunzip child. Gzip traces, block-compressed traces (see
+// blocktrace.h), and columnar traces (see coltrace.h) are supported.
+
+#ifndef _TRACEFILE_H_
+#define _TRACEFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** An open trace file. The contents are private to tracefile.cpp. */
+typedef struct TraceFileStruct TraceFile;
+
+/**
+ * Open a trace file for reading.
+ *
+ * Block-compressed traces are recognized by their magic bytes and inflated in
+ * parallel on a pool of worker threads. Columnar traces are also recognized by
+ * their magic bytes; see trace_read_columns(). For gzip traces, regular files are
+ * memory-mapped and inflated from the mapping in one pass (whole-file mode).
+ * Anything that cannot be mapped, such as a pipe, is read in large chunks and
+ * inflated as a stream (streaming mode).
+ *
+ * Prints an error message and returns NULL on failure.
+ *
+ * @param filename the path of the trace file
+ * @param num_threads the number of threads a block trace is inflated on, or 0
+ * for one per CPU core
+ * @return the opened trace file, or NULL on failure
+ */
+TraceFile *trace_open(const char *filename, unsigned int num_threads);
+
+/**
+ * Decompress up to size bytes of the trace directly into buf.
+ *
+ * Unlike read(), this only returns fewer than size bytes at the end of the
+ * trace, so callers do not need to loop to fill a buffer.
+ *
+ * Columnar traces are rebuilt into 16-byte Lab 1 records, with zero padding.
+ *
+ * @param tf the trace file to read from
+ * @param buf the buffer to decompress into
+ * @param size the number of bytes to read
+ * @return the number of bytes read, 0 at the end of the trace, or -1 on error
+ */
+ssize_t trace_read(TraceFile *tf, void *buf, size_t size);
+
+/**
+ * Skip up to size bytes of the trace without returning them.
+ *
+ * The reader jumps as close to the target as the format allows and decodes
+ * and drops the rest. Before the first read, a gzip trace resumes at the last
+ * access point before the target in its sidecar index <trace>.gzi, if there
+ * is one (see gzindex.h), and a block trace starts at the block that holds
+ * the target. A columnar trace steps over whole chunks at any record boundary.
+ *
+ * @param tf the trace file
+ * @param size the number of bytes to skip
+ * @return the number of bytes skipped, fewer than size only at the end of the
+ * trace, or -1 on error
+ */
+int64_t trace_skip(TraceFile *tf, uint64_t size);
+
+/**
+ * @param tf the trace file
+ * @return true if tf is a columnar trace, which can be read with
+ * trace_read_columns()
+ */
+bool trace_is_columnar(TraceFile *tf);
+
+/**
+ * Decode up to max_recs records of a columnar trace into a column of PCs and
+ * a column of op types, without rebuilding 16-byte records.
+ *
+ * Only returns fewer than max_recs records at the end of the trace. Must not
+ * be mixed with trace_read() on the same trace.
+ *
+ * @param tf the columnar trace file to read from
+ * @param pcs receives the PC of each record
+ * @param optypes receives the op type of each record
+ * @param max_recs the number of records pcs and optypes can hold
+ * @return the number of records read, 0 at the end of the trace, or -1 on
+ * error
+ */
+ssize_t trace_read_columns(TraceFile *tf, uint64_t *pcs, uint8_t *optypes,
+                           size_t max_recs);
+
+/**
+ * Close a trace file and release its resources.
+ *
+ * @param tf the trace file to close
+ */
+void trace_close(TraceFile *tf);
+
+#endif
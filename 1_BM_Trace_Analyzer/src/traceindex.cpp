@@ -0,0 +1,115 @@
+// traceindex.cpp
+// Builds the random-access index of a gzip-compressed CPU trace, described in
+// gzindex.h, so that readers can start partway through the trace without
+// inflating everything before it.
+//
+// The index is written next to the trace as <trace>.gzi, where trace_open()
+// finds it, e.g. ../src/traceindex ../traces/gcc.otr.gz, then
+// ../src/sim -skipinst 5000000 ../traces/gcc.otr.gz
+
+#include "gzindex.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+int index_trace(const char *filename, uint64_t span);
+void print_usage(char *program_name);
+
+int main(int argc, char *argv[])
+{
+    uint64_t span = GZINDEX_DEFAULT_SPAN;
+    std::vector<const char *> filenames;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+        else if (strcmp(argv[i], "-span") == 0)
+        {
+            if (++i >= argc)
+            {
+                fprintf(stderr, "Error: missing argument to -span\n");
+                return 2;
+            }
+
+            long mb = atol(argv[i]);
+            if (mb < 1 || mb > 1024)
+            {
+                fprintf(stderr, "Error: span must be between 1 and 1024 MB\n");
+                return 2;
+            }
+            span = (uint64_t)mb * 1024 * 1024;
+        }
+        else
+        {
+            filenames.push_back(argv[i]);
+        }
+    }
+
+    if (filenames.empty())
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < filenames.size(); i++)
+    {
+        if (index_trace(filenames[i], span) != 0)
+        {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/**
+ * Build the index of one trace and write it to <filename>.gzi.
+ *
+ * @return 0 on success, or 1 on error
+ */
+int index_trace(const char *filename, uint64_t span)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        perror("Couldn't open trace file");
+        return 1;
+    }
+
+    GzIndex *idx = gzindex_build(fd, span);
+    close(fd);
+    if (idx == NULL)
+    {
+        fprintf(stderr, "Error: couldn't index %s\n", filename);
+        return 1;
+    }
+
+    std::vector<char> index_name(strlen(filename) + strlen(GZINDEX_SUFFIX) + 1);
+    snprintf(index_name.data(), index_name.size(), "%s%s", filename, GZINDEX_SUFFIX);
+    int status = gzindex_write(idx, index_name.data()) == 0 ? 0 : 1;
+    if (status == 0)
+    {
+        printf("Wrote %lu access points over %lu bytes of trace to %s\n",
+               (unsigned long)gzindex_num_points(idx), (unsigned long)gzindex_raw_size(idx),
+               index_name.data());
+    }
+
+    gzindex_free(idx);
+    return status;
+}
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] <trace.gz> [<trace.gz> ...]\n\n", program_name);
+    fprintf(stderr, "Writes the random-access index <trace.gz>.gzi of each gzip trace\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -span <MB>          Uncompressed megabytes between access points\n");
+    fprintf(stderr, "                        (Default: %d)\n", GZINDEX_DEFAULT_SPAN / (1024 * 1024));
+}
@@ -0,0 +1,193 @@
+// tracepack.cpp
+// Converts a gzip-compressed CPU trace into the seekable block-compressed
+// format described in blocktrace.h, or into the columnar format described in
+// coltrace.h.
+//
+// The output can be read by any program that reads traces through
+// trace_open(), e.g. ../src/sim ../traces/gcc.otb
+
+#include "blocktrace.h"
+#include "coltrace.h"
+#include "trace.h"
+#include "tracefile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+int write_columnar(TraceFile *in, const char *out_filename, long block_size);
+void print_usage(char *program_name);
+
+int main(int argc, char *argv[])
+{
+    const char *in_filename = NULL;
+    const char *out_filename = NULL;
+    long block_size = BLOCKTRACE_DEFAULT_BLOCK_SIZE;
+    bool columnar = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+        else if (strcmp(argv[i], "-blocksize") == 0)
+        {
+            if (++i >= argc)
+            {
+                fprintf(stderr, "Error: missing argument to -blocksize\n");
+                return 2;
+            }
+
+            block_size = atol(argv[i]);
+            if (block_size < BLOCKTRACE_MIN_BLOCK_SIZE || block_size > BLOCKTRACE_MAX_BLOCK_SIZE)
+            {
+                fprintf(stderr, "Error: block size must be between 1 KB and 1 GB\n");
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "-columnar") == 0)
+        {
+            columnar = true;
+        }
+        else if (in_filename == NULL)
+        {
+            in_filename = argv[i];
+        }
+        else if (out_filename == NULL)
+        {
+            out_filename = argv[i];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (in_filename == NULL || out_filename == NULL)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    TraceFile *in = trace_open(in_filename, 0);
+    if (in == NULL)
+    {
+        return 1;
+    }
+
+    if (columnar)
+    {
+        int status = write_columnar(in, out_filename, block_size);
+        trace_close(in);
+        return status;
+    }
+
+    BlockTraceWriter *out = blocktrace_create(out_filename, block_size);
+    if (out == NULL)
+    {
+        trace_close(in);
+        return 1;
+    }
+
+    // Copy the trace one block at a time.
+    std::vector<uint8_t> buf(block_size);
+    ssize_t bytes_read;
+    uint64_t total_bytes = 0;
+    int status = 0;
+    while ((bytes_read = trace_read(in, buf.data(), buf.size())) > 0)
+    {
+        if (blocktrace_write(out, buf.data(), bytes_read) != 0)
+        {
+            status = 1;
+            break;
+        }
+        total_bytes += bytes_read;
+    }
+    if (bytes_read == -1)
+    {
+        status = 1;
+    }
+
+    trace_close(in);
+    if (blocktrace_finish(out) != 0)
+    {
+        status = 1;
+    }
+
+    if (status == 0)
+    {
+        printf("Wrote %lu bytes of trace in %lu blocks to %s\n",
+               (unsigned long)total_bytes,
+               (unsigned long)((total_bytes + block_size - 1) / block_size),
+               out_filename);
+    }
+    return status;
+}
+
+/**
+ * Copy a Lab 1 trace into a columnar trace with block_size / 16 records per
+ * chunk.
+ *
+ * @return 0 on success, or 1 on error
+ */
+int write_columnar(TraceFile *in, const char *out_filename, long block_size)
+{
+    size_t chunk_recs = block_size / sizeof(TraceRec);
+    ColTraceWriter *out = coltrace_create(out_filename, chunk_recs);
+    if (out == NULL)
+    {
+        return 1;
+    }
+
+    std::vector<TraceRec> buf(chunk_recs);
+    ssize_t bytes_read;
+    uint64_t total_recs = 0;
+    int status = 0;
+    while ((bytes_read = trace_read(in, buf.data(), chunk_recs * sizeof(TraceRec))) > 0)
+    {
+        if (bytes_read % sizeof(TraceRec) != 0)
+        {
+            fprintf(stderr, "Error: Invalid trace file\n");
+            status = 1;
+            break;
+        }
+
+        size_t num_recs = bytes_read / sizeof(TraceRec);
+        if (coltrace_write(out, buf.data(), num_recs) != 0)
+        {
+            status = 1;
+            break;
+        }
+        total_recs += num_recs;
+    }
+    if (bytes_read == -1)
+    {
+        status = 1;
+    }
+
+    if (coltrace_finish(out) != 0)
+    {
+        status = 1;
+    }
+
+    if (status == 0)
+    {
+        printf("Wrote %lu records in %lu chunks to %s\n", (unsigned long)total_recs,
+               (unsigned long)((total_recs + chunk_recs - 1) / chunk_recs), out_filename);
+    }
+    return status;
+}
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] <input trace> <output trace>\n\n", program_name);
+    fprintf(stderr, "Converts a trace to the seekable block-compressed format\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -blocksize <bytes>  Uncompressed bytes per block (Default: %d)\n",
+            BLOCKTRACE_DEFAULT_BLOCK_SIZE);
+    fprintf(stderr, "    -columnar           Write a Lab 1 trace in the columnar format instead,\n");
+    fprintf(stderr, "                        with <bytes> / 16 records per chunk\n");
+}
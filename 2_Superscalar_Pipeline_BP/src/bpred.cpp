@@ -8,6 +8,61 @@
 // Implements the branch predictor class.
 
 #include "bpred.h"
+#include "perceptron.h"
+#include "tage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *bpred_component_names[NUM_BPRED_COMPONENTS] = {"BIMODAL", "GSHARE"};
+
+/** Names of the index hashes, as given to -phthash. */
+static const char *bpred_hash_names[NUM_BPRED_HASHES] = {"xor", "fold", "concat"};
+
+void bpred_default_config(BPredConfig *config)
+{
+    config->ghr_bits = BPRED_DEFAULT_GHR_BITS;
+    config->pht_size = BPRED_DEFAULT_PHT_SIZE;
+    config->hash = BPRED_HASH_XOR;
+    config->tage_tables = TAGE_DEFAULT_TABLES;
+    config->tage_log_size = TAGE_DEFAULT_LOG_SIZE;
+    config->tage_min_hist = TAGE_DEFAULT_MIN_HIST;
+    config->tage_max_hist = TAGE_DEFAULT_MAX_HIST;
+    config->tage_tag_bits = TAGE_DEFAULT_TAG_BITS;
+    config->perc_hist = PERC_DEFAULT_HIST;
+    config->perc_rows = PERC_DEFAULT_ROWS;
+}
+
+bool bpred_parse_hash(const char *name, BPredHash *hash)
+{
+    for (int i = 0; i < NUM_BPRED_HASHES; i++)
+    {
+        if (strcmp(name, bpred_hash_names[i]) == 0)
+        {
+            *hash = (BPredHash)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * XOR-fold a value down to its low bits.
+ *
+ * @param x the value to fold
+ * @param bits the width of the result
+ * @return the XOR of every bits-wide chunk of x
+ */
+static inline uint32_t fold_bits(uint64_t x, uint32_t bits)
+{
+    uint64_t folded = 0;
+    while (x != 0)
+    {
+        folded ^= x;
+        x >>= bits;
+    }
+    return folded & ((1ULL << bits) - 1);
+}
 
 /**
  * Construct a branch predictor with the given policy.
@@ -18,15 +73,76 @@
  */
 BPred::BPred(BPredPolicy policy) : policy(policy)
 {
-    // TODO: Initialize member variables here.
-    
+    BPredConfig config;
+    bpred_default_config(&config);
+    init(config);
+}
+
+/**
+ * Construct a branch predictor with the given policy and geometry.
+ *
+ * @param policy the policy this branch predictor should use
+ * @param config the table sizes and index hash to use
+ */
+BPred::BPred(BPredPolicy policy, const BPredConfig &config) : policy(policy)
+{
+    init(config);
+}
+
+/**
+ * Allocate a table of packed 2-bit counters in one cache-line-aligned array,
+ * every counter starting at 2 (0b10 in each of the four fields of a byte):
+ * weakly taken, or for the chooser, weakly gshare.
+ */
+uint8_t *BPred::alloc_counters(uint32_t num_counters)
+{
+    size_t bytes = (num_counters + 3) / 4;
+    size_t alloc_bytes = (bytes + BPRED_TABLE_ALIGN - 1) & ~(size_t)(BPRED_TABLE_ALIGN - 1);
+    void *table = NULL;
+    if (posix_memalign(&table, BPRED_TABLE_ALIGN, alloc_bytes) != 0)
+    {
+        perror("Couldn't allocate pattern history table");
+        exit(1);
+    }
+    memset(table, 0xaa, alloc_bytes);
+    return (uint8_t *)table;
+}
+
+BPred::~BPred()
+{
+    free(PHT);
+    free(BIM);
+    free(CHOOSER);
+    delete tage;
+    delete perceptron;
+}
+
+void BPred::init(const BPredConfig &config)
+{
     /** The total number of branches this branch predictor has seen. */
     stat_num_branches = 0;
     /** The number of branches this branch predictor has mispredicted. */
     stat_num_mispred = 0;
-    GHR = 0;//(1 << 13) - 1;
-    // As a reminder, you can declare any additional member variables you need
-    // in the BPred class in bpred.h and initialize them here.
+    GHR = 0;
+
+    this->config = config;
+    // The option parser keeps ghr_bits at most BPRED_MAX_GHR_BITS.
+    ghr_mask = (1ULL << config.ghr_bits) - 1;
+    pht_mask = config.pht_size - 1;
+    pht_index_bits = __builtin_ctz(config.pht_size);
+
+    // Only gshare and the tournament predictor read the PHT.
+    bool uses_pht = (policy == BPRED_GSHARE || policy == BPRED_TOURNAMENT);
+    PHT = uses_pht ? alloc_counters(config.pht_size) : NULL;
+    BIM = (policy == BPRED_TOURNAMENT) ? alloc_counters(config.pht_size) : NULL;
+    CHOOSER = (policy == BPRED_TOURNAMENT) ? alloc_counters(config.pht_size) : NULL;
+    memset(last_component_pred, 0, sizeof(last_component_pred));
+    memset(stat_component_chosen, 0, sizeof(stat_component_chosen));
+    memset(stat_component_correct, 0, sizeof(stat_component_correct));
+    memset(stat_component_chosen_correct, 0, sizeof(stat_component_chosen_correct));
+
+    tage = (policy == BPRED_TAGE) ? new TagePredictor(config) : NULL;
+    perceptron = (policy == BPRED_PERCEPTRON) ? new PerceptronPredictor(config) : NULL;
 }
 
 /**
@@ -42,17 +158,26 @@ BranchDirection BPred::predict(uint64_t pc)
     if (policy == BPRED_ALWAYS_TAKEN){
         return TAKEN;
     }
+    else if (policy == BPRED_TAGE){
+        return tage->predict(pc);
+    }
+    else if (policy == BPRED_PERCEPTRON){
+        return perceptron->predict(pc);
+    }
+    else if (policy == BPRED_TOURNAMENT){
+        // Ask both components, then let the chooser pick one.
+        uint32_t key = pc & pht_mask;
+        last_component_pred[BPRED_COMP_BIMODAL] =
+            (counter2_get(BIM, key) & 2) ? TAKEN : NOT_TAKEN;
+        last_component_pred[BPRED_COMP_GSHARE] =
+            (PHT_get(PHT_index(pc)) & 2) ? TAKEN : NOT_TAKEN;
+        BPredComponent chosen = (counter2_get(CHOOSER, key) & 2) ? BPRED_COMP_GSHARE
+                                                                 : BPRED_COMP_BIMODAL;
+        return last_component_pred[chosen];
+    }
     else{ // BPRED_GSHARE
-        // Should be Modified for B2-2
-
-        // PC(12bit) ^ GHR(12bit) ==> Key of PHT
-        uint16_t cur_key = xor_12b(pc, GHR);
-        if (PHT.find(cur_key) == PHT.end()){
-            PHT[cur_key] = 2;
-        }
-        return ((((PHT[cur_key] ^ (2)) >> 1) & 1) == 1 ? NOT_TAKEN : TAKEN);
-        // return PHT[Key]
-        // return NOT_TAKEN;
+        // The upper bit of the counter is the prediction.
+        return (PHT_get(PHT_index(pc)) & 2) ? TAKEN : NOT_TAKEN;
     }
     // TODO: Return a prediction for whether the branch at address pc will be
     // TAKEN or NOT_TAKEN according to this branch predictor's policy.
@@ -85,14 +210,40 @@ void BPred::update(uint64_t pc, BranchDirection prediction,
         stat_num_mispred ++;
     
     if (policy == BPRED_GSHARE){
-        // Key: GHR ^ PC
-        uint16_t PHT_key = xor_12b(pc, GHR);
-        // update PHT[Key] (2 input: cur stage, T/NT)
-        PHT_update(PHT_key, resolution);
-        // GHR update (resolution)
+        // Train the counter the prediction came from, then shift the
+        // outcome into the history.
+        PHT_update(PHT_index(pc), resolution);
+        GHR_update(resolution);
+    }
+    else if (policy == BPRED_TAGE){
+        tage->update(pc, resolution);
+    }
+    else if (policy == BPRED_PERCEPTRON){
+        perceptron->update(pc, resolution);
+    }
+    else if (policy == BPRED_TOURNAMENT){
+        uint32_t key = pc & pht_mask;
+        uint8_t choice = counter2_get(CHOOSER, key);
+        BPredComponent chosen = (choice & 2) ? BPRED_COMP_GSHARE : BPRED_COMP_BIMODAL;
+        bool bimodal_correct = (last_component_pred[BPRED_COMP_BIMODAL] == resolution);
+        bool gshare_correct = (last_component_pred[BPRED_COMP_GSHARE] == resolution);
+
+        stat_component_chosen[chosen]++;
+        stat_component_correct[BPRED_COMP_BIMODAL] += bimodal_correct;
+        stat_component_correct[BPRED_COMP_GSHARE] += gshare_correct;
+        stat_component_chosen_correct[chosen] += (prediction == resolution);
+
+        // Move the chooser towards whichever component was right, if only
+        // one was.
+        if (bimodal_correct != gshare_correct){
+            counter2_set(CHOOSER, key, gshare_correct ? sat_increment(choice, 3)
+                                                      : sat_decrement(choice));
+        }
+
+        // Train both components.
+        counter2_set(BIM, key, PHT_get_next_stage(counter2_get(BIM, key), resolution));
+        PHT_update(PHT_index(pc), resolution);
         GHR_update(resolution);
-        // 
-        // 
     }
     // TODO: Update the stat_num_branches and stat_num_mispred member variables
     // according to the prediction and resolution of the branch.
@@ -104,12 +255,8 @@ void BPred::update(uint64_t pc, BranchDirection prediction,
     // function will not be called for that policy.
 }
 
-void BPred::PHT_update(uint16_t key, BranchDirection resolution){
-    if (PHT.find(key) != PHT.end()){
-        PHT[key] = PHT_get_next_stage(PHT[key], resolution);
-    }else{
-        PHT[key] = PHT_get_next_stage(2, resolution);
-    }
+void BPred::PHT_update(uint32_t key, BranchDirection resolution){
+    PHT_set(key, PHT_get_next_stage(PHT_get(key), resolution));
 }
 
 uint8_t BPred::PHT_get_next_stage(uint8_t cur_val, BranchDirection res){
@@ -141,9 +288,22 @@ uint8_t BPred::PHT_get_next_stage(uint8_t cur_val, BranchDirection res){
 }
 
 void BPred::GHR_update(BranchDirection resolution){
-    GHR = (((1 << 12) - 1) & ((GHR << 1) | (resolution == TAKEN ? 1 : 0)));
+    GHR = ghr_mask & ((GHR << 1) | (resolution == TAKEN ? 1 : 0));
 }
 
-uint16_t BPred::xor_12b(uint64_t pc, uint16_t ghr){
-    return ((1 << 12) - 1) & ((((1 << 12) - 1) & pc) ^ ghr);
+uint32_t BPred::PHT_index(uint64_t pc) const{
+    switch (config.hash){
+    case BPRED_HASH_FOLD:
+        return fold_bits(pc, pht_index_bits) ^ fold_bits(GHR, pht_index_bits);
+    case BPRED_HASH_CONCAT:
+        // The history fills the low ghr_bits bits and the PC the
+        // pht_index_bits - ghr_bits bits above them; the options are checked
+        // so the PC always gets at least one.
+        return pht_mask & ((pc << config.ghr_bits) | GHR);
+    default: // BPRED_HASH_XOR
+        // A history longer than the index is folded down rather than losing
+        // its oldest bits.
+        return pht_mask & (pc ^ (config.ghr_bits > pht_index_bits
+                                      ? fold_bits(GHR, pht_index_bits) : GHR));
+    }
 }
\ No newline at end of file
@@ -13,7 +13,20 @@
 #define _BPRED_H_
 
 #include <inttypes.h>
-#include <unordered_map>
+#include <stddef.h>
+
+/** Default number of global history bits used by gshare. */
+#define BPRED_DEFAULT_GHR_BITS 12
+/** Largest number of global history bits gshare can use. */
+#define BPRED_MAX_GHR_BITS 32
+/** Default number of 2-bit counters in the pattern history table. */
+#define BPRED_DEFAULT_PHT_SIZE 4096
+/** Smallest and largest number of counters in the pattern history table. */
+#define BPRED_MIN_PHT_SIZE 16
+#define BPRED_MAX_PHT_SIZE (1 << 28)
+/** Alignment of predictor tables, one cache line. */
+#define BPRED_TABLE_ALIGN 64
+
 /**
  * The possible branch prediction policies the simulator can use.
  * 
@@ -24,6 +37,9 @@ typedef enum BPredPolicyEnum
     BPRED_PERFECT,      // The branch predictor is (magically) always correct.
     BPRED_ALWAYS_TAKEN, // The branch predictor always predicts a branch taken.
     BPRED_GSHARE,       // The branch predictor uses the Gshare algorithm.
+    BPRED_TAGE,         // The branch predictor uses TAGE; see tage.h.
+    BPRED_PERCEPTRON,   // The branch predictor uses perceptrons; see perceptron.h.
+    BPRED_TOURNAMENT,   // The branch predictor chooses between bimodal and gshare.
     NUM_BPRED_POLICIES
 } BPredPolicy;
 
@@ -38,6 +54,55 @@ typedef enum BranchDirectionEnum
     TAKEN = 1      // The branch is taken.
 } BranchDirection;
 
+/** The components of the tournament predictor. */
+typedef enum BPredComponentEnum
+{
+    BPRED_COMP_BIMODAL, // 2-bit counters indexed by the PC alone.
+    BPRED_COMP_GSHARE,  // The gshare PHT.
+    NUM_BPRED_COMPONENTS
+} BPredComponent;
+
+/** Names of the tournament components, for printing. */
+extern const char *bpred_component_names[NUM_BPRED_COMPONENTS];
+
+/** How gshare combines the branch address and the global history. */
+typedef enum BPredHashEnum
+{
+    BPRED_HASH_XOR,    // Low PC bits XOR global history, folded if longer (gshare).
+    BPRED_HASH_FOLD,   // PC and history each XOR-folded to the index width.
+    BPRED_HASH_CONCAT, // Low PC bits followed by the history (gselect).
+    NUM_BPRED_HASHES
+} BPredHash;
+
+/** The geometry of a branch predictor. */
+typedef struct BPredConfigStruct
+{
+    /** The number of global history bits. */
+    uint32_t ghr_bits;
+    /** The number of 2-bit counters in the pattern history table. */
+    uint32_t pht_size;
+    /** How the table index is computed from the PC and the history. */
+    BPredHash hash;
+
+    /** The number of TAGE tagged tables. */
+    uint32_t tage_tables;
+    /** log2 of the number of entries in each TAGE tagged table. */
+    uint32_t tage_log_size;
+    /** The history lengths of the first and last TAGE tagged tables. */
+    uint32_t tage_min_hist;
+    uint32_t tage_max_hist;
+    /** The width of a TAGE tag in bits. */
+    uint32_t tage_tag_bits;
+
+    /** The number of global history bits each perceptron weighs. */
+    uint32_t perc_hist;
+    /** The number of perceptrons, a power of two. */
+    uint32_t perc_rows;
+} BPredConfig;
+
+class TagePredictor;
+class PerceptronPredictor;
+
 /**
  * A branch predictor.
  * 
@@ -55,8 +120,42 @@ public:
     uint64_t stat_num_branches;
     /** The number of branches this branch predictor has mispredicted. */
     uint64_t stat_num_mispred;
-    uint16_t GHR;
-    std::unordered_map<uint16_t, uint8_t> PHT;
+    /** The global history, most recent branch in bit 0. */
+    uint64_t GHR;
+    /**
+     * The pattern history table: 2-bit saturating counters packed four per
+     * byte, counter i in bits 2 * (i % 4) of byte i / 4. NULL unless the
+     * policy is gshare or tournament.
+     */
+    uint8_t *PHT;
+    /** The geometry of the predictor. */
+    BPredConfig config;
+    /** Mask of the GHR bits in use. */
+    uint64_t ghr_mask;
+    /** Mask of a PHT index, pht_size - 1. */
+    uint32_t pht_mask;
+    /** log2(pht_size). */
+    uint32_t pht_index_bits;
+    /** The TAGE predictor, if the policy is BPRED_TAGE. */
+    TagePredictor *tage;
+    /** The perceptron predictor, if the policy is BPRED_PERCEPTRON. */
+    PerceptronPredictor *perceptron;
+
+    /**
+     * The tournament predictor's bimodal table and chooser, packed like the
+     * PHT and indexed by the PC. A chooser counter of 2 or more picks gshare.
+     */
+    uint8_t *BIM;
+    uint8_t *CHOOSER;
+    /** Each component's prediction for the branch last predicted. */
+    BranchDirection last_component_pred[NUM_BPRED_COMPONENTS];
+    /** The number of branches each tournament component was chosen for. */
+    uint64_t stat_component_chosen[NUM_BPRED_COMPONENTS];
+    /** The number of branches each component predicted correctly, chosen or not. */
+    uint64_t stat_component_correct[NUM_BPRED_COMPONENTS];
+    /** The number of branches each component predicted correctly when chosen. */
+    uint64_t stat_component_chosen_correct[NUM_BPRED_COMPONENTS];
+
     /**
      * Construct a branch predictor with the given policy.
      * 
@@ -66,6 +165,16 @@ public:
      */
     BPred(BPredPolicy policy);
 
+    /**
+     * Construct a branch predictor with the given policy and geometry.
+     *
+     * @param policy the policy this branch predictor should use
+     * @param config the table sizes and index hash to use
+     */
+    BPred(BPredPolicy policy, const BPredConfig &config);
+
+    ~BPred();
+
     /**
      * Get a prediction for the branch with the given address.
      * 
@@ -90,13 +199,68 @@ public:
     void update(uint64_t pc, BranchDirection prediction,
                 BranchDirection resolution);
     
-    void PHT_update(uint16_t key, BranchDirection resolution);
+    void PHT_update(uint32_t key, BranchDirection resolution);
     uint8_t PHT_get_next_stage(uint8_t cur_val, BranchDirection res);
 
     void GHR_update(BranchDirection resolution);
-    uint16_t xor_12b(uint64_t pc, uint16_t ghr);
+
+    /** @return the PHT index of the branch at pc under the current GHR */
+    uint32_t PHT_index(uint64_t pc) const;
+
+    /** @return the 2-bit counter at index key */
+    inline uint8_t PHT_get(uint32_t key) const
+    {
+        return counter2_get(PHT, key);
+    }
+
+    /** Set the 2-bit counter at index key. */
+    inline void PHT_set(uint32_t key, uint8_t val)
+    {
+        counter2_set(PHT, key, val);
+    }
+
+    /** @return the 2-bit counter at index key of a packed table */
+    static inline uint8_t counter2_get(const uint8_t *table, uint32_t key)
+    {
+        return (table[key >> 2] >> ((key & 3) * 2)) & 3;
+    }
+
+    /** Set the 2-bit counter at index key of a packed table. */
+    static inline void counter2_set(uint8_t *table, uint32_t key, uint8_t val)
+    {
+        uint8_t shift = (key & 3) * 2;
+        table[key >> 2] = (table[key >> 2] & ~(3 << shift)) | (val << shift);
+    }
+
+private:
+    /** Set up the tables for the given geometry. */
+    void init(const BPredConfig &config);
+
+    /** @return a new table of num_counters packed 2-bit counters */
+    static uint8_t *alloc_counters(uint32_t num_counters);
+
+    // Predictors own their tables and are not copied.
+    BPred(const BPred &);
+    BPred &operator=(const BPred &);
 };
 
+/**
+ * The default geometry: a 4K-entry gshare with 12 bits of history, and the
+ * TAGE and perceptron tables described in tage.h and perceptron.h.
+ *
+ * @param config the geometry to fill in
+ */
+void bpred_default_config(BPredConfig *config);
+
+/**
+ * Parse the name of an index hash: xor, fold, or concat.
+ *
+ * @param name the name to parse
+ * @param hash receives the hash
+ * @return true if name is a known hash
+ */
+bool bpred_parse_hash(const char *name, BPredHash *hash);
+
 /**
  * Saturating increment: a utility function to increment a value by 1, stopping
  * at a given maximum value.
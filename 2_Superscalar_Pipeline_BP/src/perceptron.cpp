@@ -0,0 +1,206 @@
+// perceptron.cpp
+// Implements the perceptron branch predictor.
+//
+// The AVX2 kernels are compiled with per-function target attributes, so the
+// rest of the simulator needs no special compiler flags and still runs on CPUs
+// without AVX2. The kernel is picked once, on first use, from what the CPU
+// supports.
+
+#include "perceptron.h"
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Names of the kernels, indexed by PerceptronKernel. */
+static const char *perc_kernel_names[NUM_PERC_KERNELS] = {"scalar", "avx2"};
+
+/** The kernel selected by perceptron_set_kernel(), or NUM_PERC_KERNELS if none. */
+static PerceptronKernel perc_kernel = NUM_PERC_KERNELS;
+
+/** @return true if the CPU can run the given kernel */
+static bool perc_supported(PerceptronKernel kernel)
+{
+    __builtin_cpu_init();
+    switch (kernel)
+    {
+    case PERC_SCALAR:
+        return true;
+    case PERC_AVX2:
+        return __builtin_cpu_supports("avx2");
+    default:
+        return false;
+    }
+}
+
+/** @return the selected kernel, or the fastest supported one if unset */
+static PerceptronKernel perc_get_kernel()
+{
+    static const PerceptronKernel fastest = perc_supported(PERC_AVX2) ? PERC_AVX2 : PERC_SCALAR;
+    return perc_kernel != NUM_PERC_KERNELS ? perc_kernel : fastest;
+}
+
+bool perceptron_set_kernel(PerceptronKernel kernel)
+{
+    if (!perc_supported(kernel))
+    {
+        return false;
+    }
+    perc_kernel = kernel;
+    return true;
+}
+
+bool perceptron_parse_kernel(const char *name, PerceptronKernel *kernel)
+{
+    for (int i = 0; i < NUM_PERC_KERNELS; i++)
+    {
+        if (strcmp(name, perc_kernel_names[i]) == 0)
+        {
+            *kernel = (PerceptronKernel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @return the dot product of a row of weights and the inputs */
+static int32_t perc_dot_scalar(const int8_t *w, const int8_t *x, int len)
+{
+    int32_t y = 0;
+    for (int k = 0; k < len; k++)
+    {
+        y += w[k] * x[k];
+    }
+    return y;
+}
+
+/** Move every weight one step towards t * x, saturating at +/-PERC_MAX_WEIGHT. */
+static void perc_train_scalar(int8_t *w, const int8_t *x, int len, int t)
+{
+    for (int k = 0; k < len; k++)
+    {
+        int v = w[k] + t * x[k];
+        w[k] = v > PERC_MAX_WEIGHT ? PERC_MAX_WEIGHT : v < -PERC_MAX_WEIGHT ? -PERC_MAX_WEIGHT : v;
+    }
+}
+
+/**
+ * The dot product with AVX2, 32 weights at a time.
+ *
+ * The inputs are -1, 0, or +1, so the products are the weights with their
+ * sign flipped or cleared. The bytes are then summed in pairs into 16 bits by
+ * a multiply-add with 1, and in pairs again into 32 bits by another.
+ */
+__attribute__((target("avx2"))) static int32_t
+perc_dot_avx2(const int8_t *w, const int8_t *x, int len)
+{
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i ones16 = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    for (int k = 0; k < len; k += 32)
+    {
+        __m256i prod = _mm256_sign_epi8(_mm256_load_si256((const __m256i *)(w + k)),
+                                        _mm256_load_si256((const __m256i *)(x + k)));
+        __m256i sums16 = _mm256_maddubs_epi16(ones8, prod);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(sums16, ones16));
+    }
+
+    __m128i sums = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sums);
+}
+
+/** Training with AVX2: a saturating add of the signed inputs, clamped at -127. */
+__attribute__((target("avx2"))) static void
+perc_train_avx2(int8_t *w, const int8_t *x, int len, int t)
+{
+    const __m256i sign = _mm256_set1_epi8(t);
+    const __m256i min = _mm256_set1_epi8(-PERC_MAX_WEIGHT);
+    for (int k = 0; k < len; k += 32)
+    {
+        __m256i step = _mm256_sign_epi8(_mm256_load_si256((const __m256i *)(x + k)), sign);
+        __m256i v = _mm256_adds_epi8(_mm256_load_si256((const __m256i *)(w + k)), step);
+        _mm256_store_si256((__m256i *)(w + k), _mm256_max_epi8(v, min));
+    }
+}
+
+/** @return a zeroed allocation of size bytes aligned to PERC_ROW_ALIGN */
+static int8_t *perc_alloc(size_t size)
+{
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, PERC_ROW_ALIGN, size) != 0)
+    {
+        perror("Couldn't allocate perceptron tables");
+        exit(1);
+    }
+    memset(ptr, 0, size);
+    return (int8_t *)ptr;
+}
+
+PerceptronPredictor::PerceptronPredictor(const BPredConfig &config)
+    : hist_len(config.perc_hist), last_pc(0), last_row(0), last_y(0)
+{
+    row_len = (hist_len + 1 + PERC_ROW_ALIGN - 1) & ~(PERC_ROW_ALIGN - 1);
+    row_mask = config.perc_rows - 1;
+    row_bits = __builtin_ctz(config.perc_rows);
+    threshold = (int32_t)(1.93 * hist_len + 14);
+
+    weights = perc_alloc((size_t)config.perc_rows * row_len);
+    hist = perc_alloc(row_len);
+
+    // The bias input is always 1, and the history starts not taken. The
+    // padding stays 0 and adds nothing to the dot product.
+    hist[0] = 1;
+    for (int k = 1; k <= hist_len; k++)
+    {
+        hist[k] = -1;
+    }
+}
+
+PerceptronPredictor::~PerceptronPredictor()
+{
+    free(weights);
+    free(hist);
+}
+
+BranchDirection PerceptronPredictor::predict(uint64_t pc)
+{
+    last_pc = pc;
+    last_row = row_of(pc);
+    const int8_t *w = weights + (size_t)last_row * row_len;
+    last_y = perc_get_kernel() == PERC_AVX2 ? perc_dot_avx2(w, hist, row_len)
+                                            : perc_dot_scalar(w, hist, row_len);
+    return last_y >= 0 ? TAKEN : NOT_TAKEN;
+}
+
+void PerceptronPredictor::update(uint64_t pc, BranchDirection resolution)
+{
+    if (pc != last_pc)
+    {
+        // update() without a matching predict(): compute y again.
+        predict(pc);
+    }
+
+    int t = (resolution == TAKEN) ? 1 : -1;
+    bool mispredicted = (last_y >= 0) != (t > 0);
+    if (mispredicted || abs(last_y) <= threshold)
+    {
+        int8_t *w = weights + (size_t)last_row * row_len;
+        if (perc_get_kernel() == PERC_AVX2)
+        {
+            perc_train_avx2(w, hist, row_len, t);
+        }
+        else
+        {
+            perc_train_scalar(w, hist, row_len, t);
+        }
+    }
+
+    // Shift the outcome into the history, behind the bias input.
+    memmove(hist + 2, hist + 1, hist_len - 1);
+    hist[1] = t;
+
+    // The next update() needs a fresh prediction.
+    last_pc = ~pc;
+}
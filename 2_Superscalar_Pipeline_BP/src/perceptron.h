@@ -0,0 +1,121 @@
+// perceptron.h
+// Declares a perceptron branch predictor (Jimenez and Lin, "Dynamic branch
+// prediction with perceptrons", HPCA 2001), with scalar and AVX2 kernels
+// picked at run time.
+
+#ifndef _PERCEPTRON_H_
+#define _PERCEPTRON_H_
+
+#include "bpred.h"
+#include <inttypes.h>
+
+/** Default number of global history bits each perceptron weighs. */
+#define PERC_DEFAULT_HIST 63
+/** Largest number of global history bits. */
+#define PERC_MAX_HIST 255
+/** Default and largest number of perceptrons. */
+#define PERC_DEFAULT_ROWS 256
+#define PERC_MAX_ROWS (1 << 20)
+/** Weights saturate at +/-PERC_MAX_WEIGHT, symmetric so negation never overflows. */
+#define PERC_MAX_WEIGHT 127
+/** Rows are padded to a multiple of one AVX2 vector. */
+#define PERC_ROW_ALIGN 32
+
+/** The implementations of the dot product and training kernels. */
+typedef enum PerceptronKernelEnum
+{
+    PERC_SCALAR, // Portable C++
+    PERC_AVX2,   // 32 weights at a time
+    NUM_PERC_KERNELS
+} PerceptronKernel;
+
+/**
+ * Select the kernel used by every perceptron predictor.
+ *
+ * By default the fastest kernel the CPU supports is used. Every kernel gives
+ * exactly the same predictions.
+ *
+ * @param kernel the kernel to use
+ * @return true on success, or false if the CPU does not support the kernel
+ */
+bool perceptron_set_kernel(PerceptronKernel kernel);
+
+/**
+ * Look up a kernel by its name: "scalar" or "avx2".
+ *
+ * @param name the name of the kernel
+ * @param kernel receives the kernel
+ * @return true on success, or false if there is no kernel with that name
+ */
+bool perceptron_parse_kernel(const char *name, PerceptronKernel *kernel);
+
+/**
+ * A perceptron predictor.
+ *
+ * Each branch address hashes to a row of int8 weights: a bias weight followed
+ * by one weight per bit of global history. The global history is kept as a
+ * matching row of +1 (taken) and -1 (not taken), with +1 for the bias and 0
+ * in the padding, so the output y is the dot product of the two rows and
+ * predicts taken when it is not negative. Rows are padded to 32 weights, and
+ * the AVX2 kernel multiplies with a sign operation and sums with two
+ * multiply-add instructions per 32 weights.
+ *
+ * After a misprediction, or when |y| is at most the training threshold
+ * floor(1.93 * hist + 14), every weight moves one step towards agreeing with
+ * the outcome.
+ *
+ * predict() records y, and update() must follow for the same branch before
+ * the next predict().
+ */
+class PerceptronPredictor
+{
+public:
+    /**
+     * @param config the geometry: perc_hist history bits and perc_rows
+     * perceptrons
+     */
+    PerceptronPredictor(const BPredConfig &config);
+    ~PerceptronPredictor();
+
+    /** @return the prediction for the branch at pc */
+    BranchDirection predict(uint64_t pc);
+
+    /**
+     * Train the perceptron of the branch last predicted and shift its outcome
+     * into the history.
+     *
+     * @param pc the address of the branch
+     * @param resolution the outcome of the branch
+     */
+    void update(uint64_t pc, BranchDirection resolution);
+
+private:
+    int hist_len;
+    /** Weights per row, hist_len + 1 rounded up to PERC_ROW_ALIGN. */
+    int row_len;
+    uint32_t row_mask;
+    uint32_t row_bits;
+    int32_t threshold;
+
+    /** The weights, row after row. */
+    int8_t *weights;
+    /** The bias input and global history as +1/-1, newest outcome at [1]. */
+    int8_t *hist;
+
+    // The last prediction, reused by update().
+    uint64_t last_pc;
+    uint32_t last_row;
+    int32_t last_y;
+
+    /** @return the row of the branch at pc */
+    uint32_t row_of(uint64_t pc) const
+    {
+        return (pc ^ (pc >> row_bits)) & row_mask;
+    }
+
+    // Predictors own their tables and are not copied.
+    PerceptronPredictor(const PerceptronPredictor &);
+    PerceptronPredictor &operator=(const PerceptronPredictor &);
+};
+
+#endif
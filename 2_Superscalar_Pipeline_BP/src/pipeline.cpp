@@ -11,11 +11,33 @@
 #include "pipeline.h"
 #include <cstdlib>
 #include <stdio.h>
-#include <unistd.h>
+
+static_assert((PIPE_RING_SIZE & (PIPE_RING_SIZE - 1)) == 0 &&
+                  PIPE_RING_SIZE >= NUM_LATCH_TYPES * MAX_PIPE_WIDTH,
+              "the operation ring must hold every instruction in flight");
 
 /**
- * Read a single trace record from the trace file and use it to populate the
- * given fetch_op.
+ * The stage functions are templates on the pipeline width W, compiled for
+ * widths 1, 2, 4, and 8 so that the loops over lanes have a constant trip
+ * count, and for W = 0 to handle any other width at run time. pipe_init()
+ * picks one set, and pipe_cycle() calls it through Pipeline::cycle_stages.
+ * 
+ * @return the number of lanes the stage functions for W simulate
+ */
+template <unsigned int W>
+static inline unsigned int pipe_lanes()
+{
+    return W != 0 ? W : PIPE_WIDTH;
+}
+
+template <unsigned int W>
+static void pipe_cycle_stages(Pipeline *p);
+template <unsigned int W>
+void pipe_check_bpred(Pipeline *p, PipelineLatch *fetch_op, unsigned int i);
+
+/**
+ * Take the next trace record from the trace reader into the next slot of the
+ * operation ring, and point the given fetch_op at it.
  * 
  * You should not modify this function.
  * 
@@ -24,29 +46,11 @@
  */
 void pipe_get_fetch_op(Pipeline *p, PipelineLatch *fetch_op)
 {
-    TraceRec *trace_rec = &fetch_op->trace_rec;
-    uint8_t *trace_rec_buf = (uint8_t *)trace_rec;
-    size_t bytes_read_total = 0;
-    ssize_t bytes_read_last = 0;
-    size_t bytes_left = sizeof(*trace_rec);
-
-    // Read a total of sizeof(TraceRec) bytes from the trace file.
-    while (bytes_left > 0)
-    {
-        bytes_read_last = read(p->trace_fd, trace_rec_buf, bytes_left);
-        if (bytes_read_last <= 0)
-        {
-            // EOF or error
-            break;
-        }
-
-        trace_rec_buf += bytes_read_last;
-        bytes_read_total += bytes_read_last;
-        bytes_left -= bytes_read_last;
-    }
+    uint8_t slot = (p->last_op_id + 1) & (PIPE_RING_SIZE - 1);
+    TraceRingStatus status = tracering_next(p->trace_ring, &p->ops[slot].trace_rec);
 
     // Check for error conditions.
-    if (bytes_left > 0 || trace_rec->op_type >= NUM_OP_TYPES)
+    if (status != TRACERING_OK)
     {
         fetch_op->valid = false;
         p->halt_op_id = p->last_op_id;
@@ -56,14 +60,14 @@ void pipe_get_fetch_op(Pipeline *p, PipelineLatch *fetch_op)
             p->halt = true;
         }
 
-        if (bytes_read_last == -1)
+        if (status == TRACERING_READ_ERROR)
         {
             fprintf(stderr, "\n");
             perror("Couldn't read from pipe");
             return;
         }
 
-        if (bytes_read_total == 0)
+        if (status == TRACERING_END)
         {
             // No more trace records to read
             return;
@@ -79,7 +83,8 @@ void pipe_get_fetch_op(Pipeline *p, PipelineLatch *fetch_op)
     fetch_op->valid = true;
     fetch_op->stall = false;
     fetch_op->is_mispred_cbr = false;
-    fetch_op->op_id = ++p->last_op_id;
+    fetch_op->slot = slot;
+    p->ops[slot].op_id = ++p->last_op_id;
 }
 
 /**
@@ -99,17 +104,54 @@ Pipeline *pipe_init(int trace_fd)
 
     // Initialize pipeline.
     p->trace_fd = trace_fd;
+    p->trace_ring = tracering_open(trace_fd);
+    if (p->trace_ring == NULL)
+    {
+        fprintf(stderr, "Error: couldn't start the trace reader\n");
+        exit(1);
+    }
     p->halt_op_id = (uint64_t)(-1) - 3;
 
     // Allocate and initialize a branch predictor if needed.
     if (BPRED_POLICY != BPRED_PERFECT)
     {
-        p->b_pred = new BPred(BPRED_POLICY);
+        p->b_pred = new BPred(BPRED_POLICY, BPRED_CONFIG);
+    }
+
+    // Use the stage functions compiled for this width, if there are any.
+    switch (PIPE_WIDTH)
+    {
+    case 1:
+        p->cycle_stages = pipe_cycle_stages<1>;
+        break;
+    case 2:
+        p->cycle_stages = pipe_cycle_stages<2>;
+        break;
+    case 4:
+        p->cycle_stages = pipe_cycle_stages<4>;
+        break;
+    case 8:
+        p->cycle_stages = pipe_cycle_stages<8>;
+        break;
+    default:
+        p->cycle_stages = pipe_cycle_stages<0>;
+        break;
     }
 
     return p;
 }
 
+/**
+ * Stop reading the trace file. Call this before closing it.
+ * 
+ * @param p the pipeline
+ */
+void pipe_close_trace(Pipeline *p)
+{
+    tracering_close(p->trace_ring);
+    p->trace_ring = NULL;
+}
+
 /**
  * Print out the state of the pipeline latches for debugging purposes.
  * 
@@ -157,7 +199,7 @@ void pipe_print_state(Pipeline *p)
             if (p->pipe_latch[latch_type][i].valid)
             {
                 printf(" %6lu ",
-                       (unsigned long)p->pipe_latch[latch_type][i].op_id);
+                       (unsigned long)pipe_latch_op(p, &p->pipe_latch[latch_type][i])->op_id);
             }
             else
             {
@@ -195,11 +237,7 @@ void pipe_cycle(Pipeline *p)
     // stalls triggered in later pipeline stages in the same cycle, as would be
     // the case with hardware stall signals asserted by combinational logic.
 
-    pipe_cycle_WB(p);
-    pipe_cycle_MA(p);
-    pipe_cycle_EX(p);
-    pipe_cycle_ID(p);
-    pipe_cycle_IF(p);
+    p->cycle_stages(p);
 
     // You can uncomment the following line to print out the pipeline state
     // after each clock cycle for debugging purposes.
@@ -215,21 +253,23 @@ void pipe_cycle(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
+template <unsigned int W>
 void pipe_cycle_WB(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
     {
         if (p->pipe_latch[MA_LATCH][i].valid)
         {
+            const PipelineOp *op = pipe_latch_op(p, &p->pipe_latch[MA_LATCH][i]);
             p->stat_retired_inst++;
 
-            if (p->pipe_latch[MA_LATCH][i].op_id >= p->halt_op_id)
+            if (op->op_id >= p->halt_op_id)
             {
                 // Halt the pipeline if we've reached the end of the trace.
                 p->halt = true;
             }
-            if ((p->pipe_latch[MA_LATCH][i].trace_rec.op_type == 3) && p->pipe_latch[MA_LATCH][i].is_mispred_cbr){
-                for( unsigned int j = 0; j < PIPE_WIDTH; j ++){
+            if ((op->trace_rec.op_type == 3) && p->pipe_latch[MA_LATCH][i].is_mispred_cbr){
+                for( unsigned int j = 0; j < pipe_lanes<W>(); j ++){
                     p->pipe_latch[IF_LATCH][j].is_mispred_cbr = false;
                 }
                 #ifdef VERBOSE
@@ -241,6 +281,104 @@ void pipe_cycle_WB(Pipeline *p)
     }
 }
 
+/**
+ * Record an instruction entering EX as the writer of its destination register
+ * and condition code, if it is younger than the writers already recorded.
+ * 
+ * @param p the pipeline
+ * @param op the instruction entering EX
+ */
+static void scoreboard_issue(Pipeline *p, const PipelineOp *op)
+{
+    if (op->trace_rec.dest_needed && op->op_id > p->reg_producer[op->trace_rec.dest_reg].op_id)
+    {
+        ProducerEntry *e = &p->reg_producer[op->trace_rec.dest_reg];
+        e->op_id = op->op_id;
+        e->op_type = op->trace_rec.op_type;
+        e->latch = EX_LATCH;
+    }
+    if (op->trace_rec.cc_write && op->op_id > p->cc_producer.op_id)
+    {
+        p->cc_producer.op_id = op->op_id;
+        p->cc_producer.op_type = op->trace_rec.op_type;
+        p->cc_producer.latch = EX_LATCH;
+    }
+}
+
+/**
+ * Move the scoreboard entries of an instruction to a new latch, or clear them
+ * when it leaves the pipeline. Entries already taken over by a younger writer
+ * are left alone.
+ * 
+ * @param p the pipeline
+ * @param op the instruction that moved
+ * @param latch the latch it moved to, or NUM_LATCH_TYPES if it retired
+ */
+static void scoreboard_move(Pipeline *p, const PipelineOp *op, uint8_t latch)
+{
+    if (op->trace_rec.dest_needed && p->reg_producer[op->trace_rec.dest_reg].op_id == op->op_id)
+    {
+        ProducerEntry *e = &p->reg_producer[op->trace_rec.dest_reg];
+        e->latch = latch;
+        e->op_id = latch == NUM_LATCH_TYPES ? 0 : e->op_id;
+    }
+    if (op->trace_rec.cc_write && p->cc_producer.op_id == op->op_id)
+    {
+        p->cc_producer.latch = latch;
+        p->cc_producer.op_id = latch == NUM_LATCH_TYPES ? 0 : p->cc_producer.op_id;
+    }
+}
+
+/**
+ * Find the youngest writer older than an instruction in ID of a register or
+ * the condition code: an older instruction in ID checked this cycle, or else
+ * the youngest writer in EX or MA.
+ * 
+ * @param p the pipeline
+ * @param id_entry the ID latch scoreboard entry
+ * @param entry the EX and MA scoreboard entry
+ * @param op_id the op_id of the reader
+ * @return the writer, or NULL if there is none in flight
+ */
+static const ProducerEntry *scoreboard_lookup(const Pipeline *p, const ProducerEntry *id_entry,
+                                              const ProducerEntry *entry, uint64_t op_id)
+{
+    if (id_entry->cycle == p->stat_num_cycle && id_entry->op_id < op_id)
+    {
+        return id_entry;
+    }
+    return entry->op_id != 0 ? entry : NULL;
+}
+
+/**
+ * Decide whether a dependency on a writer forces the reader to stall, given
+ * the forwarding paths that are enabled.
+ * 
+ * @param producer the writer, or NULL if there is none
+ * @return true if the reader must stall
+ */
+static bool scoreboard_must_stall(const ProducerEntry *producer)
+{
+    if (producer == NULL)
+    {
+        return false;
+    }
+
+    switch (producer->latch)
+    {
+    case MA_LATCH:
+        // We can forward any dependency from the MA_LATCH.
+        return !ENABLE_MEM_FWD;
+    case EX_LATCH:
+        // We can only forward dependencies from the EX_LATCH if the
+        // dependency is not a load instruction.
+        return !ENABLE_EXE_FWD || producer->op_type == OP_LD;
+    default:
+        // We can never forward dependencies from the ID_LATCH.
+        return true;
+    }
+}
+
 /**
  * Simulate one cycle of the Memory Access stage (MA) of a pipeline.
  * 
@@ -249,13 +387,26 @@ void pipe_cycle_WB(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
+template <unsigned int W>
 void pipe_cycle_MA(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
+    {
+        // The instruction in the MA latch has been written back.
+        if (p->pipe_latch[MA_LATCH][i].valid)
+        {
+            scoreboard_move(p, pipe_latch_op(p, &p->pipe_latch[MA_LATCH][i]), NUM_LATCH_TYPES);
+        }
+    }
+
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
     {
         // Copy each instruction from the EX latch to the MA latch.
         p->pipe_latch[MA_LATCH][i] = p->pipe_latch[EX_LATCH][i];
-        
+        if (p->pipe_latch[MA_LATCH][i].valid)
+        {
+            scoreboard_move(p, pipe_latch_op(p, &p->pipe_latch[MA_LATCH][i]), MA_LATCH);
+        }
     }
 }
 
@@ -267,12 +418,17 @@ void pipe_cycle_MA(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
+template <unsigned int W>
 void pipe_cycle_EX(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
     {
         // Copy each instruction from the ID latch to the EX latch.
         p->pipe_latch[EX_LATCH][i] = p->pipe_latch[ID_LATCH][i];
+        if (p->pipe_latch[EX_LATCH][i].valid)
+        {
+            scoreboard_issue(p, pipe_latch_op(p, &p->pipe_latch[EX_LATCH][i]));
+        }
     }
 }
 
@@ -284,16 +440,15 @@ void pipe_cycle_EX(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
+template <unsigned int W>
 void pipe_cycle_ID(Pipeline *p)
 {
-    // Bookkeeping information:
-    // Is any instruction in the ID latch being stalled this cycle?
-    bool is_instruction_stalled_this_cycle = false;
-    // What is the op_id of the oldest instruction stalled this cycle?
-    uint64_t oldest_op_id_stalled = 0;
+    // The valid lanes of the ID latch, oldest instruction first.
+    unsigned int order[MAX_PIPE_WIDTH];
+    unsigned int num_valid = 0;
 
     // For each lane of the superscalar pipeline:
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
     {
         // Copy each instruction from the IF latch to the ID latch.
         p->pipe_latch[ID_LATCH][i] = p->pipe_latch[IF_LATCH][i];
@@ -301,353 +456,83 @@ void pipe_cycle_ID(Pipeline *p)
         // If this lane of IF was previously stalled, clear its stall flag.
         // We will re-stall if needed according to the stall logic below.
         p->pipe_latch[IF_LATCH][i].stall = false;
-    }
 
-    // Check for stall conditions for each instruction in the ID latch.
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
-    {
         if (!p->pipe_latch[ID_LATCH][i].valid)
         {
             // There is no instruction in this lane. Skip stall checks.
             continue;
         }
 
-        // Identify each dependency of this instruction that could potentially
-        // cause a RAW hazard.
-
-        bool found_src1_dependency = false;
-        LatchType src1_dependency_in_latch = (LatchType)(0);
-        uint64_t src1_dependency_op_id = 0;
-        uint8_t src1_dependency_op_type = 0;
-
-        bool found_src2_dependency = false;
-        LatchType src2_dependency_in_latch = (LatchType)(0);
-        uint64_t src2_dependency_op_id = 0;
-        uint8_t src2_dependency_op_type = 0;
-
-        bool found_cc_dependency = false;
-        LatchType cc_dependency_in_latch = (LatchType)(0);
-        uint64_t cc_dependency_op_id = 0;
-        uint8_t cc_dependency_op_type = 0;
-
-        // Check each lane of MA_LATCH, EX_LATCH, and ID_LATCH for potential
-        // dependencies.
-        for (unsigned int j = 0; j < PIPE_WIDTH; j++)
-        {
-            if (p->pipe_latch[MA_LATCH][j].valid)
-            {
-                // There is an instruction in lane j of the MA_LATCH.
-                // Could it cause a RAW hazard?
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src1_needed &&
-                    p->pipe_latch[MA_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src1_reg == p->pipe_latch[MA_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src1.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src1_dependency || p->pipe_latch[MA_LATCH][j].op_id > src1_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src1_dependency = true;
-                        src1_dependency_in_latch = MA_LATCH;
-                        src1_dependency_op_id = p->pipe_latch[MA_LATCH][j].op_id;
-                        src1_dependency_op_type = p->pipe_latch[MA_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src2_needed &&
-                    p->pipe_latch[MA_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src2_reg == p->pipe_latch[MA_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src2.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src2_dependency || p->pipe_latch[MA_LATCH][j].op_id > src2_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src2_dependency = true;
-                        src2_dependency_in_latch = MA_LATCH;
-                        src2_dependency_op_id = p->pipe_latch[MA_LATCH][j].op_id;
-                        src2_dependency_op_type = p->pipe_latch[MA_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.cc_read &&
-                    p->pipe_latch[MA_LATCH][j].trace_rec.cc_write)
-                {
-                    // We found a dependency for this instruction's cc.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_cc_dependency || p->pipe_latch[MA_LATCH][j].op_id > cc_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_cc_dependency = true;
-                        cc_dependency_in_latch = MA_LATCH;
-                        cc_dependency_op_id = p->pipe_latch[MA_LATCH][j].op_id;
-                        cc_dependency_op_type = p->pipe_latch[MA_LATCH][j].trace_rec.op_type;
-                    }
-                }
-            }
-
-            if (p->pipe_latch[EX_LATCH][j].valid)
-            {
-                // There is an instruction in lane j of the EX_LATCH.
-                // Could it cause a RAW hazard?
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src1_needed &&
-                    p->pipe_latch[EX_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src1_reg == p->pipe_latch[EX_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src1.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src1_dependency || p->pipe_latch[EX_LATCH][j].op_id > src1_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src1_dependency = true;
-                        src1_dependency_in_latch = EX_LATCH;
-                        src1_dependency_op_id = p->pipe_latch[EX_LATCH][j].op_id;
-                        src1_dependency_op_type = p->pipe_latch[EX_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src2_needed &&
-                    p->pipe_latch[EX_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src2_reg == p->pipe_latch[EX_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src2.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src2_dependency || p->pipe_latch[EX_LATCH][j].op_id > src2_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src2_dependency = true;
-                        src2_dependency_in_latch = EX_LATCH;
-                        src2_dependency_op_id = p->pipe_latch[EX_LATCH][j].op_id;
-                        src2_dependency_op_type = p->pipe_latch[EX_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.cc_read &&
-                    p->pipe_latch[EX_LATCH][j].trace_rec.cc_write)
-                {
-                    // We found a dependency for this instruction's cc.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_cc_dependency || p->pipe_latch[EX_LATCH][j].op_id > cc_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_cc_dependency = true;
-                        cc_dependency_in_latch = EX_LATCH;
-                        cc_dependency_op_id = p->pipe_latch[EX_LATCH][j].op_id;
-                        cc_dependency_op_type = p->pipe_latch[EX_LATCH][j].trace_rec.op_type;
-                    }
-                }
-            }
-
-            if (p->pipe_latch[ID_LATCH][j].valid &&
-                p->pipe_latch[ID_LATCH][j].op_id < p->pipe_latch[ID_LATCH][i].op_id)
-            {
-                // There is an older instruction in lane j of the ID_LATCH.
-                // Could it cause a RAW hazard?
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src1_needed &&
-                    p->pipe_latch[ID_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src1_reg == p->pipe_latch[ID_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src1.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src1_dependency || p->pipe_latch[ID_LATCH][j].op_id > src1_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src1_dependency = true;
-                        src1_dependency_in_latch = ID_LATCH;
-                        src1_dependency_op_id = p->pipe_latch[ID_LATCH][j].op_id;
-                        src1_dependency_op_type = p->pipe_latch[ID_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.src2_needed &&
-                    p->pipe_latch[ID_LATCH][j].trace_rec.dest_needed &&
-                    p->pipe_latch[ID_LATCH][i].trace_rec.src2_reg == p->pipe_latch[ID_LATCH][j].trace_rec.dest_reg)
-                {
-                    // We found a dependency for this instruction's src2.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_src2_dependency || p->pipe_latch[ID_LATCH][j].op_id > src2_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_src2_dependency = true;
-                        src2_dependency_in_latch = ID_LATCH;
-                        src2_dependency_op_id = p->pipe_latch[ID_LATCH][j].op_id;
-                        src2_dependency_op_type = p->pipe_latch[ID_LATCH][j].trace_rec.op_type;
-                    }
-                }
-
-                if (p->pipe_latch[ID_LATCH][i].trace_rec.cc_read &&
-                    p->pipe_latch[ID_LATCH][j].trace_rec.cc_write)
-                {
-                    // We found a dependency for this instruction's cc.
-                    // Is it the youngest dependency we've found so far?
-                    if (!found_cc_dependency || p->pipe_latch[ID_LATCH][j].op_id > cc_dependency_op_id)
-                    {
-                        // Yes, it is!
-                        found_cc_dependency = true;
-                        cc_dependency_in_latch = ID_LATCH;
-                        cc_dependency_op_id = p->pipe_latch[ID_LATCH][j].op_id;
-                        cc_dependency_op_type = p->pipe_latch[ID_LATCH][j].trace_rec.op_type;
-                    }
-                }
-            }
-        }
-
-        // We have now identified the dependencies for this instruction.
-        // Do any of them require us to stall?
-
-        bool should_stall_for_src1 = false;
-        bool should_stall_for_src2 = false;
-        bool should_stall_for_cc = false;
-
-        if (found_src1_dependency)
+        // Insert this lane into the order by op_id. Lanes are not in program
+        // order once some of them have stalled.
+        uint64_t op_id = pipe_latch_op(p, &p->pipe_latch[ID_LATCH][i])->op_id;
+        unsigned int k = num_valid++;
+        while (k > 0 && pipe_latch_op(p, &p->pipe_latch[ID_LATCH][order[k - 1]])->op_id > op_id)
         {
-            if (src1_dependency_in_latch == MA_LATCH)
-            {
-                if (ENABLE_MEM_FWD)
-                {
-                    // We can forward any dependency from the MA_LATCH.
-                    // No need to stall for this dependency.
-                }
-                else
-                {
-                    should_stall_for_src1 = true;
-                }
-            }
-
-            if (src1_dependency_in_latch == EX_LATCH)
-            {
-                if (ENABLE_EXE_FWD)
-                {
-                    // We can only forward dependencies from the EX_LATCH if
-                    // the dependency is not a load instruction.
-                    should_stall_for_src1 = (src1_dependency_op_type == OP_LD);
-                }
-                else
-                {
-                    should_stall_for_src1 = true;
-                }
-            }
-
-            if (src1_dependency_in_latch == ID_LATCH)
-            {
-                // We can never forward dependencies from the ID_LATCH.
-                // We must always stall.
-                should_stall_for_src1 = true;
-            }
+            order[k] = order[k - 1];
+            k--;
         }
+        order[k] = i;
+    }
 
-        if (found_src2_dependency)
-        {
-            if (src2_dependency_in_latch == MA_LATCH)
-            {
-                if (ENABLE_MEM_FWD)
-                {
-                    // We can forward any dependency from the MA_LATCH.
-                    // No need to stall for this dependency.
-                }
-                else
-                {
-                    should_stall_for_src2 = true;
-                }
-            }
-
-            if (src2_dependency_in_latch == EX_LATCH)
-            {
-                if (ENABLE_EXE_FWD)
-                {
-                    // We can only forward dependencies from the EX_LATCH if
-                    // the dependency is not a load instruction.
-                    should_stall_for_src2 = (src2_dependency_op_type == OP_LD);
-                }
-                else
-                {
-                    should_stall_for_src2 = true;
-                }
-            }
-
-            if (src2_dependency_in_latch == ID_LATCH)
-            {
-                // We can never forward dependencies from the ID_LATCH.
-                // We must always stall.
-                should_stall_for_src2 = true;
-            }
-        }
+    // Check for stall conditions for each instruction in the ID latch, oldest
+    // first, so that the older instructions in ID are in the ID scoreboard by
+    // the time a younger one looks up its sources.
+    bool is_instruction_stalled_this_cycle = false;
+    for (unsigned int k = 0; k < num_valid; k++)
+    {
+        PipelineLatch *latch = &p->pipe_latch[ID_LATCH][order[k]];
+        const PipelineOp *op = pipe_latch_op(p, latch);
 
-        if (found_cc_dependency)
+        if (!is_instruction_stalled_this_cycle)
         {
-            if (cc_dependency_in_latch == MA_LATCH)
-            {
-                if (ENABLE_MEM_FWD)
-                { 
-                    // We can forward any dependency from the MA_LATCH.
-                    // No need to stall for this dependency.
-                }
-                else
-                {
-                    should_stall_for_cc = true;
-                }
-            }
-
-            if (cc_dependency_in_latch == EX_LATCH)
-            {
-                if (ENABLE_EXE_FWD)
-                {
-                    // We can only forward dependencies from the EX_LATCH if
-                    // the dependency is not a load instruction.
-                    should_stall_for_cc = (cc_dependency_op_type == OP_LD);
-                }
-                else
-                {
-                    should_stall_for_cc = true;
-                }
-            }
-
-            if (cc_dependency_in_latch == ID_LATCH)
-            {
-                // We can never forward dependencies from the ID_LATCH.
-                // We must always stall.
-                should_stall_for_cc = true;
-            }
+            // Look up the youngest older writer of each source of this
+            // instruction. Do any of them require us to stall?
+            const TraceRec *rec = &op->trace_rec;
+            bool should_stall_for_src1 =
+                rec->src1_needed &&
+                scoreboard_must_stall(scoreboard_lookup(p, &p->id_reg_producer[rec->src1_reg],
+                                                        &p->reg_producer[rec->src1_reg], op->op_id));
+            bool should_stall_for_src2 =
+                rec->src2_needed &&
+                scoreboard_must_stall(scoreboard_lookup(p, &p->id_reg_producer[rec->src2_reg],
+                                                        &p->reg_producer[rec->src2_reg], op->op_id));
+            bool should_stall_for_cc =
+                rec->cc_read &&
+                scoreboard_must_stall(scoreboard_lookup(p, &p->id_cc_producer, &p->cc_producer,
+                                                        op->op_id));
+            is_instruction_stalled_this_cycle =
+                should_stall_for_src1 || should_stall_for_src2 || should_stall_for_cc;
         }
 
-        // Finally, we know if we need to stall this instruction due to any of
-        // its dependencies.
-        if (should_stall_for_src1 || should_stall_for_src2 || should_stall_for_cc)
+        if (is_instruction_stalled_this_cycle)
         {
-            // Update bookkeeping information.
-            if (!is_instruction_stalled_this_cycle ||
-                p->pipe_latch[ID_LATCH][i].op_id < oldest_op_id_stalled)
-            {
-                oldest_op_id_stalled = p->pipe_latch[ID_LATCH][i].op_id;
-            }
-            is_instruction_stalled_this_cycle = true;
+            // Enforce in-order execution by stalling this instruction and
+            // every younger one.
 
             // Insert a bubble into the ID/EX latch.
-            p->pipe_latch[ID_LATCH][i].valid = false;
+            latch->valid = false;
 
             // Tell the IF stage to stall this lane.
-            p->pipe_latch[IF_LATCH][i].stall = true;
+            p->pipe_latch[IF_LATCH][order[k]].stall = true;
+            continue;
         }
-    }
 
-    if (is_instruction_stalled_this_cycle)
-    {
-        // Enforce in-order execution by stalling any remaining instructions
-        // younger than the oldest one stalled.
-        for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+        // This instruction proceeds. Record it as the youngest writer in ID.
+        if (op->trace_rec.dest_needed)
         {
-            if (p->pipe_latch[ID_LATCH][i].valid &&
-                p->pipe_latch[ID_LATCH][i].op_id > oldest_op_id_stalled)
-            {
-                // Insert a bubble into the ID/EX latch.
-                p->pipe_latch[ID_LATCH][i].valid = false;
-
-                // Tell the IF stage to stall this lane.
-                p->pipe_latch[IF_LATCH][i].stall = true;
-            }
+            ProducerEntry *e = &p->id_reg_producer[op->trace_rec.dest_reg];
+            e->op_id = op->op_id;
+            e->op_type = op->trace_rec.op_type;
+            e->latch = ID_LATCH;
+            e->cycle = p->stat_num_cycle;
+        }
+        if (op->trace_rec.cc_write)
+        {
+            p->id_cc_producer.op_id = op->op_id;
+            p->id_cc_producer.op_type = op->trace_rec.op_type;
+            p->id_cc_producer.latch = ID_LATCH;
+            p->id_cc_producer.cycle = p->stat_num_cycle;
         }
     }
 }
@@ -660,9 +545,10 @@ void pipe_cycle_ID(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
+template <unsigned int W>
 void pipe_cycle_IF(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < pipe_lanes<W>(); i++)
     {
         if (p->pipe_latch[IF_LATCH][i].stall)
         {
@@ -687,9 +573,9 @@ void pipe_cycle_IF(Pipeline *p)
                 std::cout << "FETCH\n";
             #endif
             // Handle branch (mis)prediction.
-            if (BPRED_POLICY != BPRED_PERFECT && fetch_op.valid && (fetch_op.trace_rec.op_type == 3))
+            if (BPRED_POLICY != BPRED_PERFECT && fetch_op.valid && (pipe_latch_op(p, &fetch_op)->trace_rec.op_type == 3))
             {
-                pipe_check_bpred(p, &fetch_op, i);
+                pipe_check_bpred<W>(p, &fetch_op, i);
             }
         }
         // Copy the instruction to the IF latch.
@@ -707,21 +593,23 @@ void pipe_cycle_IF(Pipeline *p)
  * @param p the pipeline
  * @param fetch_op the pipeline latch containing the operation fetched
  */
+template <unsigned int W>
 void pipe_check_bpred(Pipeline *p, PipelineLatch *fetch_op, unsigned int i)
 {
-    BranchDirection predict = p->b_pred->predict(fetch_op->trace_rec.inst_addr); // why taking pc?
+    const TraceRec *trace_rec = &pipe_latch_op(p, fetch_op)->trace_rec;
+    BranchDirection predict = p->b_pred->predict(trace_rec->inst_addr); // why taking pc?
     // TODO: For a conditional branch instruction, get a prediction from the
     // branch predictor.
     
     BranchDirection resolution = predict;
-    // std::cout << "Pipe check bpred " << predict << ", " <<fetch_op->trace_rec.br_dir << std::endl; 
+    // std::cout << "Pipe check bpred " << predict << ", " <<trace_rec->br_dir << std::endl; 
     #ifdef VERBOSE
-        fprintf(stdout, "Pipe check bpred %d, %d\n", predict,fetch_op->trace_rec.br_dir);
+        fprintf(stdout, "Pipe check bpred %d, %d\n", predict,trace_rec->br_dir);
     #endif
-    if (predict != (fetch_op->trace_rec.br_dir)){
+    if (predict != (trace_rec->br_dir)){
         
         fetch_op->is_mispred_cbr = true;
-        for (unsigned int j = 0; j < PIPE_WIDTH; j ++){
+        for (unsigned int j = 0; j < pipe_lanes<W>(); j ++){
             p->pipe_latch[IF_LATCH][j].is_mispred_cbr = true;
             // p->pipe_latch[IF_LATCH][j].needed_bubble = 3;
         }
@@ -736,7 +624,54 @@ void pipe_check_bpred(Pipeline *p, PipelineLatch *fetch_op, unsigned int i)
     // TODO: If needed, stall the IF stage by setting the flag
     // p->fetch_cbr_stall.
 
-    p->b_pred->update(fetch_op->trace_rec.inst_addr, predict, resolution);
+    p->b_pred->update(trace_rec->inst_addr, predict, resolution);
     // TODO: Immediately update the branch predictor.
     
 }
+
+/**
+ * Simulate one cycle of every stage, from WB to IF, at width W.
+ * 
+ * @param p the pipeline to simulate
+ */
+template <unsigned int W>
+static void pipe_cycle_stages(Pipeline *p)
+{
+    pipe_cycle_WB<W>(p);
+    pipe_cycle_MA<W>(p);
+    pipe_cycle_EX<W>(p);
+    pipe_cycle_ID<W>(p);
+    pipe_cycle_IF<W>(p);
+}
+
+// The stage functions declared in pipeline.h, for any width.
+
+void pipe_cycle_WB(Pipeline *p)
+{
+    pipe_cycle_WB<0>(p);
+}
+
+void pipe_cycle_MA(Pipeline *p)
+{
+    pipe_cycle_MA<0>(p);
+}
+
+void pipe_cycle_EX(Pipeline *p)
+{
+    pipe_cycle_EX<0>(p);
+}
+
+void pipe_cycle_ID(Pipeline *p)
+{
+    pipe_cycle_ID<0>(p);
+}
+
+void pipe_cycle_IF(Pipeline *p)
+{
+    pipe_cycle_IF<0>(p);
+}
+
+void pipe_check_bpred(Pipeline *p, PipelineLatch *fetch_op, unsigned int i)
+{
+    pipe_check_bpred<0>(p, fetch_op, i);
+}
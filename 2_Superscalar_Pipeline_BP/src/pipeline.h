@@ -13,6 +13,7 @@
 
 #include "trace.h"
 #include "bpred.h"
+#include "tracering.h"
 #include <inttypes.h>
 
 /**
@@ -23,6 +24,21 @@
  */
 #define MAX_PIPE_WIDTH 8
 
+/**
+ * [Internal] The number of registers a trace record can name.
+ * 
+ * This defines the array size of Pipeline::reg_producer.
+ */
+#define NUM_REGS 256
+
+/**
+ * [Internal] The number of slots in Pipeline::ops.
+ * 
+ * This is a power of two, and at least the number of instructions that can
+ * be in flight at once: one per lane of each latch.
+ */
+#define PIPE_RING_SIZE 64
+
 /**
  * The width of the pipeline; that is, the maximum number of instructions that
  * can be in each stage of the pipeline at any given time.
@@ -64,9 +80,50 @@ extern uint32_t ENABLE_EXE_FWD;
  */
 extern BPredPolicy BPRED_POLICY;
 
+/**
+ * The geometry of the branch predictor: global history length, pattern
+ * history table size, and index hash.
+ *
+ * You should not modify this value directly; it is set by the command-line
+ * arguments -ghrbits, -phtsize, and -phthash.
+ */
+extern BPredConfig BPRED_CONFIG;
+
+/**
+ * An operation in flight in the pipeline. It stays in its slot of
+ * Pipeline::ops from the time it is fetched until it is written back, and the
+ * latches refer to it by that slot.
+ */
+typedef struct PipelineOpStruct
+{
+    /**
+     * A unique, monotonically increasing ID for this operation in the trace
+     * file.
+     * 
+     * Unlike the instruction's PC (trace_rec.inst_addr), this is guaranteed
+     * to be unique for each operation in the trace file.
+     * 
+     * Additionally, it is monotonically increasing, which allows it to be used
+     * for ordering operations: if A's op_id is less than B's op_id, then A was
+     * issued before B.
+     */
+    uint64_t op_id;
+
+    /**
+     * The trace record containing information about this instruction, such as
+     * what type of instruction it is, its address, what registers it reads and
+     * writes, and so on.
+     */
+    TraceRec trace_rec;
+} PipelineOp;
+
 /**
  * One of the latches in the pipeline. Each one of these can contain one
  * operation to be processed by the next pipeline stage.
+ * 
+ * A latch only holds the slot of its operation in Pipeline::ops, so moving an
+ * operation to the next latch copies a few bytes. Use pipe_latch_op() to get
+ * the operation itself.
  */
 typedef struct PipelineLatchStruct
 {
@@ -82,19 +139,6 @@ typedef struct PipelineLatchStruct
      */
     bool valid;
 
-    /**
-     * A unique, monotonically increasing ID for this operation in the trace
-     * file.
-     * 
-     * Unlike the instruction's PC (trace_rec->inst_addr), this is guaranteed
-     * to be unique for each operation in the trace file.
-     * 
-     * Additionally, it is monotonically increasing, which allows it to be used
-     * for ordering operations: if A's op_id is less than B's op_id, then A was
-     * issued before B.
-     */
-    uint64_t op_id;
-
     /**
      * Should this operation be stalled?
      * 
@@ -105,13 +149,6 @@ typedef struct PipelineLatchStruct
      */
     bool stall;
 
-    /**
-     * The trace record containing information about this instruction, such as
-     * what type of instruction it is, its address, what registers it reads and
-     * writes, and so on.
-     */
-    TraceRec trace_rec;
-
     /**
      * Is this operation a conditional branch that the branch predictor
      * mispredicted?
@@ -122,6 +159,9 @@ typedef struct PipelineLatchStruct
      * This is only relevant for part B of the lab.
      */
     bool is_mispred_cbr;
+
+    /** The slot of Pipeline::ops that holds this operation. */
+    uint8_t slot;
 } PipelineLatch;
 
 /**
@@ -137,6 +177,23 @@ typedef enum LatchTypeEnum
     NUM_LATCH_TYPES
 } LatchType;
 
+/**
+ * [Internal] An entry of the register scoreboard: the youngest instruction in
+ * flight that writes a register or the condition code, which is the one an
+ * instruction in ID that reads it depends on.
+ */
+typedef struct ProducerEntryStruct
+{
+    /** The op_id of the writer, or 0 if there is none. */
+    uint64_t op_id;
+    /** The op_type of the writer. */
+    uint8_t op_type;
+    /** The latch the writer is in. */
+    uint8_t latch;
+    /** For the ID_LATCH entries, the cycle in which the entry was written. */
+    uint64_t cycle;
+} ProducerEntry;
+
 /**
  * The data structure for a pipelined processor.
  */
@@ -155,6 +212,14 @@ typedef struct Pipeline
      */
     PipelineLatch pipe_latch[NUM_LATCH_TYPES][MAX_PIPE_WIDTH];
 
+    /**
+     * [Internal] The operations in flight, in a ring: the operation with a
+     * given op_id is in slot op_id % PIPE_RING_SIZE. Operations are in flight
+     * in op_id order with no gaps, so a slot is not reused until its
+     * operation has been written back.
+     */
+    PipelineOp ops[PIPE_RING_SIZE];
+
     /**
      * The branch predictor.
      * 
@@ -200,8 +265,34 @@ typedef struct Pipeline
      */
     uint64_t stat_num_cycle;
 
+    /**
+     * [Internal] The scoreboard of the EX and MA latches: for each register,
+     * the youngest writer in either latch, kept up to date by pipe_cycle_EX()
+     * and pipe_cycle_MA() as instructions move between them.
+     */
+    ProducerEntry reg_producer[NUM_REGS];
+    /** [Internal] The youngest writer of the condition code in EX or MA. */
+    ProducerEntry cc_producer;
+
+    /**
+     * [Internal] The scoreboard of the ID latch, rebuilt by pipe_cycle_ID()
+     * each cycle: for each register, the youngest writer in ID that has been
+     * checked for hazards this cycle.
+     */
+    ProducerEntry id_reg_producer[NUM_REGS];
+    /** [Internal] The ID latch scoreboard entry of the condition code. */
+    ProducerEntry id_cc_producer;
+
+    /**
+     * [Internal] Simulates one cycle of every stage, with the stage functions
+     * compiled for PIPE_WIDTH if there are any. Set by pipe_init().
+     */
+    void (*cycle_stages)(struct Pipeline *p);
+
     /** [Internal] The file descriptor from which to read trace records. */
     int trace_fd;
+    /** [Internal] Reads and checks trace records from trace_fd on a thread. */
+    TraceRing *trace_ring;
     /** [Internal] The last op_id assigned. */
     uint64_t last_op_id;
     /** [Internal] The op_id of the last instruction in the trace. */
@@ -210,6 +301,18 @@ typedef struct Pipeline
     bool halt;
 } Pipeline;
 
+/**
+ * Get the operation a pipeline latch refers to.
+ * 
+ * @param p the pipeline
+ * @param latch the latch
+ * @return the operation in the latch; only meaningful if the latch is valid
+ */
+inline PipelineOp *pipe_latch_op(Pipeline *p, const PipelineLatch *latch)
+{
+    return &p->ops[latch->slot];
+}
+
 /**
  * Allocate and initialize a new pipeline.
  * 
@@ -220,6 +323,13 @@ typedef struct Pipeline
  */
 Pipeline *pipe_init(int trace_fd);
 
+/**
+ * Stop reading the trace file. Call this before closing it.
+ * 
+ * @param p the pipeline
+ */
+void pipe_close_trace(Pipeline *p);
+
 /**
  * Simulate one cycle of all stages of a pipeline.
  * 
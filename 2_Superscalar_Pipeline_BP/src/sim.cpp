@@ -8,13 +8,20 @@
 
 #include "pipeline.h"
 #include "bpred.h"
+#include "perceptron.h"
+#include "tage.h"
+#include <algorithm>
+#include <atomic>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 /**
  * The width of the pipeline; that is, the maximum number of instructions that
@@ -57,6 +64,66 @@ uint32_t ENABLE_EXE_FWD = 0;
  */
 BPredPolicy BPRED_POLICY = BPRED_PERFECT;
 
+/**
+ * The geometry of the branch predictor: global history length, pattern
+ * history table size, and index hash.
+ * 
+ * You should not modify this value directly; it is set by the command-line
+ * arguments -ghrbits, -phtsize, and -phthash.
+ */
+BPredConfig BPRED_CONFIG;
+
+/**
+ * A Boolean indicating whether to only run the branch predictor over the
+ * conditional branches in the trace, without simulating the pipeline.
+ * 
+ * You should not modify this value directly; it is set by the command-line
+ * argument -bpredonly.
+ */
+uint32_t BPRED_ONLY = 0;
+
+/**
+ * The file listing the branch predictor configurations to sweep, or NULL to
+ * simulate as usual.
+ * 
+ * You should not modify this value directly; it is set by the command-line
+ * argument -bpredsweep.
+ */
+const char *BPRED_SWEEP_FILE = NULL;
+
+/**
+ * The number of sweep configurations to simulate at once, or 0 for one per
+ * CPU core.
+ * 
+ * You should not modify this value directly; it is set by the command-line
+ * argument -threads.
+ */
+unsigned int NUM_THREADS = 0;
+
+/** Number of trace records read from the trace file at once by -bpredonly. */
+#define TRACE_BLOCK_RECS 4096
+
+/** Longest line, and most options on a line, of a sweep file. */
+#define SWEEP_MAX_LINE 1024
+#define SWEEP_MAX_ARGS 64
+
+/** A conditional branch, as kept in memory by -bpredsweep. */
+typedef struct BranchRecStruct
+{
+    uint64_t pc;
+    BranchDirection dir;
+} BranchRec;
+
+/** One branch predictor configuration of a sweep, and its result. */
+typedef struct SweepPointStruct
+{
+    /** The options that describe the configuration, as written in the file. */
+    std::string label;
+    BPredPolicy policy;
+    BPredConfig config;
+    unsigned long stat_num_mispred;
+} SweepPoint;
+
 // #define HEARTBEAT_CYCLES 100
 #define HEARTBEAT_CYCLES 10000
 #define STAT_CYCLES (HEARTBEAT_CYCLES * 50)
@@ -65,9 +132,20 @@ Pipeline *pipeline;
 uint64_t last_hbeat_inst = 0;
 
 int parse_args(int argc, char *argv[], char **trace_filename);
+int parse_bpred_option(int argc, char *argv[], int *i, BPredPolicy *policy, BPredConfig *config);
+const char *check_bpred_config(const BPredConfig *config);
 int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid);
+int wait_gunzip(pid_t pid);
 int check_heartbeat();
+ssize_t read_trace_recs(int fd, TraceRec *recs, size_t max_recs);
+int run_bpred_only(int trace_fd, BPred *b_pred, uint64_t *num_inst, uint64_t *num_branches);
+int read_sweep_file(const char *filename, std::vector<SweepPoint> *points);
+int read_branches(int trace_fd, std::vector<BranchRec> *branches, uint64_t *num_inst);
+void run_sweep(std::vector<SweepPoint> &points, const std::vector<BranchRec> &branches);
+void print_sweep(const std::vector<SweepPoint> &points, uint64_t num_inst, uint64_t num_branches);
 void print_stats();
+void print_bpred_only_stats(const BPred *b_pred, uint64_t num_inst, uint64_t num_branches);
+void print_tournament_stats(const BPred *b_pred);
 void print_usage(char *program_name);
 
 int main(int argc, char *argv[])
@@ -82,6 +160,17 @@ int main(int argc, char *argv[])
         return status;
     }
 
+    // Read the configurations to sweep before the trace.
+    std::vector<SweepPoint> sweep_points;
+    if (BPRED_SWEEP_FILE != NULL)
+    {
+        status = read_sweep_file(BPRED_SWEEP_FILE, &sweep_points);
+        if (status != 0)
+        {
+            return status;
+        }
+    }
+
     // Open the trace file using gunzip.
     int trace_fd;
     pid_t pid;
@@ -92,6 +181,38 @@ int main(int argc, char *argv[])
         return status;
     }
 
+    if (BPRED_SWEEP_FILE != NULL)
+    {
+        // Read the branches once and run every configuration over them.
+        std::vector<BranchRec> branches;
+        uint64_t num_inst;
+        status = read_branches(trace_fd, &branches, &num_inst);
+        close(trace_fd);
+        status = status == 0 ? wait_gunzip(pid) : (waitpid(pid, NULL, 0), status);
+        if (status == 0)
+        {
+            run_sweep(sweep_points, branches);
+            print_sweep(sweep_points, num_inst, branches.size());
+        }
+        return status;
+    }
+
+    if (BPRED_ONLY)
+    {
+        // Run the branches straight through the branch predictor.
+        BPred *b_pred = BPRED_POLICY != BPRED_PERFECT ? new BPred(BPRED_POLICY, BPRED_CONFIG) : NULL;
+        uint64_t num_inst, num_branches;
+        status = run_bpred_only(trace_fd, b_pred, &num_inst, &num_branches);
+        close(trace_fd);
+        status = status == 0 ? wait_gunzip(pid) : (waitpid(pid, NULL, 0), status);
+        if (status == 0)
+        {
+            print_bpred_only_stats(b_pred, num_inst, num_branches);
+        }
+        delete b_pred;
+        return status;
+    }
+
     // Simulate the pipeline.
     pipeline = pipe_init(trace_fd);
     status = 0;
@@ -100,6 +221,7 @@ int main(int argc, char *argv[])
         pipe_cycle(pipeline);
         status = check_heartbeat();
     }
+    pipe_close_trace(pipeline);
     close(trace_fd);
     if (status != 0)
     {
@@ -123,6 +245,7 @@ int main(int argc, char *argv[])
 int parse_args(int argc, char *argv[], char **trace_filename)
 {
     *trace_filename = NULL;
+    bpred_default_config(&BPRED_CONFIG);
 
     if (argc < 2)
     {
@@ -135,6 +258,16 @@ int parse_args(int argc, char *argv[], char **trace_filename)
         if (argv[i][0] == '-')
         {
             // Parse options.
+            int status = parse_bpred_option(argc, argv, &i, &BPRED_POLICY, &BPRED_CONFIG);
+            if (status == 2)
+            {
+                return 2;
+            }
+            else if (status == 0)
+            {
+                continue;
+            }
+
             if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
             {
                 print_usage(argv[0]);
@@ -165,22 +298,56 @@ int parse_args(int argc, char *argv[], char **trace_filename)
             {
                 ENABLE_EXE_FWD = 1;
             }
-            else if (strcmp(argv[i], "-bpredpolicy") == 0)
+            else if (strcmp(argv[i], "-bpredonly") == 0)
+            {
+                BPRED_ONLY = 1;
+            }
+            else if (strcmp(argv[i], "-bpredsweep") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -bpredsweep\n");
+                    return 2;
+                }
+
+                BPRED_SWEEP_FILE = argv[i];
+            }
+            else if (strcmp(argv[i], "-threads") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to -bpredpolicy\n");
+                    fprintf(stderr, "Error: missing argument to -threads\n");
                     return 2;
                 }
 
-                int policy = atoi(argv[i]);
-                if (policy < 0 || policy >= NUM_BPRED_POLICIES)
+                int threads = atoi(argv[i]);
+                if (threads < 0)
                 {
-                    fprintf(stderr, "Error: invalid argument for -bpredpolicy\n");
+                    fprintf(stderr, "Error: -threads must not be negative\n");
                     return 2;
                 }
 
-                BPRED_POLICY = (BPredPolicy)policy;
+                NUM_THREADS = threads;
+            }
+            else if (strcmp(argv[i], "-perckernel") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -perckernel\n");
+                    return 2;
+                }
+
+                PerceptronKernel kernel;
+                if (!perceptron_parse_kernel(argv[i], &kernel))
+                {
+                    fprintf(stderr, "Error: unknown perceptron kernel: %s\n", argv[i]);
+                    return 2;
+                }
+                if (!perceptron_set_kernel(kernel))
+                {
+                    fprintf(stderr, "Error: this CPU does not support the %s kernel\n", argv[i]);
+                    return 2;
+                }
             }
             else
             {
@@ -206,6 +373,252 @@ int parse_args(int argc, char *argv[], char **trace_filename)
         return 2;
     }
 
+    const char *error = check_bpred_config(&BPRED_CONFIG);
+    if (error != NULL)
+    {
+        fprintf(stderr, "Error: %s\n", error);
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Check the branch predictor options that constrain each other, which can
+ * only be done once all of them have been parsed.
+ *
+ * @param config the parsed geometry
+ * @return NULL if the geometry is usable, or a message saying why not
+ */
+const char *check_bpred_config(const BPredConfig *config)
+{
+    if (config->tage_min_hist > config->tage_max_hist)
+    {
+        return "-tageminhist must not exceed -tagemaxhist";
+    }
+    // Concatenation puts the history in the low index bits and the PC above
+    // it, so the history must leave the PC at least one bit.
+    if (config->hash == BPRED_HASH_CONCAT &&
+        config->ghr_bits >= (uint32_t)__builtin_ctz(config->pht_size))
+    {
+        return "-phthash concat needs -ghrbits below log2 of -phtsize";
+    }
+    return NULL;
+}
+
+/**
+ * Parse one branch predictor option, such as -bpredpolicy or -ghrbits, and
+ * its argument.
+ *
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @param i the index of the option; advanced past its argument
+ * @param policy receives the policy set by -bpredpolicy
+ * @param config receives the geometry set by the other options
+ * @return 0 on success, 1 if argv[*i] is not a branch predictor option, or 2
+ * on error
+ */
+int parse_bpred_option(int argc, char *argv[], int *i, BPredPolicy *policy, BPredConfig *config)
+{
+    if (strcmp(argv[*i], "-bpredpolicy") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -bpredpolicy\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < 0 || value >= NUM_BPRED_POLICIES)
+        {
+            fprintf(stderr, "Error: invalid argument for -bpredpolicy\n");
+            return 2;
+        }
+
+        *policy = (BPredPolicy)value;
+    }
+    else if (strcmp(argv[*i], "-ghrbits") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -ghrbits\n");
+            return 2;
+        }
+
+        int ghr_bits = atoi(argv[*i]);
+        if (ghr_bits < 0 || ghr_bits > BPRED_MAX_GHR_BITS)
+        {
+            fprintf(stderr, "Error: history length must be between 0 and %d\n",
+                    BPRED_MAX_GHR_BITS);
+            return 2;
+        }
+
+        config->ghr_bits = ghr_bits;
+    }
+    else if (strcmp(argv[*i], "-phtsize") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -phtsize\n");
+            return 2;
+        }
+
+        long pht_size = atol(argv[*i]);
+        if (pht_size < BPRED_MIN_PHT_SIZE || pht_size > BPRED_MAX_PHT_SIZE ||
+            (pht_size & (pht_size - 1)) != 0)
+        {
+            fprintf(stderr, "Error: PHT size must be a power of two between %d and %d\n",
+                    BPRED_MIN_PHT_SIZE, BPRED_MAX_PHT_SIZE);
+            return 2;
+        }
+
+        config->pht_size = pht_size;
+    }
+    else if (strcmp(argv[*i], "-phthash") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -phthash\n");
+            return 2;
+        }
+
+        if (!bpred_parse_hash(argv[*i], &config->hash))
+        {
+            fprintf(stderr, "Error: unknown PHT hash: %s\n", argv[*i]);
+            return 2;
+        }
+    }
+    else if (strcmp(argv[*i], "-tagetables") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -tagetables\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < 1 || value > TAGE_MAX_TABLES)
+        {
+            fprintf(stderr, "Error: number of TAGE tables must be between %d and %d\n",
+                    1, TAGE_MAX_TABLES);
+            return 2;
+        }
+
+        config->tage_tables = value;
+    }
+    else if (strcmp(argv[*i], "-tagelogsize") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -tagelogsize\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < TAGE_MIN_LOG_SIZE || value > TAGE_MAX_LOG_SIZE)
+        {
+            fprintf(stderr, "Error: log2 of the TAGE table size must be between %d and %d\n",
+                    TAGE_MIN_LOG_SIZE, TAGE_MAX_LOG_SIZE);
+            return 2;
+        }
+
+        config->tage_log_size = value;
+    }
+    else if (strcmp(argv[*i], "-tageminhist") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -tageminhist\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < 1 || value > TAGE_MAX_HIST)
+        {
+            fprintf(stderr, "Error: shortest TAGE history must be between %d and %d\n",
+                    1, TAGE_MAX_HIST);
+            return 2;
+        }
+
+        config->tage_min_hist = value;
+    }
+    else if (strcmp(argv[*i], "-tagemaxhist") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -tagemaxhist\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < 1 || value > TAGE_MAX_HIST)
+        {
+            fprintf(stderr, "Error: longest TAGE history must be between %d and %d\n",
+                    1, TAGE_MAX_HIST);
+            return 2;
+        }
+
+        config->tage_max_hist = value;
+    }
+    else if (strcmp(argv[*i], "-tagetagbits") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -tagetagbits\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < TAGE_MIN_TAG_BITS || value > TAGE_MAX_TAG_BITS)
+        {
+            fprintf(stderr, "Error: TAGE tag width must be between %d and %d\n",
+                    TAGE_MIN_TAG_BITS, TAGE_MAX_TAG_BITS);
+            return 2;
+        }
+
+        config->tage_tag_bits = value;
+    }
+    else if (strcmp(argv[*i], "-perchist") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -perchist\n");
+            return 2;
+        }
+
+        int value = atoi(argv[*i]);
+        if (value < 1 || value > PERC_MAX_HIST)
+        {
+            fprintf(stderr, "Error: perceptron history must be between %d and %d\n",
+                    1, PERC_MAX_HIST);
+            return 2;
+        }
+
+        config->perc_hist = value;
+    }
+    else if (strcmp(argv[*i], "-percrows") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -percrows\n");
+            return 2;
+        }
+
+        long rows = atol(argv[*i]);
+        if (rows < 1 || rows > PERC_MAX_ROWS || (rows & (rows - 1)) != 0)
+        {
+            fprintf(stderr, "Error: perceptron count must be a power of two between 1 and %d\n",
+                    PERC_MAX_ROWS);
+            return 2;
+        }
+
+        config->perc_rows = rows;
+    }
+    else
+    {
+        return 1;
+    }
+
     return 0;
 }
 
@@ -248,6 +661,30 @@ int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid)
     return 0;
 }
 
+/**
+ * Wait for the gunzip process started by open_gunzip_pipe() once its output
+ * has been read to the end.
+ *
+ * @param pid the gunzip process
+ * @return 0 if gunzip decompressed the whole trace, or 1 if it failed, in
+ * which case the records read were only part of the trace
+ */
+int wait_gunzip(pid_t pid)
+{
+    int wait_status;
+    if (waitpid(pid, &wait_status, 0) == -1)
+    {
+        perror("Couldn't wait for gunzip");
+        return 1;
+    }
+    if (!WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 0)
+    {
+        fprintf(stderr, "Error: gunzip failed; the trace file is corrupt or truncated\n");
+        return 1;
+    }
+    return 0;
+}
+
 int check_heartbeat()
 {
     if (pipeline->stat_num_cycle % HEARTBEAT_CYCLES == 0)
@@ -307,11 +744,399 @@ void print_stats()
         printf("LAB2_BPRED_BRANCHES     \t : %10lu\n", stat_num_branches);
         printf("LAB2_BPRED_MISPRED      \t : %10lu\n", stat_num_mispred);
         printf("LAB2_MISPRED_RATE       \t : %10.3f\n", bpred_mispred_rate);
+
+        if (BPRED_POLICY == BPRED_TOURNAMENT)
+        {
+            print_tournament_stats(pipeline->b_pred);
+        }
     }
 
     printf("\n");
 }
 
+/**
+ * Read up to max_recs whole trace records.
+ *
+ * @param fd the trace file
+ * @param recs the buffer to read into
+ * @param max_recs the size of recs
+ * @return the number of records read, fewer than max_recs only at the end of
+ * the trace, or -1 on error
+ */
+ssize_t read_trace_recs(int fd, TraceRec *recs, size_t max_recs)
+{
+    uint8_t *buf = (uint8_t *)recs;
+    size_t bytes_left = max_recs * sizeof(TraceRec);
+    size_t bytes_read_total = 0;
+    while (bytes_left > 0)
+    {
+        ssize_t bytes_read_last = read(fd, buf + bytes_read_total, bytes_left);
+        if (bytes_read_last == -1)
+        {
+            perror("Couldn't read from pipe");
+            return -1;
+        }
+        if (bytes_read_last == 0)
+        {
+            break;
+        }
+        bytes_read_total += bytes_read_last;
+        bytes_left -= bytes_read_last;
+    }
+
+    if (bytes_read_total % sizeof(TraceRec) != 0)
+    {
+        fprintf(stderr, "Error: Invalid trace file\n");
+        return -1;
+    }
+    return bytes_read_total / sizeof(TraceRec);
+}
+
+/**
+ * Predict and train on every conditional branch of a trace in order, as
+ * pipe_check_bpred() does at fetch, with no pipeline timing.
+ *
+ * @param trace_fd the trace file
+ * @param b_pred the branch predictor, or NULL for a perfect one
+ * @param num_inst receives the number of instructions in the trace
+ * @param num_branches receives the number of conditional branches
+ * @return 0 on success, or 1 on error
+ */
+int run_bpred_only(int trace_fd, BPred *b_pred, uint64_t *num_inst, uint64_t *num_branches)
+{
+    TraceRec *recs = (TraceRec *)malloc(TRACE_BLOCK_RECS * sizeof(TraceRec));
+    if (recs == NULL)
+    {
+        perror("Couldn't allocate trace buffer");
+        return 1;
+    }
+
+    *num_inst = 0;
+    *num_branches = 0;
+    ssize_t num_recs;
+    int status = 0;
+    do
+    {
+        num_recs = read_trace_recs(trace_fd, recs, TRACE_BLOCK_RECS);
+        if (num_recs == -1)
+        {
+            status = 1;
+            break;
+        }
+
+        for (ssize_t i = 0; i < num_recs; i++)
+        {
+            if (recs[i].op_type >= NUM_OP_TYPES)
+            {
+                fprintf(stderr, "Error: Invalid trace file\n");
+                status = 1;
+                break;
+            }
+            if (recs[i].op_type != OP_CBR)
+            {
+                continue;
+            }
+
+            (*num_branches)++;
+            if (b_pred != NULL)
+            {
+                uint64_t pc = recs[i].inst_addr;
+                BranchDirection prediction = b_pred->predict(pc);
+                b_pred->update(pc, prediction, (BranchDirection)recs[i].br_dir);
+            }
+        }
+        *num_inst += num_recs;
+    } while (status == 0 && num_recs == TRACE_BLOCK_RECS);
+
+    free(recs);
+    return status;
+}
+
+/**
+ * Read a sweep file: one branch predictor configuration per line, written as
+ * the options that select it on the command line, such as
+ * "-bpredpolicy 3 -tagetables 9". Options not given on a line keep the values
+ * given on the command line. Blank lines and text after a # are ignored.
+ *
+ * @param filename the sweep file
+ * @param points receives one point per configuration
+ * @return 0 on success, or nonzero on error
+ */
+int read_sweep_file(const char *filename, std::vector<SweepPoint> *points)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        perror("Couldn't open sweep file");
+        return 1;
+    }
+
+    char line[SWEEP_MAX_LINE];
+    int line_num = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_num++;
+        // fgets() splits a longer line, and each piece would be read as a
+        // configuration of its own; only the last line may lack a newline.
+        if (strchr(line, '\n') == NULL && !feof(file))
+        {
+            fprintf(stderr, "Error: %s:%d: line longer than %d characters\n", filename, line_num,
+                    SWEEP_MAX_LINE - 2);
+            status = 2;
+            break;
+        }
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        SweepPoint point;
+        point.policy = BPRED_POLICY;
+        point.config = BPRED_CONFIG;
+        point.stat_num_mispred = 0;
+
+        // Split the line into options, and parse them as the command line is.
+        char *args[SWEEP_MAX_ARGS];
+        int num_args = 0;
+        for (char *arg = strtok(line, " \t\r\n"); arg != NULL; arg = strtok(NULL, " \t\r\n"))
+        {
+            if (num_args == SWEEP_MAX_ARGS)
+            {
+                fprintf(stderr, "Error: %s:%d: too many options\n", filename, line_num);
+                status = 2;
+                break;
+            }
+            args[num_args++] = arg;
+        }
+        if (status != 0 || num_args == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < num_args; i++)
+        {
+            point.label += (i > 0 ? " " : "");
+            point.label += args[i];
+        }
+        for (int i = 0; status == 0 && i < num_args; i++)
+        {
+            status = parse_bpred_option(num_args, args, &i, &point.policy, &point.config);
+            if (status == 1)
+            {
+                fprintf(stderr, "Error: %s:%d: not a branch predictor option: %s\n", filename,
+                        line_num, args[i]);
+                status = 2;
+            }
+            else if (status != 0)
+            {
+                fprintf(stderr, "Error: %s:%d: invalid configuration\n", filename, line_num);
+            }
+        }
+        const char *error = status == 0 ? check_bpred_config(&point.config) : NULL;
+        if (error != NULL)
+        {
+            fprintf(stderr, "Error: %s:%d: %s\n", filename, line_num, error);
+            status = 2;
+        }
+
+        points->push_back(point);
+    }
+    fclose(file);
+
+    if (status == 0 && points->empty())
+    {
+        fprintf(stderr, "Error: no configurations in sweep file %s\n", filename);
+        status = 2;
+    }
+    return status;
+}
+
+/**
+ * Read every conditional branch of a trace into memory.
+ *
+ * @param trace_fd the trace file
+ * @param branches receives the branches in trace order
+ * @param num_inst receives the number of instructions in the trace
+ * @return 0 on success, or 1 on error
+ */
+int read_branches(int trace_fd, std::vector<BranchRec> *branches, uint64_t *num_inst)
+{
+    std::vector<TraceRec> recs(TRACE_BLOCK_RECS);
+    *num_inst = 0;
+    ssize_t num_recs;
+    do
+    {
+        num_recs = read_trace_recs(trace_fd, &recs[0], TRACE_BLOCK_RECS);
+        if (num_recs == -1)
+        {
+            return 1;
+        }
+
+        for (ssize_t i = 0; i < num_recs; i++)
+        {
+            if (recs[i].op_type >= NUM_OP_TYPES)
+            {
+                fprintf(stderr, "Error: Invalid trace file\n");
+                return 1;
+            }
+            if (recs[i].op_type == OP_CBR)
+            {
+                BranchRec branch;
+                branch.pc = recs[i].inst_addr;
+                branch.dir = (BranchDirection)recs[i].br_dir;
+                branches->push_back(branch);
+            }
+        }
+        *num_inst += num_recs;
+    } while (num_recs == TRACE_BLOCK_RECS);
+
+    return 0;
+}
+
+/**
+ * Run every sweep configuration over the same branches, on a pool of
+ * NUM_THREADS threads.
+ *
+ * Each thread takes the next configuration not yet taken until none are
+ * left, and runs it with its own predictor; the branches are only read.
+ *
+ * @param points the configurations; the misprediction count of each is set
+ * @param branches the branches of the trace, in order
+ */
+void run_sweep(std::vector<SweepPoint> &points, const std::vector<BranchRec> &branches)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < points.size(); i = next++)
+        {
+            SweepPoint *point = &points[i];
+            if (point->policy == BPRED_PERFECT)
+            {
+                point->stat_num_mispred = 0;
+                continue;
+            }
+
+            BPred b_pred(point->policy, point->config);
+            for (size_t j = 0; j < branches.size(); j++)
+            {
+                BranchDirection prediction = b_pred.predict(branches[j].pc);
+                b_pred.update(branches[j].pc, prediction, branches[j].dir);
+            }
+            point->stat_num_mispred = b_pred.stat_num_mispred;
+        }
+    };
+
+    unsigned int num_threads = NUM_THREADS;
+    if (num_threads == 0)
+    {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min<size_t>(num_threads, points.size());
+
+    // The calling thread is one of the workers.
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < num_threads; t++)
+    {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); t++)
+    {
+        pool[t].join();
+    }
+}
+
+/**
+ * Print the misprediction rate of every sweep configuration, one per row, in
+ * the order of the sweep file.
+ *
+ * @param points the configurations and their results
+ * @param num_inst the number of instructions in the trace
+ * @param num_branches the number of conditional branches in the trace
+ */
+void print_sweep(const std::vector<SweepPoint> &points, uint64_t num_inst, uint64_t num_branches)
+{
+    printf("\n");
+
+    printf("LAB2_NUM_INST           \t : %10lu\n", (unsigned long)num_inst);
+    printf("LAB2_BPRED_BRANCHES     \t : %10lu\n", (unsigned long)num_branches);
+    printf("LAB2_SWEEP_CONFIGS      \t : %10lu\n", (unsigned long)points.size());
+
+    printf("\n");
+    printf("%10s  %10s  %10s  %s\n", "MISPRED", "RATE", "MPKI", "CONFIG");
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const SweepPoint *point = &points[i];
+        double mispred_rate =
+            num_branches > 0 ? 100.0 * (double)point->stat_num_mispred / (double)num_branches : 0.0;
+        double mpki = num_inst > 0 ? 1000.0 * (double)point->stat_num_mispred / (double)num_inst : 0.0;
+        printf("%10lu  %10.3f  %10.3f  %s\n", point->stat_num_mispred, mispred_rate, mpki,
+               point->label.c_str());
+    }
+
+    printf("\n");
+}
+
+/**
+ * Print the statistics of a -bpredonly run.
+ *
+ * @param b_pred the branch predictor, or NULL for a perfect one
+ * @param num_inst the number of instructions in the trace
+ * @param num_branches the number of conditional branches in the trace
+ */
+void print_bpred_only_stats(const BPred *b_pred, uint64_t num_inst, uint64_t num_branches)
+{
+    unsigned long stat_num_mispred = b_pred != NULL ? b_pred->stat_num_mispred : 0;
+    double bpred_mispred_rate =
+        num_branches > 0 ? 100.0 * (double)stat_num_mispred / (double)num_branches : 0.0;
+    double mpki = num_inst > 0 ? 1000.0 * (double)stat_num_mispred / (double)num_inst : 0.0;
+
+    printf("\n");
+
+    printf("LAB2_NUM_INST           \t : %10lu\n", (unsigned long)num_inst);
+    printf("LAB2_BPRED_BRANCHES     \t : %10lu\n", (unsigned long)num_branches);
+    printf("LAB2_BPRED_MISPRED      \t : %10lu\n", stat_num_mispred);
+    printf("LAB2_MISPRED_RATE       \t : %10.3f\n", bpred_mispred_rate);
+    printf("LAB2_BPRED_MPKI         \t : %10.3f\n", mpki);
+
+    if (BPRED_POLICY == BPRED_TOURNAMENT)
+    {
+        print_tournament_stats(b_pred);
+    }
+
+    printf("\n");
+}
+
+/**
+ * Print how often each component of the tournament predictor was chosen and
+ * how often it was right.
+ *
+ * @param b_pred the tournament predictor
+ */
+void print_tournament_stats(const BPred *b_pred)
+{
+    for (int c = 0; c < NUM_BPRED_COMPONENTS; c++)
+    {
+        unsigned long chosen = b_pred->stat_component_chosen[c];
+        unsigned long correct = b_pred->stat_component_correct[c];
+        unsigned long chosen_correct = b_pred->stat_component_chosen_correct[c];
+        unsigned long branches = b_pred->stat_num_branches;
+        char label[64];
+
+        snprintf(label, sizeof(label), "LAB2_BPRED_%s_CHOSEN", bpred_component_names[c]);
+        printf("%-24s\t : %10lu\n", label, chosen);
+        snprintf(label, sizeof(label), "LAB2_BPRED_%s_CHOSEN_OK", bpred_component_names[c]);
+        printf("%-24s\t : %10lu\n", label, chosen_correct);
+        snprintf(label, sizeof(label), "LAB2_BPRED_%s_CORRECT", bpred_component_names[c]);
+        printf("%-24s\t : %10lu\n", label, correct);
+        snprintf(label, sizeof(label), "LAB2_BPRED_%s_ACCURACY", bpred_component_names[c]);
+        printf("%-24s\t : %10.3f\n", label,
+               branches > 0 ? 100.0 * (double)correct / (double)branches : 0.0);
+    }
+}
+
 void print_usage(char *program_name)
 {
     fprintf(stderr, "Usage: %s [options] <trace file>\n\n", program_name);
@@ -322,6 +1147,39 @@ void print_usage(char *program_name)
     fprintf(stderr, "                        (disabled by default)\n");
     fprintf(stderr, "    -enableexefwd       Enable forwarding from Execute (EX) stage (disabled by\n");
     fprintf(stderr, "                        default)\n");
+    fprintf(stderr, "    -bpredonly          Only run the branch predictor over the branches,\n");
+    fprintf(stderr, "                        without simulating the pipeline\n");
+    fprintf(stderr, "    -bpredsweep <file>  Only run the branch predictor, once for each line of\n");
+    fprintf(stderr, "                        <file>, and print a table of misprediction rates;\n");
+    fprintf(stderr, "                        each line gives branch predictor options, such as\n");
+    fprintf(stderr, "                        \"-bpredpolicy 2 -ghrbits 14\"\n");
+    fprintf(stderr, "    -threads <n>        Run <n> -bpredsweep configurations at once (Default:\n");
+    fprintf(stderr, "                        one per core)\n");
     fprintf(stderr, "    -bpredpolicy <num>  Set branch predictor [0: Perfect, 1: Always Taken,\n");
-    fprintf(stderr, "                        2: Gshare] (Default: 0)\n");
+    fprintf(stderr, "                        2: Gshare, 3: TAGE, 4: Perceptron,\n");
+    fprintf(stderr, "                        5: Tournament of bimodal and gshare] (Default: 0)\n");
+    fprintf(stderr, "    -ghrbits <n>        Use <n> bits of global history (Default: %d)\n",
+            BPRED_DEFAULT_GHR_BITS);
+    fprintf(stderr, "    -phtsize <n>        Use <n> 2-bit counters, a power of two (Default: %d)\n",
+            BPRED_DEFAULT_PHT_SIZE);
+    fprintf(stderr, "    -phthash <hash>     Index the PHT by xor (PC ^ history), fold (both\n");
+    fprintf(stderr, "                        XOR-folded), or concat (PC then history; needs\n");
+    fprintf(stderr, "                        -ghrbits below log2 of -phtsize) (Default: xor)\n");
+    fprintf(stderr, "    -tagetables <n>     Use <n> TAGE tagged tables (Default: %d)\n",
+            TAGE_DEFAULT_TABLES);
+    fprintf(stderr, "    -tagelogsize <n>    Use 2^<n> entries per TAGE table (Default: %d)\n",
+            TAGE_DEFAULT_LOG_SIZE);
+    fprintf(stderr, "    -tageminhist <n>    History length of the first TAGE table (Default: %d)\n",
+            TAGE_DEFAULT_MIN_HIST);
+    fprintf(stderr, "    -tagemaxhist <n>    History length of the last TAGE table (Default: %d)\n",
+            TAGE_DEFAULT_MAX_HIST);
+    fprintf(stderr, "    -tagetagbits <n>    Width of a TAGE tag in bits (Default: %d)\n",
+            TAGE_DEFAULT_TAG_BITS);
+    fprintf(stderr, "                        -phtsize sets the size of the TAGE base table\n");
+    fprintf(stderr, "    -perchist <n>       Weigh <n> bits of global history per perceptron\n");
+    fprintf(stderr, "                        (Default: %d)\n", PERC_DEFAULT_HIST);
+    fprintf(stderr, "    -percrows <n>       Use <n> perceptrons, a power of two (Default: %d)\n",
+            PERC_DEFAULT_ROWS);
+    fprintf(stderr, "    -perckernel <k>     Compute perceptrons with the scalar or avx2 kernel\n");
+    fprintf(stderr, "                        (Default: the fastest the CPU supports)\n");
 }
@@ -0,0 +1,253 @@
+// tage.cpp
+// Implements the TAGE branch predictor.
+
+#include "tage.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void TageFoldedHistory::init(int orig_length, int comp_length)
+{
+    this->comp = 0;
+    this->orig_length = orig_length;
+    this->comp_length = comp_length;
+    this->outpoint = orig_length % comp_length;
+}
+
+TagePredictor::TagePredictor(const BPredConfig &config)
+    : num_tables(config.tage_tables), log_size(config.tage_log_size),
+      tag_bits(config.tage_tag_bits), hist_ptr(0), use_alt_on_na(0), num_updates(0),
+      rng(0x2545f491), last_pc(0), provider(-1), alt(-1), provider_pred(false),
+      alt_pred(false), pred(false)
+{
+    // History lengths grow geometrically from the shortest to the longest,
+    // each at least one longer than the last.
+    for (int i = 0; i < num_tables; i++)
+    {
+        double ratio = num_tables > 1 ? (double)i / (double)(num_tables - 1) : 0.0;
+        hist_len[i] = (int)(config.tage_min_hist *
+                                pow((double)config.tage_max_hist / config.tage_min_hist, ratio) +
+                            0.5);
+        if (i > 0 && hist_len[i] <= hist_len[i - 1])
+        {
+            hist_len[i] = hist_len[i - 1] + 1;
+        }
+        index_fold[i].init(hist_len[i], log_size);
+        tag_fold[0][i].init(hist_len[i], tag_bits);
+        tag_fold[1][i].init(hist_len[i], tag_bits - 1);
+    }
+    memset(hist, 0, sizeof(hist));
+
+    // Base counters start weakly taken, like the gshare PHT, and tagged
+    // entries start invalid.
+    base_mask = config.pht_size - 1;
+    base = (uint8_t *)malloc(config.pht_size);
+    entries = (TageEntry *)calloc((size_t)num_tables << log_size, sizeof(TageEntry));
+    if (base == NULL || entries == NULL)
+    {
+        perror("Couldn't allocate TAGE tables");
+        exit(1);
+    }
+    memset(base, 2, config.pht_size);
+}
+
+TagePredictor::~TagePredictor()
+{
+    free(base);
+    free(entries);
+}
+
+void TagePredictor::lookup(uint64_t pc)
+{
+    uint32_t index_mask = (1U << log_size) - 1;
+    uint32_t tag_mask = (1U << tag_bits) - 1;
+    for (int i = 0; i < num_tables; i++)
+    {
+        int shift = abs(log_size - i) + 1;
+        last_index[i] = (pc ^ (pc >> shift) ^ index_fold[i].comp) & index_mask;
+        last_tag[i] = (pc ^ tag_fold[0][i].comp ^ (tag_fold[1][i].comp << 1)) & tag_mask;
+    }
+    last_pc = pc;
+}
+
+BranchDirection TagePredictor::predict(uint64_t pc)
+{
+    lookup(pc);
+
+    // Find the two matches with the longest histories.
+    provider = -1;
+    alt = -1;
+    for (int i = num_tables - 1; i >= 0; i--)
+    {
+        const TageEntry *e = entry(i, last_index[i]);
+        if (e->valid && e->tag == last_tag[i])
+        {
+            if (provider < 0)
+            {
+                provider = i;
+            }
+            else
+            {
+                alt = i;
+                break;
+            }
+        }
+    }
+
+    bool base_pred = base[pc & base_mask] >= 2;
+    alt_pred = alt >= 0 ? entry(alt, last_index[alt])->ctr >= 0 : base_pred;
+    if (provider < 0)
+    {
+        provider_pred = base_pred;
+        pred = base_pred;
+    }
+    else
+    {
+        const TageEntry *e = entry(provider, last_index[provider]);
+        provider_pred = e->ctr >= 0;
+        bool newly_allocated = e->u == 0 && (e->ctr == 0 || e->ctr == -1);
+        pred = (newly_allocated && use_alt_on_na >= 0) ? alt_pred : provider_pred;
+    }
+    return pred ? TAKEN : NOT_TAKEN;
+}
+
+/** Move a signed counter towards taken or not taken, between min and max. */
+static inline int8_t ctr_update(int8_t ctr, bool taken, int8_t min, int8_t max)
+{
+    if (taken)
+    {
+        return ctr < max ? ctr + 1 : ctr;
+    }
+    return ctr > min ? ctr - 1 : ctr;
+}
+
+void TagePredictor::allocate(bool taken)
+{
+    // Prefer the shortest longer history with a free entry, but skip it half
+    // of the time when there is another, so that entries spread over tables.
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    int first = -1;
+    for (int i = provider + 1; i < num_tables; i++)
+    {
+        if (entry(i, last_index[i])->u != 0)
+        {
+            continue;
+        }
+        if (first < 0)
+        {
+            first = i;
+            if ((rng & 1) == 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            first = i;
+            break;
+        }
+    }
+
+    if (first < 0)
+    {
+        // Every candidate is useful. Age them so one frees up later.
+        for (int i = provider + 1; i < num_tables; i++)
+        {
+            TageEntry *e = entry(i, last_index[i]);
+            e->u = sat_decrement(e->u);
+        }
+        return;
+    }
+
+    TageEntry *e = entry(first, last_index[first]);
+    e->tag = last_tag[first];
+    e->ctr = taken ? 0 : -1;
+    e->u = 0;
+    e->valid = 1;
+}
+
+void TagePredictor::update(uint64_t pc, BranchDirection resolution)
+{
+    if (pc != last_pc)
+    {
+        // update() without a matching predict(): look the branch up again.
+        predict(pc);
+    }
+    bool taken = (resolution == TAKEN);
+
+    if (provider >= 0)
+    {
+        TageEntry *e = entry(provider, last_index[provider]);
+
+        // Learn whether newly allocated providers are worse than the
+        // alternate.
+        bool newly_allocated = e->u == 0 && (e->ctr == 0 || e->ctr == -1);
+        if (newly_allocated && provider_pred != alt_pred)
+        {
+            use_alt_on_na = ctr_update(use_alt_on_na, alt_pred == taken, -8, 7);
+        }
+
+        if (pred != taken && provider < num_tables - 1)
+        {
+            allocate(taken);
+        }
+
+        // Train the provider, and the alternate too while the provider has
+        // not proven useful.
+        e->ctr = ctr_update(e->ctr, taken, -4, 3);
+        if (e->u == 0)
+        {
+            if (alt >= 0)
+            {
+                TageEntry *a = entry(alt, last_index[alt]);
+                a->ctr = ctr_update(a->ctr, taken, -4, 3);
+            }
+            else
+            {
+                uint8_t *b = &base[pc & base_mask];
+                *b = taken ? sat_increment(*b, 3) : sat_decrement(*b);
+            }
+        }
+
+        // The provider is useful when it was right and the alternate was not.
+        if (provider_pred != alt_pred)
+        {
+            e->u = provider_pred == taken ? sat_increment(e->u, 3) : sat_decrement(e->u);
+        }
+    }
+    else
+    {
+        if (pred != taken)
+        {
+            allocate(taken);
+        }
+        uint8_t *b = &base[pc & base_mask];
+        *b = taken ? sat_increment(*b, 3) : sat_decrement(*b);
+    }
+
+    // Let entries that stopped being useful be replaced eventually.
+    if (++num_updates % TAGE_U_RESET_PERIOD == 0)
+    {
+        size_t num_entries = (size_t)num_tables << log_size;
+        for (size_t i = 0; i < num_entries; i++)
+        {
+            entries[i].u >>= 1;
+        }
+    }
+
+    // Shift the outcome into the history and every folded copy of it.
+    hist_ptr = (hist_ptr - 1) & (TAGE_HIST_BUF_SIZE - 1);
+    hist[hist_ptr] = taken;
+    for (int i = 0; i < num_tables; i++)
+    {
+        index_fold[i].update(hist, hist_ptr);
+        tag_fold[0][i].update(hist, hist_ptr);
+        tag_fold[1][i].update(hist, hist_ptr);
+    }
+
+    // The next update() needs a fresh lookup.
+    last_pc = ~pc;
+}
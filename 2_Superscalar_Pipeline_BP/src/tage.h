@@ -0,0 +1,174 @@
+// tage.h
+// Declares a TAGE branch predictor: a PC-indexed bimodal base table backed by
+// tagged tables indexed with geometrically longer global histories, as
+// described by Seznec and Michaud, "A case for (partially) TAgged GEometric
+// history length branch prediction", JILP 2006.
+
+#ifndef _TAGE_H_
+#define _TAGE_H_
+
+#include "bpred.h"
+#include <inttypes.h>
+
+/** Largest number of tagged tables. */
+#define TAGE_MAX_TABLES 16
+/** Longest global history a tagged table can use. */
+#define TAGE_MAX_HIST 1024
+/** Size of the circular global history buffer; a power of two > TAGE_MAX_HIST. */
+#define TAGE_HIST_BUF_SIZE 2048
+/** Smallest and largest log2 of the number of entries in a tagged table. */
+#define TAGE_MIN_LOG_SIZE 4
+#define TAGE_MAX_LOG_SIZE 20
+/** Smallest and largest tag width in bits. */
+#define TAGE_MIN_TAG_BITS 4
+#define TAGE_MAX_TAG_BITS 16
+
+/** Default geometry: 7 tables of 1K entries with 4 to 256 bits of history. */
+#define TAGE_DEFAULT_TABLES 7
+#define TAGE_DEFAULT_LOG_SIZE 10
+#define TAGE_DEFAULT_MIN_HIST 4
+#define TAGE_DEFAULT_MAX_HIST 256
+#define TAGE_DEFAULT_TAG_BITS 9
+
+/** Number of updates between halvings of every usefulness counter. */
+#define TAGE_U_RESET_PERIOD (1 << 18)
+
+/** One entry of a tagged table. */
+typedef struct TageEntryStruct
+{
+    /** Signed 3-bit prediction counter: taken if >= 0. */
+    int8_t ctr;
+    /** 2-bit usefulness counter. */
+    uint8_t u : 2;
+    /**
+     * Set once the entry has been allocated. A tag can take any value, so a
+     * zeroed entry would otherwise match every lookup whose tag is 0.
+     */
+    uint8_t valid : 1;
+    /** Partial tag of the branch and history that allocated the entry. */
+    uint16_t tag;
+} TageEntry;
+
+/**
+ * A global history of orig_length bits XOR-folded down to comp_length bits,
+ * updated in O(1) as each outcome is shifted in and the oldest shifted out.
+ */
+typedef struct TageFoldedHistoryStruct
+{
+    uint32_t comp;
+    int comp_length;
+    int orig_length;
+    /** Where the outcome leaving the history lands in comp. */
+    int outpoint;
+
+    void init(int orig_length, int comp_length);
+
+    /**
+     * Shift the newest outcome in and the one orig_length branches old out.
+     *
+     * @param hist the circular global history, newest outcome at hist[ptr]
+     * @param ptr the position of the newest outcome
+     */
+    inline void update(const uint8_t *hist, int ptr)
+    {
+        comp = (comp << 1) | hist[ptr];
+        comp ^= (uint32_t)hist[(ptr + orig_length) & (TAGE_HIST_BUF_SIZE - 1)] << outpoint;
+        comp ^= comp >> comp_length;
+        comp &= (1U << comp_length) - 1;
+    }
+} TageFoldedHistory;
+
+/**
+ * A TAGE predictor.
+ *
+ * Tagged table i is indexed and tagged with a hash of the PC and the last
+ * hist_len[i] outcomes, the lengths growing geometrically from the shortest
+ * to the longest. The prediction comes from the matching entry with the
+ * longest history (the provider), or from the next match (the alternate)
+ * when the provider was only just allocated and such entries have been
+ * proving wrong. A misprediction allocates an entry in a table with a longer
+ * history than the provider's, taking one whose usefulness counter is 0.
+ *
+ * predict() records the lookup, and update() must follow for the same
+ * branch before the next predict().
+ */
+class TagePredictor
+{
+public:
+    /**
+     * @param config the geometry: pht_size is the number of base counters,
+     * and the tage_* fields describe the tagged tables
+     */
+    TagePredictor(const BPredConfig &config);
+    ~TagePredictor();
+
+    /** @return the prediction for the branch at pc */
+    BranchDirection predict(uint64_t pc);
+
+    /**
+     * Train the tables with the outcome of the branch last predicted and
+     * shift it into the history.
+     *
+     * @param pc the address of the branch
+     * @param resolution the outcome of the branch
+     */
+    void update(uint64_t pc, BranchDirection resolution);
+
+    /** @return the history length of tagged table i */
+    int get_hist_len(int i) const
+    {
+        return hist_len[i];
+    }
+
+private:
+    int num_tables;
+    int log_size;
+    int tag_bits;
+    int hist_len[TAGE_MAX_TABLES];
+
+    /** The bimodal base table, one 2-bit counter per byte. */
+    uint8_t *base;
+    uint32_t base_mask;
+
+    /** The tagged tables, each 1 << log_size entries, in one allocation. */
+    TageEntry *entries;
+
+    /** The global history, newest outcome at hist[hist_ptr]. */
+    uint8_t hist[TAGE_HIST_BUF_SIZE];
+    int hist_ptr;
+    TageFoldedHistory index_fold[TAGE_MAX_TABLES];
+    TageFoldedHistory tag_fold[2][TAGE_MAX_TABLES];
+
+    /** Signed 4-bit counter: use the alternate over a newly allocated provider if >= 0. */
+    int8_t use_alt_on_na;
+    uint64_t num_updates;
+    /** State of the generator that spreads allocations over the tables. */
+    uint32_t rng;
+
+    // The last lookup, reused by update().
+    uint64_t last_pc;
+    uint32_t last_index[TAGE_MAX_TABLES];
+    uint16_t last_tag[TAGE_MAX_TABLES];
+    int provider;
+    int alt;
+    bool provider_pred;
+    bool alt_pred;
+    bool pred;
+
+    TageEntry *entry(int table, uint32_t index) const
+    {
+        return &entries[((size_t)table << log_size) + index];
+    }
+
+    /** Compute the index and tag of pc in every table. */
+    void lookup(uint64_t pc);
+
+    /** Allocate entries for a mispredicted branch in longer-history tables. */
+    void allocate(bool taken);
+
+    // Predictors own their tables and are not copied.
+    TagePredictor(const TagePredictor &);
+    TagePredictor &operator=(const TagePredictor &);
+};
+
+#endif
@@ -0,0 +1,284 @@
+// tracering.cpp
+// Implements the background trace reader.
+//
+// The reader thread is the only writer of head and the simulator the only
+// writer of tail, so the ring needs no lock: each side publishes its index
+// with a release store and reads the other's with an acquire load. A side
+// that runs out parks on a condition variable after raising its waiting
+// flag, and the other side takes the lock to wake it only when it sees that
+// flag, so neither spins and the common case never locks.
+
+#include "tracering.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * A reader that finds the ring full sleeps until this many records are free,
+ * and the consumer checks for a sleeping reader each time it takes this many.
+ */
+#define TRACERING_WAKE (TRACERING_SIZE / 4)
+
+struct TraceRingStruct
+{
+    /** The records, record i in slot i % TRACERING_SIZE. */
+    TraceRec recs[TRACERING_SIZE];
+
+    /** The number of records the reader has published. */
+    alignas(64) std::atomic<uint64_t> head;
+    /** Set by the reader after it has published its last record. */
+    std::atomic<bool> finished;
+    /** How the trace ended; valid once finished is set. */
+    TraceRingStatus end_status;
+    /** The errno of a failed read; valid once finished is set. */
+    int end_errno;
+
+    /** The number of records the consumer has taken. */
+    alignas(64) std::atomic<uint64_t> tail;
+    /** Set by tracering_close() to stop the reader. */
+    std::atomic<bool> stop;
+
+    /** The consumer's copy of head, refreshed only when it runs out. */
+    alignas(64) uint64_t head_seen;
+    /** Whether the consumer has returned end_status. */
+    bool end_reported;
+
+    /** Guards sleeping and waking on the condition variables. */
+    alignas(64) std::mutex mutex;
+    /** Signalled when the consumer frees space for a sleeping reader. */
+    std::condition_variable space_free;
+    /** Signalled when the reader publishes records or finishes. */
+    std::condition_variable records_ready;
+    /** Set while the reader sleeps on space_free. */
+    std::atomic<bool> reader_waiting;
+    /** Set while the consumer sleeps on records_ready. */
+    std::atomic<bool> consumer_waiting;
+
+    /** The trace file. */
+    int fd;
+    /** The reader thread. */
+    std::thread reader;
+};
+
+/**
+ * Wake the consumer if it is sleeping. Called by the reader after publishing.
+ */
+static void tracering_wake_consumer(TraceRing *r)
+{
+    // Pairs with the fence in tracering_wait_for_records(): either the
+    // consumer sees what was just published, or this sees it waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (r->consumer_waiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        r->records_ready.notify_one();
+    }
+}
+
+/**
+ * Wake the reader if it is sleeping. Called by the consumer after freeing
+ * space.
+ */
+static void tracering_wake_reader(TraceRing *r)
+{
+    // Pairs with the fence in tracering_wait_for_space().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (r->reader_waiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        r->space_free.notify_one();
+    }
+}
+
+/**
+ * Reader thread: sleep until TRACERING_WAKE records are free or the ring is
+ * closed.
+ */
+static void tracering_wait_for_space(TraceRing *r, uint64_t bytes_written)
+{
+    const uint64_t max_used = sizeof(r->recs) - TRACERING_WAKE * sizeof(TraceRec);
+    std::unique_lock<std::mutex> lock(r->mutex);
+    r->reader_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!r->stop.load(std::memory_order_relaxed) &&
+           bytes_written - r->tail.load(std::memory_order_acquire) * sizeof(TraceRec) > max_used)
+    {
+        r->space_free.wait(lock);
+    }
+    r->reader_waiting.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * Consumer: sleep until the reader publishes record next or finishes.
+ */
+static void tracering_wait_for_records(TraceRing *r, uint64_t next)
+{
+    // The ring is empty, so a reader waiting for space may go on. The
+    // consumer only checks for one every TRACERING_WAKE records, and the
+    // reader may have started waiting after the last check.
+    tracering_wake_reader(r);
+
+    std::unique_lock<std::mutex> lock(r->mutex);
+    r->consumer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!r->finished.load(std::memory_order_acquire) &&
+           r->head.load(std::memory_order_acquire) == next)
+    {
+        r->records_ready.wait(lock);
+    }
+    r->consumer_waiting.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * Reader thread: fill the free part of the ring from the file, and publish
+ * each batch of whole, valid records.
+ */
+static void tracering_reader(TraceRing *r)
+{
+    const size_t ring_bytes = sizeof(r->recs);
+    uint8_t *buf = (uint8_t *)r->recs;
+    uint64_t bytes_written = 0;
+    uint64_t published = 0;
+    TraceRingStatus status = TRACERING_END;
+    int read_errno = 0;
+
+    while (!r->stop.load(std::memory_order_relaxed))
+    {
+        // Records never straddle the end of the ring, since the ring holds a
+        // whole number of them, but a read can end partway through one.
+        uint64_t tail = r->tail.load(std::memory_order_acquire);
+        size_t free_bytes = ring_bytes - (size_t)(bytes_written - tail * sizeof(TraceRec));
+        if (free_bytes == 0)
+        {
+            tracering_wait_for_space(r, bytes_written);
+            continue;
+        }
+        size_t pos = bytes_written % ring_bytes;
+        ssize_t bytes_read = read(r->fd, buf + pos, std::min(free_bytes, ring_bytes - pos));
+        if (bytes_read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            status = TRACERING_READ_ERROR;
+            read_errno = errno;
+            break;
+        }
+        if (bytes_read == 0)
+        {
+            status = bytes_written % sizeof(TraceRec) == 0 ? TRACERING_END : TRACERING_INVALID;
+            break;
+        }
+        bytes_written += bytes_read;
+
+        // Check the records completed by this read before publishing them.
+        uint64_t complete = bytes_written / sizeof(TraceRec);
+        uint64_t valid = published;
+        while (valid < complete && r->recs[valid % TRACERING_SIZE].op_type < NUM_OP_TYPES)
+        {
+            valid++;
+        }
+        published = valid;
+        r->head.store(published, std::memory_order_release);
+        tracering_wake_consumer(r);
+        if (valid < complete)
+        {
+            status = TRACERING_INVALID;
+            break;
+        }
+    }
+
+    r->end_status = status;
+    r->end_errno = read_errno;
+    r->finished.store(true, std::memory_order_release);
+    tracering_wake_consumer(r);
+}
+
+TraceRing *tracering_open(int fd)
+{
+    TraceRing *r = new (std::nothrow) TraceRing();
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->head = 0;
+    r->finished = false;
+    r->end_status = TRACERING_END;
+    r->end_errno = 0;
+    r->tail = 0;
+    r->stop = false;
+    r->head_seen = 0;
+    r->end_reported = false;
+    r->reader_waiting = false;
+    r->consumer_waiting = false;
+    r->fd = fd;
+
+    try
+    {
+        r->reader = std::thread(tracering_reader, r);
+    }
+    catch (const std::exception &)
+    {
+        delete r;
+        return NULL;
+    }
+    return r;
+}
+
+TraceRingStatus tracering_next(TraceRing *r, TraceRec *rec)
+{
+    uint64_t next = r->tail.load(std::memory_order_relaxed);
+    while (next == r->head_seen)
+    {
+        // Check finished before head, so no record published before the
+        // reader finished can be missed.
+        bool finished = r->finished.load(std::memory_order_acquire);
+        r->head_seen = r->head.load(std::memory_order_acquire);
+        if (next < r->head_seen)
+        {
+            break;
+        }
+        if (finished)
+        {
+            if (r->end_reported || r->end_status == TRACERING_END)
+            {
+                return TRACERING_END;
+            }
+            r->end_reported = true;
+            errno = r->end_errno;
+            return r->end_status;
+        }
+        tracering_wait_for_records(r, next);
+    }
+
+    *rec = r->recs[next % TRACERING_SIZE];
+    r->tail.store(next + 1, std::memory_order_release);
+    if ((next + 1) % TRACERING_WAKE == 0)
+    {
+        tracering_wake_reader(r);
+    }
+    return TRACERING_OK;
+}
+
+void tracering_close(TraceRing *r)
+{
+    if (r == NULL)
+    {
+        return;
+    }
+    {
+        // Stop under the lock, so a reader about to sleep sees it.
+        std::lock_guard<std::mutex> lock(r->mutex);
+        r->stop.store(true, std::memory_order_relaxed);
+    }
+    r->space_free.notify_one();
+    r->reader.join();
+    delete r;
+}
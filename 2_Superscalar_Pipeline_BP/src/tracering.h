@@ -0,0 +1,57 @@
+// tracering.h
+// Declares a trace reader that reads and validates trace records on a
+// background thread, handing them to the simulator through a single-producer,
+// single-consumer ring that takes a lock only to sleep when full or empty.
+
+#ifndef _TRACERING_H_
+#define _TRACERING_H_
+
+#include "trace.h"
+#include <inttypes.h>
+
+/** Number of trace records the ring holds; a power of two. */
+#define TRACERING_SIZE 4096
+
+/** The result of taking a record from the ring. */
+typedef enum TraceRingStatusEnum
+{
+    TRACERING_OK,         // A record was taken.
+    TRACERING_END,        // The trace has ended.
+    TRACERING_INVALID,    // The trace ended in a partial or invalid record.
+    TRACERING_READ_ERROR, // Reading the trace file failed; errno is set.
+} TraceRingStatus;
+
+typedef struct TraceRingStruct TraceRing;
+
+/**
+ * Start reading trace records from a file on a new thread.
+ *
+ * The thread reads the file in large chunks and checks that every record has
+ * a valid op_type, so the consumer only copies records out of the ring.
+ *
+ * @param fd the trace file; it must stay open until tracering_close()
+ * @return the ring, or NULL if the thread could not be started
+ */
+TraceRing *tracering_open(int fd);
+
+/**
+ * Take the next trace record, waiting for the reader thread if needed.
+ *
+ * Records are taken in file order. Once the records run out, the result is
+ * TRACERING_INVALID or TRACERING_READ_ERROR once if the trace did not end
+ * cleanly, and TRACERING_END from then on. Only one thread may take records.
+ *
+ * @param r the ring
+ * @param rec receives the record
+ * @return TRACERING_OK if a record was taken
+ */
+TraceRingStatus tracering_next(TraceRing *r, TraceRec *rec);
+
+/**
+ * Stop the reader thread and free the ring. The trace file is not closed.
+ *
+ * @param r the ring, or NULL
+ */
+void tracering_close(TraceRing *r);
+
+#endif